@@ -0,0 +1,204 @@
+// Host benchmark of the calendar image decoders: the PNG path loadImage()
+// takes for /calendar.png against the run-length coded /calendar.ink.
+//
+//   python3 sim/calendar_stub.py --dump /tmp/cal
+//   pio run -e bench
+//   .pio/build/bench/program /tmp/cal/calendar.png /tmp/cal/calendar.ink
+//
+// Both images are decoded into a 3-bit framebuffer the way the firmware
+// does it, checked to be identical, and timed over a number of runs. The
+// PNG header checks are run against crafted headers first.
+#include <Inkplate.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "framebuffer.h"
+#include "inkrle.h"
+#include "png.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+#define BENCH_RUNS 20
+// Input arrives in TCP segment sized reads, as from WiFiClient.
+#define BENCH_READ_CHUNK 1460
+
+struct MemSource {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+};
+
+static int readMem(void* ctx, uint8_t* buf, size_t len) {
+    MemSource* src = (MemSource*)ctx;
+    size_t n = src->data->size() - src->pos;
+    if (n > len) n = len;
+    if (n > BENCH_READ_CHUNK) n = BENCH_READ_CHUNK;
+    memcpy(buf, src->data->data() + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+static uint8_t pngFramebuffer[FRAMEBUFFER_SIZE];
+static uint8_t inkFramebuffer[FRAMEBUFFER_SIZE];
+
+// Same as drawRow() and framebufferWriteRow() in rotation 1.
+static void drawRow(void* ctx, int y, const uint8_t* gray, int width) {
+    if (width > E_INK_HEIGHT) width = E_INK_HEIGHT;
+    int px = E_INK_WIDTH - 1 - y;
+    if (px < 0) return;
+    for (int x = 0; x < width; x++) {
+        uint8_t* b = pngFramebuffer + (x * E_INK_WIDTH + px) / 2;
+        uint8_t level = gray[x] >> 5;
+        *b = (px & 1) ? (*b & 0xf0) | level : (*b & 0x0f) | (level << 4);
+    }
+}
+
+static esp_err_t decodePng(const std::vector<uint8_t>& data) {
+    MemSource src = {&data, 0};
+    PngInfo info;
+    return pngDecode(readMem, &src, drawRow, NULL, &info);
+}
+
+// The header is checked by inkParseHeader() on the device; only the
+// encoding matters here.
+static esp_err_t decodeInk(const std::vector<uint8_t>& data) {
+    if (data.size() < INK_HEADER_SIZE ||
+        memcmp(data.data(), INK_MAGIC, 4) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (data[6] == INK_ENCODING_RAW) {
+        if (data.size() != INK_HEADER_SIZE + FRAMEBUFFER_SIZE) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(inkFramebuffer, data.data() + INK_HEADER_SIZE,
+               FRAMEBUFFER_SIZE);
+        return ESP_OK;
+    }
+    MemSource src = {&data, INK_HEADER_SIZE};
+    uint32_t bytesIn;
+    return inkRleDecode(readMem, &src, inkFramebuffer, E_INK_WIDTH,
+                        E_INK_HEIGHT, &bytesIn);
+}
+
+// A PNG that ends right after its IHDR chunk. CRCs are not checked by the
+// decoder, so the IHDR's is left as zero.
+static std::vector<uint8_t> pngHeader(uint8_t bitDepth, uint8_t colorType) {
+    std::vector<uint8_t> data = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',  // signature
+        0,    0,   0,   13,  'I',  'H',  'D',  'R',   // IHDR
+        0,    0,   0,   1,   0,    0,    0,    1,     // 1x1
+        bitDepth, colorType, 0, 0, 0,                // no interlace
+        0,    0,   0,   0};                           // CRC
+    return data;
+}
+
+// Every colour type and bit depth the PNG specification allows must get
+// past the header, and every other pair must be rejected before decoding.
+static bool checkHeaders() {
+    // Allowed bit depths as bit masks, indexed by colour type.
+    static const uint32_t allowed[8] = {
+        1 << 1 | 1 << 2 | 1 << 4 | 1 << 8 | 1 << 16,  // gray
+        0,
+        1 << 8 | 1 << 16,                    // RGB
+        1 << 1 | 1 << 2 | 1 << 4 | 1 << 8,  // palette
+        1 << 8 | 1 << 16,                    // gray and alpha
+        0,
+        1 << 8 | 1 << 16,  // RGBA
+        0,
+    };
+    bool ok = true;
+    for (int colorType = 0; colorType < 8; colorType++) {
+        for (int bitDepth = 0; bitDepth < 32; bitDepth++) {
+            bool valid = allowed[colorType] >> bitDepth & 1;
+            std::vector<uint8_t> data = pngHeader(bitDepth, colorType);
+            MemSource src = {&data, 0};
+            esp_err_t err = pngDecode(readMem, &src, drawRow, NULL, NULL);
+            // Valid headers run out of input before the first IDAT.
+            esp_err_t want =
+                valid ? ESP_ERR_TIMEOUT : ESP_ERR_INVALID_RESPONSE;
+            if (err != want) {
+                fprintf(stderr,
+                        "colour type %d bit depth %d: got %d, want %d\n",
+                        colorType, bitDepth, err, want);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void bench(const char* name, const std::vector<uint8_t>& data,
+                  esp_err_t (*decode)(const std::vector<uint8_t>&)) {
+    double bestNs = 1e18;
+    unsigned long long bestCycles = ~0ULL;
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long c0 = CYCLES();
+        esp_err_t err = decode(data);
+        unsigned long long cycles = CYCLES() - c0;
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (err != ESP_OK) {
+            printf("%s: decode failed (%d)\n", name, err);
+            return;
+        }
+        if (ns < bestNs) bestNs = ns;
+        if (cycles < bestCycles) bestCycles = cycles;
+    }
+    printf("%-4s %8zu bytes %6.2f%% %9.3fms %12llu cycles %7.2f cycles/px\n",
+           name, data.size(), 100.0 * data.size() / FRAMEBUFFER_SIZE,
+           bestNs / 1e6, bestCycles,
+           (double)bestCycles / (E_INK_WIDTH * E_INK_HEIGHT));
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s calendar.png calendar.ink\n", argv[0]);
+        return 2;
+    }
+    if (!checkHeaders()) {
+        fprintf(stderr, "PNG header checks failed\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> png, ink;
+    if (!readFile(argv[1], &png) || !readFile(argv[2], &ink)) {
+        perror("read");
+        return 1;
+    }
+
+    if (decodePng(png) != ESP_OK || decodeInk(ink) != ESP_OK) {
+        fprintf(stderr, "cannot decode the images\n");
+        return 1;
+    }
+    if (memcmp(pngFramebuffer, inkFramebuffer, FRAMEBUFFER_SIZE) != 0) {
+        fprintf(stderr, "images decode to different framebuffers\n");
+        return 1;
+    }
+
+    printf("best of %d runs, %d byte framebuffer:\n", BENCH_RUNS,
+           FRAMEBUFFER_SIZE);
+    bench("png", png, decodePng);
+    bench("ink", ink, decodeInk);
+    return 0;
+}
@@ -0,0 +1,208 @@
+// Host benchmark of the dithering kernels against the PNG decoder that
+// feeds them, to check dithering keeps up with decoding the rows.
+//
+//   python3 sim/calendar_stub.py --dump /tmp/cal
+//   pio run -e dither_bench
+//   .pio/build/dither_bench/program /tmp/cal/calendar.png
+//
+// The PNG is decoded to 8-bit gray rows once, then each kernel is timed
+// quantising the rows into a 3-bit framebuffer the way drawRow() does, and
+// compared with the decode alone. How well each keeps the image's tone is
+// reported as the mean difference of 8x8 block averages from the source.
+#include <Inkplate.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "dither.h"
+#include "framebuffer.h"
+#include "png.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+#define BENCH_RUNS 20
+// Input arrives in TCP segment sized reads, as from WiFiClient.
+#define BENCH_READ_CHUNK 1460
+// Side of the blocks whose average tone is compared.
+#define BENCH_BLOCK 8
+
+struct MemSource {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+};
+
+static int readMem(void* ctx, uint8_t* buf, size_t len) {
+    MemSource* src = (MemSource*)ctx;
+    size_t n = src->data->size() - src->pos;
+    if (n > len) n = len;
+    if (n > BENCH_READ_CHUNK) n = BENCH_READ_CHUNK;
+    memcpy(buf, src->data->data() + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+static uint8_t framebuffer[FRAMEBUFFER_SIZE];
+// The decoded image, and the part of it that fits the panel.
+static std::vector<uint8_t> image;
+static int imageStride, imageWidth, imageHeight;
+
+// Same as framebufferWriteRow() in rotation 1.
+static void writeRow(int y, const uint8_t* levels, int width) {
+    if (width > E_INK_HEIGHT) width = E_INK_HEIGHT;
+    int px = E_INK_WIDTH - 1 - y;
+    if (px < 0) return;
+    for (int x = 0; x < width; x++) {
+        uint8_t* b = framebuffer + (x * E_INK_WIDTH + px) / 2;
+        uint8_t level = levels[x];
+        *b = (px & 1) ? (*b & 0xf0) | level : (*b & 0x0f) | (level << 4);
+    }
+}
+
+static uint8_t readLevel(int x, int y) {
+    int px = E_INK_WIDTH - 1 - y;
+    uint8_t b = framebuffer[(x * E_INK_WIDTH + px) / 2];
+    return (px & 1) ? b & 0x0f : b >> 4;
+}
+
+// Same as drawRow() without dithering.
+static void drawRow(void* ctx, int y, const uint8_t* gray, int width) {
+    static uint8_t levels[E_INK_WIDTH];
+    if (width > E_INK_WIDTH) width = E_INK_WIDTH;
+    for (int x = 0; x < width; x++) levels[x] = gray[x] >> 5;
+    writeRow(y, levels, width);
+}
+
+static void keepRow(void* ctx, int y, const uint8_t* gray, int width) {
+    image.insert(image.end(), gray, gray + width);
+    imageStride = width;
+    imageWidth = width > E_INK_HEIGHT ? E_INK_HEIGHT : width;
+    imageHeight = y + 1 > E_INK_WIDTH ? E_INK_WIDTH : y + 1;
+}
+
+static esp_err_t decodePng(const std::vector<uint8_t>& data,
+                           PngRowFn row) {
+    MemSource src = {&data, 0};
+    PngInfo info;
+    return pngDecode(readMem, &src, row, NULL, &info);
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static esp_err_t ditherImage(uint8_t kernel) {
+    static uint8_t levels[E_INK_WIDTH];
+    Dither dither;
+    esp_err_t err = ditherBegin(&dither, kernel);
+    if (err != ESP_OK) return err;
+    for (int y = 0; y < imageHeight; y++) {
+        ditherRow(&dither, image.data() + (size_t)y * imageStride, levels,
+                  imageWidth);
+        writeRow(y, levels, imageWidth);
+    }
+    ditherEnd(&dither);
+    return ESP_OK;
+}
+
+/**
+  Mean difference, in 8-bit gray, between the average of each block of the
+  source and of the framebuffer.
+*/
+static double toneError() {
+    double total = 0;
+    int blocks = 0;
+    for (int by = 0; by + BENCH_BLOCK <= imageHeight; by += BENCH_BLOCK) {
+        for (int bx = 0; bx + BENCH_BLOCK <= imageWidth; bx += BENCH_BLOCK) {
+            int in = 0, out = 0;
+            for (int y = by; y < by + BENCH_BLOCK; y++) {
+                for (int x = bx; x < bx + BENCH_BLOCK; x++) {
+                    in += image[(size_t)y * imageStride + x];
+                    out += readLevel(x, y) * 255 / (FRAMEBUFFER_LEVELS - 1);
+                }
+            }
+            total += abs(in - out);
+            blocks++;
+        }
+    }
+    return blocks ? total / blocks / (BENCH_BLOCK * BENCH_BLOCK) : 0;
+}
+
+/**
+  Time a run, the best of BENCH_RUNS.
+
+  @returns the cycles taken, or 0 if it failed.
+*/
+static unsigned long long bench(const char* name, esp_err_t (*run)(int),
+                                int arg, unsigned long long decodeCycles) {
+    double bestNs = 1e18;
+    unsigned long long bestCycles = ~0ULL;
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long c0 = CYCLES();
+        esp_err_t err = run(arg);
+        unsigned long long cycles = CYCLES() - c0;
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (err != ESP_OK) {
+            printf("%s: failed (%d)\n", name, err);
+            return 0;
+        }
+        if (ns < bestNs) bestNs = ns;
+        if (cycles < bestCycles) bestCycles = cycles;
+    }
+    printf("%-16s %9.3fms %12llu cycles %7.2f cycles/px", name, bestNs / 1e6,
+           bestCycles, (double)bestCycles / (imageWidth * imageHeight));
+    if (decodeCycles && bestCycles) {
+        printf(" %6.1fx decode, tone error %5.2f\n",
+               (double)decodeCycles / bestCycles, toneError());
+    } else {
+        printf("\n");
+    }
+    return bestCycles;
+}
+
+static std::vector<uint8_t> png;
+
+static esp_err_t runDecode(int) { return decodePng(png, drawRow); }
+
+static esp_err_t runDither(int kernel) { return ditherImage(kernel); }
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s calendar.png\n", argv[0]);
+        return 2;
+    }
+    if (!readFile(argv[1], &png)) {
+        perror("read");
+        return 1;
+    }
+
+    if (decodePng(png, keepRow) != ESP_OK) {
+        fprintf(stderr, "cannot decode the PNG\n");
+        return 1;
+    }
+
+    printf("best of %d runs, %dx%zu PNG of %zu bytes:\n", BENCH_RUNS,
+           imageStride, image.size() / imageStride, png.size());
+    unsigned long long decode = bench("decode", runDecode, 0, 0);
+    bench("none", runDither, DITHER_NONE, decode);
+    bench("floyd-steinberg", runDither, DITHER_FLOYD_STEINBERG, decode);
+    bench("atkinson", runDither, DITHER_ATKINSON, decode);
+    return 0;
+}
@@ -0,0 +1,238 @@
+// Host stress test and benchmark of the receive/decode pipeline behind
+// loadImage(url, stats), with the receive task and the decoder on two
+// threads as on the device's two cores.
+//
+//   python3 sim/calendar_stub.py --dump /tmp/cal
+//   pio run -e pipeline_bench
+//   .pio/build/pipeline_bench/program /tmp/cal/calendar.png [kB/s]
+//
+// First the SPSC ring is hammered with randomly sized reads and writes and
+// the stream checked byte for byte, then the PNG is decoded through the
+// pipeline with jittery reads and checked against a plain decode. Last, the
+// image arrives at a simulated link rate (default 500kB/s, about what the
+// ESP32 gets over WiFi) and the pipeline is timed against receiving and
+// decoding on one thread.
+#include <Inkplate.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "pipeline.h"
+#include "png.h"
+
+#define BENCH_RING_BYTES (64UL << 20)
+#define BENCH_DECODES 100
+#define BENCH_RUNS 5
+
+// The firmware's Arduino clock comes from the simulator; here it is the
+// process's.
+static const auto benchStart = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - benchStart)
+        .count();
+}
+
+unsigned long millis() { return micros() / 1000; }
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static void sleepUs(unsigned long us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+struct MemSource {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+    std::mt19937* jitter;  // random read sizes and stalls, or NULL
+    uint32_t rate;         // simulated link rate in kB/s, or 0
+};
+
+// Reads as from WiFiClient: at most a TCP segment, whatever has arrived.
+static int readMem(void* ctx, uint8_t* buf, size_t len) {
+    MemSource* src = (MemSource*)ctx;
+    size_t n = min(len, src->data->size() - src->pos);
+    n = min(n, (size_t)PIPELINE_READ_CHUNK);
+    if (src->jitter) {
+        n = min(n, (size_t)((*src->jitter)() % PIPELINE_READ_CHUNK + 1));
+        if ((*src->jitter)() % 8 == 0) sleepUs((*src->jitter)() % 200);
+    }
+    // kB/s is bytes per millisecond.
+    if (src->rate) sleepUs(n * 1000 / src->rate);
+    memcpy(buf, src->data->data() + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+static uint8_t framebuffer[FRAMEBUFFER_SIZE];
+static uint8_t reference[FRAMEBUFFER_SIZE];
+
+// Same as drawRow() and framebufferWriteRow() in rotation 1.
+static void drawRow(void* ctx, int y, const uint8_t* gray, int width) {
+    if (width > E_INK_HEIGHT) width = E_INK_HEIGHT;
+    int px = E_INK_WIDTH - 1 - y;
+    if (px < 0) return;
+    for (int x = 0; x < width; x++) {
+        uint8_t* b = framebuffer + (x * E_INK_WIDTH + px) / 2;
+        uint8_t level = gray[x] >> 5;
+        *b = (px & 1) ? (*b & 0xf0) | level : (*b & 0x0f) | (level << 4);
+    }
+}
+
+static esp_err_t decode(PngReadFn read, void* readCtx, void* ctx) {
+    memset(framebuffer, 0, sizeof(framebuffer));
+    return pngDecode(read, readCtx, drawRow, NULL, NULL);
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+/**
+  Stream a counting sequence through a ring of the given size between two
+  threads, in random sized pieces.
+*/
+static bool stressRing(uint32_t size) {
+    std::vector<uint8_t> storage(size);
+    SpscRing ring;
+    spscInit(&ring, storage.data(), size);
+
+    std::thread producer([&ring] {
+        std::mt19937 rng(1);
+        uint8_t buf[4096];
+        uint64_t sent = 0;
+        while (sent < BENCH_RING_BYTES) {
+            size_t n = min((size_t)(rng() % sizeof(buf) + 1),
+                           (size_t)(BENCH_RING_BYTES - sent));
+            for (size_t i = 0; i < n; i++) buf[i] = (sent + i) * 131 >> 3;
+            size_t done = 0;
+            while (done < n) {
+                size_t w = spscWrite(&ring, buf + done, n - done);
+                if (w == 0) std::this_thread::yield();
+                done += w;
+            }
+            sent += n;
+        }
+    });
+
+    std::mt19937 rng(2);
+    uint8_t buf[4096];
+    uint64_t received = 0;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    while (received < BENCH_RING_BYTES) {
+        size_t n = spscRead(&ring, buf, rng() % sizeof(buf) + 1);
+        if (n == 0) std::this_thread::yield();
+        for (size_t i = 0; i < n && ok; i++) {
+            ok = buf[i] == (uint8_t)((received + i) * 131 >> 3);
+        }
+        received += n;
+    }
+    producer.join();
+    double s = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+
+    printf("ring %6u bytes: %s, %7.1f MB/s\n", size,
+           ok ? "in order" : "CORRUPTED", BENCH_RING_BYTES / s / 1e6);
+    return ok;
+}
+
+/**
+  Decode the image through the pipeline with jittery reads, checking every
+  decode against the reference.
+*/
+static bool stressPipeline(const std::vector<uint8_t>& png) {
+    std::mt19937 jitter(3);
+    for (int i = 0; i < BENCH_DECODES; i++) {
+        MemSource src = {&png, 0, &jitter, 0};
+        esp_err_t err = pipelineRun(readMem, &src, decode, NULL, NULL);
+        if (err != ESP_OK ||
+            memcmp(framebuffer, reference, FRAMEBUFFER_SIZE) != 0) {
+            printf("pipeline: decode %d %s\n", i,
+                   err != ESP_OK ? "failed" : "differs from the reference");
+            return false;
+        }
+    }
+    printf("pipeline: %d jittery decodes match the reference\n",
+           BENCH_DECODES);
+    return true;
+}
+
+/**
+  Time receiving and decoding at a link rate, on one thread and pipelined.
+*/
+static void bench(const std::vector<uint8_t>& png, uint32_t rate) {
+    double serialMs = 1e18, pipelineMs = 1e18;
+    PipelineStats best = {};
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        MemSource src = {&png, 0, NULL, rate};
+        unsigned long start = micros();
+        decode(readMem, &src, NULL);
+        serialMs = min(serialMs, (micros() - start) / 1000.0);
+
+        src.pos = 0;
+        PipelineStats stats;
+        pipelineRun(readMem, &src, decode, NULL, &stats);
+        if (stats.totalUs / 1000.0 < pipelineMs) {
+            pipelineMs = stats.totalUs / 1000.0;
+            best = stats;
+        }
+    }
+
+    printf("%u bytes at %ukB/s, best of %d runs:\n", (unsigned)png.size(),
+           rate, BENCH_RUNS);
+    printf("  one thread %9.2fms\n", serialMs);
+    printf("  pipelined  %9.2fms\n", pipelineMs);
+    printf("  receive    %9.2fms %8.0fkB/s, %7.2fms waiting for the decoder\n",
+           best.receiveUs / 1000.0,
+           best.receiveUs ? best.bytes * 1000.0 / best.receiveUs : 0.0,
+           best.receiveWaitUs / 1000.0);
+    printf("  decode     %9.2fms %8.0fkB/s, %7.2fms waiting for data\n",
+           best.decodeUs / 1000.0,
+           best.decodeUs ? best.bytes * 1000.0 / best.decodeUs : 0.0,
+           best.decodeWaitUs / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s calendar.png [kB/s]\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint8_t> png;
+    if (!readFile(argv[1], &png)) {
+        perror("read");
+        return 1;
+    }
+    uint32_t rate = argc == 3 ? atoi(argv[2]) : 500;
+
+    MemSource src = {&png, 0, NULL, 0};
+    if (decode(readMem, &src, NULL) != ESP_OK) {
+        fprintf(stderr, "cannot decode %s\n", argv[1]);
+        return 1;
+    }
+    memcpy(reference, framebuffer, FRAMEBUFFER_SIZE);
+
+    bool ok = stressRing(64) && stressRing(PIPELINE_RING_SIZE) &&
+              stressPipeline(png);
+    if (!ok) return 1;
+    bench(png, rate);
+    return 0;
+}
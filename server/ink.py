@@ -0,0 +1,245 @@
+"""
+The .ink image format and tile deltas served to the client. See
+src/framebuffer.h and src/tiles.h in the client.
+
+An .ink image is a 16 byte header followed by the Inkplate10's 3-bit
+framebuffer: PANEL_HEIGHT rows of PANEL_WIDTH pixels, two pixels per byte with
+the even pixel in the high nibble, each a gray level from 0 (black) to
+7 (white). The framebuffer is either stored as is (ENCODING_RAW) or
+run-length coded (ENCODING_RLE, see encode() and src/inkrle.h).
+
+The framebuffer is split into TILE_WIDTH x TILE_HEIGHT tiles. The client
+reports the hash of each tile it has and gets back only the tiles that
+differ.
+"""
+
+import struct
+
+MAGIC = b"INK3"
+VERSION = 1
+# board rotation the portrait calendar is laid out for
+ROTATION = 1
+PANEL_WIDTH = 1200
+PANEL_HEIGHT = 825
+HEADER = struct.Struct("<4sBBBxHHI")
+PAYLOAD_SIZE = PANEL_WIDTH * PANEL_HEIGHT // 2
+ENCODING_RAW = 0
+ENCODING_RLE = 1
+
+RLE_RUN = 0x80
+RLE_COPY = 0x40
+RLE_LITERAL = 0x00
+RLE_RUN_MAX = 16
+RLE_SPAN_MAX = 64
+# shortest run or copy worth a token of its own rather than literals
+RLE_MIN_MATCH = 3
+
+TILE_WIDTH = 80
+TILE_HEIGHT = 75
+TILES_X = PANEL_WIDTH // TILE_WIDTH
+TILES_Y = PANEL_HEIGHT // TILE_HEIGHT
+TILE_COUNT = TILES_X * TILES_Y
+TILE_ROW_BYTES = TILE_WIDTH // 2
+
+DELTA_MAGIC = b"INKD"
+DELTA_VERSION = 1
+DELTA_HEADER = struct.Struct("<4sBBHHH4x")
+
+
+def header(payload_size=PAYLOAD_SIZE, encoding=ENCODING_RAW):
+    return HEADER.pack(
+        MAGIC, VERSION, ROTATION, encoding, PANEL_WIDTH, PANEL_HEIGHT, payload_size
+    )
+
+
+def payload(ink):
+    """
+    Returns the framebuffer of an .ink image, or raises ValueError.
+    """
+    magic, version, _, encoding, _, _, size = HEADER.unpack_from(ink)
+    data = ink[HEADER.size : HEADER.size + size]
+    if magic != MAGIC or version != VERSION or len(data) != size:
+        raise ValueError("not a version %d .ink image" % VERSION)
+    if encoding == ENCODING_RLE:
+        return decode(data)
+    if encoding != ENCODING_RAW or size != PAYLOAD_SIZE:
+        raise ValueError("unsupported .ink encoding %d" % encoding)
+    return data
+
+
+HIGH_NIBBLE = bytes(b >> 4 for b in range(256))
+LOW_NIBBLE = bytes(b & 0x0F for b in range(256))
+
+
+def unpack(framebuffer):
+    """
+    One gray level per byte from a packed framebuffer.
+    """
+    levels = bytearray(len(framebuffer) * 2)
+    levels[0::2] = framebuffer.translate(HIGH_NIBBLE)
+    levels[1::2] = framebuffer.translate(LOW_NIBBLE)
+    return levels
+
+
+def pack(levels):
+    if len(levels) % 2:
+        levels = levels + b"\0"
+    return bytes(hi << 4 | lo for hi, lo in zip(levels[0::2], levels[1::2]))
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def encode(framebuffer, width=PANEL_WIDTH):
+    """
+    Run-length code a packed framebuffer for the client's inkRleDecode().
+
+    Greedy: at each pixel take the longer of a run of one level or a copy of
+    the row above if it covers at least RLE_MIN_MATCH pixels, otherwise
+    collect the pixel into a literal span.
+    """
+    levels = unpack(framebuffer)
+    n = len(levels)
+    out = bytearray()
+    literal_start = 0
+
+    def flush_literals(end):
+        start = literal_start
+        while start < end:
+            count = min(end - start, RLE_SPAN_MAX)
+            out.append(RLE_LITERAL | (count - 1))
+            out.extend(pack(levels[start : start + count]))
+            start += count
+
+    p = 0
+    while p < n:
+        level = levels[p]
+        run = 1
+        while p + run < n and levels[p + run] == level:
+            run += 1
+        copy = 0
+        if p >= width:
+            while p + copy < n and levels[p + copy] == levels[p + copy - width]:
+                copy += 1
+
+        if max(run, copy) < RLE_MIN_MATCH:
+            p += 1
+            continue
+
+        flush_literals(p)
+        if copy >= run:
+            length, token, limit = copy, RLE_COPY, RLE_SPAN_MAX
+        else:
+            length, token, limit = run, RLE_RUN | level << 4, RLE_RUN_MAX
+        if length < limit:
+            out.append(token | (length - 1))
+        else:
+            out.append(token | (limit - 1))
+            out.extend(varint(length - limit))
+        p += length
+        literal_start = p
+
+    flush_literals(n)
+    return bytes(out)
+
+
+def decode(data, width=PANEL_WIDTH, height=PANEL_HEIGHT):
+    """
+    Inverse of encode(), returns the packed framebuffer or raises ValueError.
+    """
+    n = width * height
+    levels = bytearray(n)
+    p = i = 0
+
+    def extend(length, limit):
+        nonlocal i
+        if length < limit:
+            return length
+        shift = 0
+        while True:
+            b = data[i]
+            i += 1
+            length += (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return length
+
+    try:
+        while p < n:
+            token = data[i]
+            i += 1
+            if token & RLE_RUN:
+                length = extend((token & 0x0F) + 1, RLE_RUN_MAX)
+                levels[p : p + length] = bytes([token >> 4 & 7]) * length
+            elif token & RLE_COPY:
+                length = extend((token & 0x3F) + 1, RLE_SPAN_MAX)
+                if p < width:
+                    raise ValueError("copy from above the first row")
+                for q in range(p, p + length):
+                    levels[q] = levels[q - width]
+            else:
+                length = (token & 0x3F) + 1
+                span = unpack(data[i : i + (length + 1) // 2])
+                levels[p : p + length] = span[:length]
+                i += (length + 1) // 2
+            p += length
+    except IndexError:
+        raise ValueError("truncated run-length coded image")
+    if len(levels) != n or i != len(data):
+        raise ValueError("malformed run-length coded image")
+    return pack(levels)
+
+
+def tile(framebuffer, index):
+    tx, ty = index % TILES_X, index // TILES_X
+    row_bytes = PANEL_WIDTH // 2
+    start = ty * TILE_HEIGHT * row_bytes + tx * TILE_ROW_BYTES
+    return b"".join(
+        framebuffer[start + row * row_bytes : start + row * row_bytes + TILE_ROW_BYTES]
+        for row in range(TILE_HEIGHT)
+    )
+
+
+def tile_hash(data):
+    """
+    32-bit FNV-1a, never 0 as the client uses 0 for a missing tile.
+    """
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h or 1
+
+
+def delta(ink, manifest):
+    """
+    Returns the tiles of an .ink image that differ from a client's manifest,
+    a packed array of little-endian uint32 tile hashes. Tiles missing from a
+    short or empty manifest are always sent.
+    """
+    framebuffer = payload(ink)
+    count = min(len(manifest) // 4, TILE_COUNT)
+    known = struct.unpack("<%dI" % count, manifest[: count * 4])
+
+    changed = []
+    for i in range(TILE_COUNT):
+        data = tile(framebuffer, i)
+        if i >= count or tile_hash(data) != known[i]:
+            changed.append(struct.pack("<H", i) + data)
+
+    return (
+        DELTA_HEADER.pack(
+            DELTA_MAGIC,
+            DELTA_VERSION,
+            ROTATION,
+            len(changed),
+            TILE_WIDTH,
+            TILE_HEIGHT,
+        )
+        + b"".join(changed)
+    )
@@ -4,17 +4,20 @@
 import os
 import io
 import sys
+import hashlib
 import yaml
 import time
 import threading
 import datetime as dt
 import logging.config
 import paho.mqtt.client as mqtt
+import ink
+import telemetry
 from utils import get_prop, get_prop_by_keys
 from views.calendar import CalendarPage
 from google.api import GoogleAPIService
 from werkzeug.serving import make_server
-from flask import Flask, send_file, abort
+from flask import Flask, Response, request, send_file, abort
 
 cwd = os.path.dirname(os.path.realpath(__file__))
 log = None
@@ -182,7 +185,16 @@ def get_client_mqtt_logging(host, port, topic):
             # ignore stale messages
             return
 
-        client_log.info(message.payload.decode())
+        if telemetry.is_packet(message.payload):
+            try:
+                telemetry.log_packet(telemetry.decode(message.payload), client_log)
+            except (ValueError, KeyError) as e:
+                log.error(f"Bad telemetry packet from client: {e}")
+            return
+
+        # Lines held by the client while offline arrive newline-separated.
+        for line in message.payload.decode().splitlines():
+            client_log.info(line)
 
     mqtt_client.on_connect = on_connect
     mqtt_client.on_disconnect = on_disconnect
@@ -217,21 +229,103 @@ class ServerThread(threading.Thread):
         self.server.shutdown()
 
 
-@app.route("/calendar.png")
+@app.route("/calendar.png", methods=["GET", "POST"])
 def serve_cal_png():
-    global server_num_serves, server_max_serves
     """
     Returns the calendar image directly through send_file
     """
+    if request.method == "POST":
+        return serve_delta()
+    return serve_image("calendar.png", "image/png")
+
+
+@app.route("/calendar.ink", methods=["GET", "POST"])
+def serve_cal_ink():
+    """
+    Returns the calendar pre-packed in the Inkplate's native framebuffer
+    layout, which the client copies to display memory without decoding.
+    """
+    if request.method == "POST":
+        return serve_delta()
+    return serve_image("calendar.ink", "application/octet-stream")
+
+
+def calendar_etag():
+    """
+    Returns the ETag shared by every representation of the calendar: the
+    PNG, the .ink and tile deltas. It is a hash of the .ink, which holds
+    exactly what the panel shows, so a client that drew the calendar from
+    any of them gets a 304 from the others. None if there is no .ink.
+    """
+    path = os.path.join(cwd, "views", "calendar.ink")
+    if not os.path.exists(path):
+        return None
+    with open(path, "rb") as f:
+        return hashlib.sha1(f.read()).hexdigest()
+
+
+def serve_delta():
+    """
+    Returns the tiles of the calendar that differ from the tile-hash manifest
+    posted by the client, see ink.py. The client patches them into the
+    calendar it kept from last time.
+    """
+    global server_num_serves, server_max_serves
 
-    path = os.path.join(cwd, "views/calendar.png")
+    path = os.path.join(cwd, "views", "calendar.ink")
 
     if not os.path.exists(path):
         log.error(f"{path}: no such file exists")
         abort(404)
 
-    f = open(path, "rb")
-    stream = io.BytesIO(f.read())
+    with open(path, "rb") as f:
+        data = f.read()
+    # The same ETag as calendar_etag().
+    etag = hashlib.sha1(data).hexdigest()
+
+    # incr number of times served
+    server_num_serves += 1
+    if server_max_serves > 0:
+        log.info(f"Served {server_num_serves}/{server_max_serves} times")
+
+    if request.if_none_match.contains(etag):
+        return Response(status=304, headers={"ETag": f'"{etag}"'})
+
+    body = ink.delta(data, request.get_data())
+    tiles = int.from_bytes(body[6:8], "little")
+    log.info(f"Serving {tiles}/{ink.TILE_COUNT} changed tiles, {len(body)} bytes")
+
+    return Response(
+        body,
+        mimetype="application/octet-stream",
+        headers={"ETag": f'"{etag}"'},
+    )
+
+
+def serve_image(name, mimetype):
+    """
+    Returns an image rendered by the calendar page through send_file.
+
+    The image is re-rendered on every run, so its ETag is a hash of the
+    content rather than the file's mtime, see calendar_etag(). Clients that
+    already have the same image get a 304 and can skip the download and the
+    display refresh.
+    """
+    global server_num_serves, server_max_serves
+
+    path = os.path.join(cwd, "views", name)
+
+    if not os.path.exists(path):
+        log.error(f"{path}: no such file exists")
+        abort(404)
+
+    with open(path, "rb") as f:
+        data = f.read()
+    stream = io.BytesIO(data)
+    etag = calendar_etag() or hashlib.sha1(data).hexdigest()
+    last_modified = dt.datetime.fromtimestamp(
+        os.path.getmtime(path), tz=dt.timezone.utc
+    )
 
     # incr number of times served
     server_num_serves += 1
@@ -240,9 +334,12 @@ def serve_cal_png():
 
     return send_file(
         stream,
-        mimetype="image/png",
+        mimetype=mimetype,
         as_attachment=True,
         download_name=os.path.basename(path),
+        conditional=True,
+        etag=etag,
+        last_modified=last_modified,
     )
 
 
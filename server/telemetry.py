@@ -0,0 +1,117 @@
+"""
+Decoding of the client's telemetry packets. See src/telemetry.h in the
+client.
+
+In telemetry mode the client publishes one CBOR (RFC 8949) packet per wake
+with its metrics and the log messages of the wake, instead of a MQTT message
+per log line.
+"""
+
+import struct
+import logging
+import datetime as dt
+
+VERSION = 2
+
+# client log levels, see LOG_LEVEL in src/logger.h
+LEVELS = [
+    logging.CRITICAL,
+    logging.ERROR,
+    logging.WARNING,
+    logging.INFO,  # notice
+    logging.INFO,
+    logging.DEBUG,
+]
+
+
+def is_packet(payload):
+    """
+    Text log lines start with a timestamp digit, profile records with "{";
+    a telemetry packet is a CBOR map.
+    """
+    return len(payload) > 0 and payload[0] >> 5 == 5
+
+
+def decode(payload):
+    """
+    Decode a CBOR data item, or raise ValueError. Only the types the client
+    sends are supported: integers, text, arrays and maps.
+    """
+    value, end = _item(payload, 0)
+    if end != len(payload):
+        raise ValueError("trailing bytes after telemetry packet")
+    return value
+
+
+def _argument(data, pos, info):
+    if info < 24:
+        return info, pos
+    if info == 31:
+        return None, pos
+    sizes = {24: ">B", 25: ">H", 26: ">I", 27: ">Q"}
+    if info not in sizes:
+        raise ValueError("bad CBOR argument %d" % info)
+    fmt = sizes[info]
+    return struct.unpack_from(fmt, data, pos)[0], pos + struct.calcsize(fmt)
+
+
+def _item(data, pos):
+    try:
+        initial = data[pos]
+        major, info = initial >> 5, initial & 0x1F
+        value, pos = _argument(data, pos + 1, info)
+    except (IndexError, struct.error):
+        raise ValueError("truncated telemetry packet")
+
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 3:
+        if value is None or pos + value > len(data):
+            raise ValueError("bad CBOR text")
+        return data[pos : pos + value].decode("utf-8", "replace"), pos + value
+    if major == 4:
+        items = []
+        while value is None or len(items) < value:
+            if value is None and data[pos : pos + 1] == b"\xff":
+                return items, pos + 1
+            item, pos = _item(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5 and value is not None:
+        items = {}
+        for _ in range(value):
+            key, pos = _item(data, pos)
+            items[key], pos = _item(data, pos)
+        return items, pos
+    raise ValueError("unsupported CBOR major type %d" % major)
+
+
+def log_packet(packet, client_log):
+    """
+    Log the metrics of a decoded packet, then replay the client's log
+    messages at their original levels.
+    """
+    if packet.get("v") != VERSION:
+        client_log.warning(f"unsupported telemetry version {packet.get('v')}")
+        return
+
+    spans = " ".join(f"{name}={dur / 1000:.0f}ms" for name, _, dur in packet["spans"])
+    retries = " ".join(f"{k}={v}" for k, v in packet["retries"].items() if v)
+    lines, truncated, dropped = packet["log_stats"]
+    client_log.info(
+        f"wake #{packet['boot']}: awake {packet['awake_us'] / 1e6:.2f}s, "
+        f"battery {packet['battery_mv'] / 1000:.2f}v, {spans}"
+    )
+    if retries or packet["errors"]:
+        client_log.warning(f"retries: {retries or 'none'}, errors: {packet['errors']}")
+    if truncated or dropped:
+        client_log.warning(f"{lines} log lines, {truncated} truncated, {dropped} dropped")
+
+    # Messages held from earlier wakes that never got online come first.
+    for boot, seq, level, epoch, msg in packet["logs"]:
+        ts = dt.datetime.fromtimestamp(epoch, dt.timezone.utc).isoformat()
+        client_log.log(
+            LEVELS[min(level, len(LEVELS) - 1)], f"{ts} - #{boot}.{seq} - {msg}"
+        )
@@ -1,5 +1,7 @@
 import os
+import ink
 import logging
+import numpy as np
 from time import sleep
 from PIL import Image
 from airium import Airium
@@ -34,6 +36,7 @@ class Page:
         cwd = os.path.dirname(os.path.realpath(__file__))
         html_fp = os.path.join(cwd, "html", self.name + ".html")
         png_fp = os.path.join(cwd, self.name + ".png")
+        ink_fp = os.path.join(cwd, self.name + ".ink")
 
         with open(html_fp, "wb") as f:
             f.write(bytes(self.airium))
@@ -48,9 +51,40 @@ class Page:
         img = Image.open(png_fp)
         img = img.convert("P", palette=Image.ADAPTIVE, colors=256)
         img.save(png_fp, format="png", optimize=True, quality=25)
+        self.save_ink(img, ink_fp)
 
         self.log.info("Screenshot captured and saved to file.")
 
+    def save_ink(self, img, ink_fp):
+        """
+        Write the image in the Inkplate10's native 3-bit framebuffer layout,
+        run-length coded so the client can decode it straight into display
+        memory, see ink.py.
+
+        The client shows the calendar in portrait (rotation 1) on a landscape
+        panel, so the image is rotated clockwise into panel rows.
+        """
+        gray = np.asarray(img.convert("L").transpose(Image.ROTATE_270))
+        if gray.shape != (ink.PANEL_HEIGHT, ink.PANEL_WIDTH):
+            self.log.warning(
+                f"not writing {ink_fp}: image is {img.width}x{img.height}, "
+                f"panel needs {ink.PANEL_HEIGHT}x{ink.PANEL_WIDTH}"
+            )
+            # A stale .ink would keep its ETag and tiles for the new PNG.
+            if os.path.exists(ink_fp):
+                os.remove(ink_fp)
+            return
+
+        levels = gray >> 5
+        packed = (levels[:, 0::2] << 4) | levels[:, 1::2]
+        payload = ink.encode(packed.astype(np.uint8).tobytes())
+
+        # Replace the old .ink in one step so it is never served half written.
+        tmp_fp = ink_fp + ".tmp"
+        with open(tmp_fp, "wb") as f:
+            f.write(ink.header(len(payload), ink.ENCODING_RLE) + payload)
+        os.replace(tmp_fp, ink_fp)
+
     def _get_chromedriver(self):
         opts = Options()
         opts.add_argument("--headless")
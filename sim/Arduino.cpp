@@ -0,0 +1,136 @@
+#include "Arduino.h"
+
+#include <time.h>
+
+#include <random>
+#include <thread>
+
+#include "sim.h"
+
+HardwareSerial Serial;
+
+static std::mt19937 rng(1);
+
+unsigned long millis() { return sim::wakeMicros() / 1000; }
+
+unsigned long micros() { return sim::wakeMicros(); }
+
+int64_t esp_timer_get_time() { return sim::wakeMicros(); }
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() { std::this_thread::yield(); }
+
+void randomSeed(unsigned long seed) { rng.seed(seed); }
+
+long random(long max) { return max > 0 ? rng() % max : 0; }
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+uint32_t esp_random() {
+    static std::random_device rd;
+    return rd();
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return (esp_sleep_wakeup_cause_t)sim::wakeupCause();
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio, int level) {
+    sim::enableExt0Wakeup();
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+    sim::enableTimerWakeup(timeUs);
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start() { sim::deepSleep(); }
+
+void HardwareSerial::begin(unsigned long baud) {}
+
+size_t HardwareSerial::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+    return fwrite(buf, 1, size, stdout);
+}
+
+void HardwareSerial::flush() { fflush(stdout); }
+
+size_t Print::write(const uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buf++);
+    return n;
+}
+
+size_t Print::write(const char* s) {
+    return s ? write((const uint8_t*)s, strlen(s)) : 0;
+}
+
+size_t Print::print(int v) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%d", v);
+    return write(buf);
+}
+
+size_t Print::print(double v, int decimals) {
+    return write(String(v, decimals).c_str());
+}
+
+size_t Print::printf(const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t*)buf, std::min((size_t)len, sizeof(buf) - 1));
+}
+
+String::String(double v, unsigned int decimals) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+}
+
+int String::indexOf(char c) const {
+    size_t i = s_.find(c);
+    return i == std::string::npos ? -1 : (int)i;
+}
+
+String IPAddress::toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1],
+             (*this)[2], (*this)[3]);
+    return String(buf);
+}
@@ -0,0 +1,61 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+// Host stand-in for the subset of the ESP32 Arduino core used by the
+// firmware. Only what src/ touches is provided.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "IPAddress.h"
+#include "Print.h"
+#include "WString.h"
+#include "esp_err.h"
+#include "esp_sleep.h"
+
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_pointer(addr) ((void*)*(addr))
+
+// Variables placed in RTC slow memory survive deep sleep. The simulator
+// collects them in a dedicated section and persists it between wakes.
+#define RTC_DATA_ATTR __attribute__((section("rtc_sim_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::max;
+using std::min;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+int64_t esp_timer_get_time();
+
+class HardwareSerial : public Print {
+   public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    void flush();
+};
+
+extern HardwareSerial Serial;
+
+#endif
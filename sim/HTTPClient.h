@@ -0,0 +1,53 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+#include <string>
+#include <vector>
+
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_NOT_FOUND 404
+
+// Minimal HTTP/1.0 client with the same surface as the ESP32 core's
+// HTTPClient. The body is left unread on the connection for getStreamPtr().
+class HTTPClient {
+   public:
+    bool begin(const char* url);
+    bool begin(const String& url) { return begin(url.c_str()); }
+    void end();
+    void setTimeout(uint16_t ms) { timeoutMs_ = ms; }
+    void setReuse(bool) {}
+    void addHeader(const String& name, const String& value);
+    void collectHeaders(const char* keys[], size_t count);
+    String header(const char* name);
+    bool hasHeader(const char* name);
+    int GET();
+    int POST(uint8_t* payload, size_t size);
+    int getSize() { return size_; }
+    WiFiClient* getStreamPtr() { return &client_; }
+    WiFiClient& getStream() { return client_; }
+    bool connected() { return client_.connected(); }
+    static String errorToString(int error);
+
+   private:
+    int sendRequest(const char* method, const uint8_t* payload, size_t size);
+    bool readLine(std::string& line);
+
+    std::string host_;
+    uint16_t port_ = 80;
+    std::string path_;
+    uint16_t timeoutMs_ = 5000;
+    WiFiClient client_;
+    int size_ = -1;
+    std::vector<std::pair<std::string, std::string>> reqHeaders_;
+    std::vector<std::pair<std::string, std::string>> respHeaders_;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+#include <stdint.h>
+
+#include "WString.h"
+
+class IPAddress {
+   public:
+    IPAddress() : addr_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : addr_((uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 |
+                (uint32_t)d << 24) {}
+    IPAddress(uint32_t addr) : addr_(addr) {}
+
+    operator uint32_t() const { return addr_; }
+    uint8_t operator[](int i) const { return (addr_ >> (8 * i)) & 0xff; }
+    bool operator==(const IPAddress& o) const { return addr_ == o.addr_; }
+    bool operator!=(const IPAddress& o) const { return addr_ != o.addr_; }
+    String toString() const;
+
+   private:
+    uint32_t addr_;  // network byte order, as on the ESP32
+};
+
+#endif
@@ -0,0 +1,354 @@
+#include "Inkplate.h"
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "sim.h"
+
+static const uint8_t pngSignature[8] = {0x89, 'P',  'N',  'G',
+                                        '\r', '\n', 0x1a, '\n'};
+
+#define PANEL_PIXELS (E_INK_WIDTH * E_INK_HEIGHT)
+
+Inkplate::Inkplate(uint8_t mode) : mode_(mode) {
+    DMemory4Bit = (uint8_t*)malloc(PANEL_PIXELS / 2);
+    memset(DMemory4Bit, 0xff, PANEL_PIXELS / 2);
+    mono_ = (uint8_t*)calloc(PANEL_PIXELS, 1);
+    monoShown_ = (uint8_t*)calloc(PANEL_PIXELS, 1);
+    panel_ = (uint8_t*)malloc(PANEL_PIXELS);
+    memset(panel_, 7, PANEL_PIXELS);
+}
+
+Inkplate::~Inkplate() {
+    free(DMemory4Bit);
+    free(mono_);
+    free(monoShown_);
+    free(panel_);
+}
+
+bool Inkplate::begin() { return true; }
+
+void Inkplate::clearDisplay() {
+    if (mode_ == INKPLATE_1BIT) {
+        memset(mono_, WHITE, PANEL_PIXELS);
+    } else {
+        memset(DMemory4Bit, 0xff, PANEL_PIXELS / 2);
+    }
+}
+
+void Inkplate::selectDisplayMode(uint8_t mode) {
+    if (mode == mode_) return;
+    mode_ = mode;
+    memset(mono_, WHITE, PANEL_PIXELS);
+    memset(DMemory4Bit, 0xff, PANEL_PIXELS / 2);
+    blockPartial_ = true;
+}
+
+void Inkplate::display() {
+    if (mode_ == INKPLATE_1BIT) {
+        delay(sim::envLong("SIM_DISPLAY_1BIT_MS", 0));
+        for (int i = 0; i < PANEL_PIXELS; i++) {
+            panel_[i] = mono_[i] == BLACK ? 0 : 7;
+        }
+        memcpy(monoShown_, mono_, PANEL_PIXELS);
+        blockPartial_ = false;
+        showPanel("1-bit full");
+        return;
+    }
+
+    delay(sim::envLong("SIM_DISPLAY_MS", 0));
+    for (int i = 0; i < PANEL_PIXELS; i++) {
+        uint8_t b = DMemory4Bit[i / 2];
+        panel_[i] = ((i & 1) ? b : b >> 4) & 7;
+    }
+    showPanel("3-bit full");
+}
+
+void Inkplate::partialUpdate(bool forced, bool leaveOn) {
+    if (mode_ != INKPLATE_1BIT) return;
+    if (blockPartial_ && !forced) {
+        display();
+        return;
+    }
+
+    delay(sim::envLong("SIM_PARTIAL_MS", 0));
+    int changed = 0;
+    for (int i = 0; i < PANEL_PIXELS; i++) {
+        if (mono_[i] == monoShown_[i]) continue;
+        panel_[i] = mono_[i] == BLACK ? 0 : 7;
+        changed++;
+    }
+    memcpy(monoShown_, mono_, PANEL_PIXELS);
+    char refresh[48];
+    snprintf(refresh, sizeof(refresh), "1-bit partial, %d pixels changed",
+             changed);
+    showPanel(refresh);
+}
+
+void Inkplate::preloadScreen() {
+    memcpy(monoShown_, mono_, PANEL_PIXELS);
+    blockPartial_ = false;
+}
+
+void Inkplate::showPanel(const char* refresh) {
+    // Dump the panel as the user sees it, i.e. in the current rotation.
+    int16_t w = width(), h = height();
+    std::string path = sim::statePath("display.pgm");
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return;
+    fprintf(fp, "P5\n%d %d\n255\n", w, h);
+    uint8_t* row = (uint8_t*)malloc(w);
+    for (int16_t y = 0; y < h; y++) {
+        for (int16_t x = 0; x < w; x++) {
+            int16_t px = x, py = y;
+            switch (rotation_) {
+                case 1:
+                    std::swap(px, py);
+                    px = E_INK_WIDTH - px - 1;
+                    break;
+                case 2:
+                    px = E_INK_WIDTH - px - 1;
+                    py = E_INK_HEIGHT - py - 1;
+                    break;
+                case 3:
+                    std::swap(px, py);
+                    py = E_INK_HEIGHT - py - 1;
+                    break;
+            }
+            row[x] = panel_[E_INK_WIDTH * py + px] * 255 / 7;
+        }
+        fwrite(row, 1, w, fp);
+    }
+    free(row);
+    fclose(fp);
+    sim::note("display refreshed (%s), saved %s", refresh, path.c_str());
+}
+
+void Inkplate::setRotation(uint8_t r) { rotation_ = r & 3; }
+
+int16_t Inkplate::width() {
+    return (rotation_ & 1) ? E_INK_HEIGHT : E_INK_WIDTH;
+}
+
+int16_t Inkplate::height() {
+    return (rotation_ & 1) ? E_INK_WIDTH : E_INK_HEIGHT;
+}
+
+void Inkplate::drawPixel(int16_t x0, int16_t y0, uint16_t color) {
+    if (x0 < 0 || y0 < 0 || x0 >= width() || y0 >= height()) return;
+    switch (rotation_) {
+        case 1:
+            std::swap(x0, y0);
+            x0 = height() - x0 - 1;
+            break;
+        case 2:
+            x0 = width() - x0 - 1;
+            y0 = height() - y0 - 1;
+            break;
+        case 3:
+            std::swap(x0, y0);
+            y0 = width() - y0 - 1;
+            break;
+    }
+    if (mode_ == INKPLATE_1BIT) {
+        mono_[E_INK_WIDTH * y0 + x0] = color & 1;
+        return;
+    }
+    color &= 7;
+    uint8_t* p = DMemory4Bit + E_INK_WIDTH / 2 * y0 + x0 / 2;
+    *p = (x0 & 1) ? (*p & 0xf0) | color : (*p & 0x0f) | (color << 4);
+}
+
+void Inkplate::fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
+                        uint16_t color) {
+    for (int16_t j = y; j < y + h; j++) {
+        for (int16_t i = x; i < x + w; i++) drawPixel(i, j, color);
+    }
+}
+
+void Inkplate::drawChar(int16_t x, int16_t y, unsigned char c,
+                        uint16_t color) {
+    const GFXglyph* glyph = font_->glyph + (c - font_->first);
+    const uint8_t* bitmap = font_->bitmap;
+    uint16_t bo = glyph->bitmapOffset;
+    uint8_t bits = 0, bit = 0;
+    for (uint8_t yy = 0; yy < glyph->height; yy++) {
+        for (uint8_t xx = 0; xx < glyph->width; xx++) {
+            if (!(bit++ & 7)) bits = bitmap[bo++];
+            if (bits & 0x80) {
+                if (textSize_ == 1) {
+                    drawPixel(x + glyph->xOffset + xx, y + glyph->yOffset + yy,
+                              color);
+                } else {
+                    fillRect(x + (glyph->xOffset + xx) * textSize_,
+                             y + (glyph->yOffset + yy) * textSize_, textSize_,
+                             textSize_, color);
+                }
+            }
+            bits <<= 1;
+        }
+    }
+}
+
+size_t Inkplate::write(uint8_t c) {
+    // Only custom GFX fonts are used by the firmware.
+    if (!font_) return 1;
+    if (c == '\n') {
+        cursorX_ = 0;
+        cursorY_ += textSize_ * font_->yAdvance;
+    } else if (c != '\r' && c >= font_->first && c <= font_->last) {
+        const GFXglyph* glyph = font_->glyph + (c - font_->first);
+        if (glyph->width > 0 && glyph->height > 0) {
+            if (wrap_ && cursorX_ + textSize_ * (glyph->xOffset + glyph->width) >
+                             width()) {
+                cursorX_ = 0;
+                cursorY_ += textSize_ * font_->yAdvance;
+            }
+            drawChar(cursorX_, cursorY_, c, textColor_);
+        }
+        cursorX_ += glyph->xAdvance * textSize_;
+    }
+    return 1;
+}
+
+void Inkplate::charBounds(unsigned char c, int16_t* x, int16_t* y,
+                          int16_t* minx, int16_t* miny, int16_t* maxx,
+                          int16_t* maxy) {
+    if (c == '\n') {
+        *x = 0;
+        *y += textSize_ * font_->yAdvance;
+        return;
+    }
+    if (c == '\r' || c < font_->first || c > font_->last) return;
+    const GFXglyph* glyph = font_->glyph + (c - font_->first);
+    if (wrap_ && *x + (glyph->xOffset + glyph->width) * textSize_ > width()) {
+        *x = 0;
+        *y += textSize_ * font_->yAdvance;
+    }
+    int16_t x1 = *x + glyph->xOffset * textSize_;
+    int16_t y1 = *y + glyph->yOffset * textSize_;
+    int16_t x2 = x1 + glyph->width * textSize_ - 1;
+    int16_t y2 = y1 + glyph->height * textSize_ - 1;
+    if (x1 < *minx) *minx = x1;
+    if (y1 < *miny) *miny = y1;
+    if (x2 > *maxx) *maxx = x2;
+    if (y2 > *maxy) *maxy = y2;
+    *x += glyph->xAdvance * textSize_;
+}
+
+void Inkplate::getTextBounds(const char* str, int16_t x, int16_t y,
+                             int16_t* x1, int16_t* y1, uint16_t* w,
+                             uint16_t* h) {
+    *x1 = x;
+    *y1 = y;
+    *w = *h = 0;
+    if (!font_) return;
+    int16_t minx = width(), miny = height(), maxx = -1, maxy = -1;
+    for (const char* c = str; *c; c++) {
+        charBounds(*c, &x, &y, &minx, &miny, &maxx, &maxy);
+    }
+    if (maxx >= minx) {
+        *x1 = minx;
+        *w = maxx - minx + 1;
+    }
+    if (maxy >= miny) {
+        *y1 = miny;
+        *h = maxy - miny + 1;
+    }
+}
+
+bool Inkplate::drawImage(const char* path, int x, int y, bool dither,
+                         bool invert) {
+    uint8_t* buf = NULL;
+    int32_t len = 0;
+    if (!strncmp(path, "http://", 7)) {
+        len = E_INK_WIDTH * E_INK_HEIGHT * 4 + 100;
+        buf = downloadFile(path, &len);
+    } else {
+        File f = sd.open(path, FILE_READ);
+        if (f) {
+            len = f.size();
+            buf = (uint8_t*)malloc(len);
+            len = f.read(buf, len);
+        }
+    }
+    if (!buf) return false;
+
+    // Validate the container but leave rasterising to the firmware's own
+    // decoders; the stock driver's PNG decoder is not simulated.
+    bool ok = len >= 24 && !memcmp(buf, pngSignature, 8) &&
+              !memcmp(buf + 12, "IHDR", 4);
+    if (ok) {
+        uint32_t w = buf[16] << 24 | buf[17] << 16 | buf[18] << 8 | buf[19];
+        uint32_t h = buf[20] << 24 | buf[21] << 16 | buf[22] << 8 | buf[23];
+        sim::note("drawImage %s: %ux%u PNG (%d bytes), not rasterised", path,
+                  w, h, len);
+    }
+    free(buf);
+    return ok;
+}
+
+bool Inkplate::drawImage(const uint8_t* buf, int x, int y, int w, int h,
+                         uint8_t c, uint8_t bg) {
+    int xSize = (w + 1) / 2;
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < w; i++) {
+            uint8_t b = buf[xSize * j + i / 2];
+            uint8_t nibble = (i & 1) ? b & 0x0f : b >> 4;
+            drawPixel(x + i, y + j, nibble >> 1);
+        }
+    }
+    return true;
+}
+
+uint8_t* Inkplate::downloadFile(const char* url, int32_t* defaultLen) {
+    HTTPClient http;
+    if (!http.begin(url)) return NULL;
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        http.end();
+        return NULL;
+    }
+
+    int32_t size = http.getSize() > 0 ? http.getSize() : *defaultLen;
+    uint8_t* buf = (uint8_t*)malloc(size);
+    WiFiClient* stream = http.getStreamPtr();
+    int32_t n = 0;
+    while (n < size) {
+        int r = stream->read(buf + n, size - n);
+        if (r > 0) {
+            n += r;
+        } else if (r < 0) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    http.end();
+    *defaultLen = n;
+    return buf;
+}
+
+// The ADC reading, with SIM_BATTERY_NOISE_MV of uniform noise either way.
+double Inkplate::readBattery() {
+    // Each wake is a fresh process, so vary the noise between wakes.
+    static bool seeded = false;
+    if (!seeded) srand(sim::bootCount());
+    seeded = true;
+    double noise = sim::envDouble("SIM_BATTERY_NOISE_MV", 0) / 1000.0;
+    return sim::envDouble("SIM_BATTERY_V", 3.95) +
+           noise * (2.0 * rand() / RAND_MAX - 1);
+}
+
+uint32_t Inkplate::rtcGetEpoch() { return sim::rtcEpoch(); }
+
+void Inkplate::rtcSetEpoch(uint32_t epoch) { sim::rtcSetEpoch(epoch); }
+
+bool Inkplate::rtcIsSet() { return sim::rtcIsSet(); }
+
+void Inkplate::rtcSetAlarmEpoch(uint32_t epoch, uint8_t match) {
+    sim::rtcSetAlarm(epoch);
+}
+
+int16_t Inkplate::sdCardInit() { return 1; }
@@ -0,0 +1,133 @@
+#ifndef INKPLATE_H
+#define INKPLATE_H
+#include "Arduino.h"
+#include "HTTPClient.h"
+#include "SdFat.h"
+#include "WiFi.h"
+
+// Inkplate 10 panel geometry in its native (landscape) orientation.
+#define E_INK_WIDTH 1200
+#define E_INK_HEIGHT 825
+
+#define INKPLATE_1BIT 0
+#define INKPLATE_3BIT 1
+
+#define WHITE 0
+#define BLACK 1
+
+#define RTC_ALARM_MATCH_DHHMMSS 0
+
+typedef struct {
+    uint16_t bitmapOffset;
+    uint8_t width;
+    uint8_t height;
+    uint8_t xAdvance;
+    int8_t xOffset;
+    int8_t yOffset;
+} GFXglyph;
+
+typedef struct {
+    uint8_t* bitmap;
+    GFXglyph* glyph;
+    uint16_t first;
+    uint16_t last;
+    uint8_t yAdvance;
+} GFXfont;
+
+extern SdFat sd;
+
+// Simulated Inkplate 10. Drawing goes to a framebuffer with the same layout
+// as the real driver's DMemory4Bit, or in 1-bit mode to a black and white
+// one; display() and partialUpdate() dump what the panel then shows to
+// display.pgm in the simulator state directory.
+class Inkplate : public Print {
+   public:
+    Inkplate(uint8_t mode);
+    ~Inkplate();
+
+    bool begin();
+    void clearDisplay();
+    void display();
+    // 1-bit mode only: refresh the pixels that differ from the frame last
+    // shown, or all of them after a mode change, as the real driver does.
+    void partialUpdate(bool forced = false, bool leaveOn = false);
+    // 1-bit mode only: take the frame drawn so far as the one the panel
+    // shows, eg. after deep sleep, so partialUpdate() compares against it.
+    void preloadScreen();
+    void selectDisplayMode(uint8_t mode);
+    uint8_t getDisplayMode() { return mode_; }
+
+    void setRotation(uint8_t r);
+    uint8_t getRotation() { return rotation_; }
+    int16_t width();
+    int16_t height();
+    void drawPixel(int16_t x, int16_t y, uint16_t color);
+    void writePixel(int16_t x, int16_t y, uint16_t color) {
+        drawPixel(x, y, color);
+    }
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void fillScreen(uint16_t color) { fillRect(0, 0, width(), height(), color); }
+
+    void setFont(const GFXfont* f) { font_ = f; }
+    void setTextSize(uint8_t s) { textSize_ = s ? s : 1; }
+    void setTextColor(uint16_t c) { textColor_ = c; }
+    void setTextWrap(bool w) { wrap_ = w; }
+    void setCursor(int16_t x, int16_t y) {
+        cursorX_ = x;
+        cursorY_ = y;
+    }
+    void getTextBounds(const char* str, int16_t x, int16_t y, int16_t* x1,
+                       int16_t* y1, uint16_t* w, uint16_t* h);
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    bool drawImage(const char* path, int x, int y, bool dither = true,
+                   bool invert = false);
+    bool drawImage(const String& path, int x, int y, bool dither = true,
+                   bool invert = false) {
+        return drawImage(path.c_str(), x, y, dither, invert);
+    }
+    bool drawImage(const uint8_t* buf, int x, int y, int w, int h,
+                   uint8_t c = BLACK, uint8_t bg = 0xFF);
+    uint8_t* downloadFile(const char* url, int32_t* defaultLen);
+
+    double readBattery();
+
+    void rtcGetRtcData() {}
+    uint32_t rtcGetEpoch();
+    void rtcSetEpoch(uint32_t epoch);
+    bool rtcIsSet();
+    void rtcSetAlarmEpoch(uint32_t epoch, uint8_t match);
+    void rtcClearAlarmFlag() {}
+
+    int16_t sdCardInit();
+    void sdCardSleep() {}
+    SdFat& getSdFat() { return sd; }
+
+    // Same packing as the real driver: two pixels per byte, even x in the
+    // high nibble, each nibble holding a 3-bit gray level (0 black, 7 white).
+    uint8_t* DMemory4Bit;
+
+   private:
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color);
+    void charBounds(unsigned char c, int16_t* x, int16_t* y, int16_t* minx,
+                    int16_t* miny, int16_t* maxx, int16_t* maxy);
+    void showPanel(const char* refresh);
+
+    uint8_t mode_;
+    // Native pixels, a byte each: BLACK or WHITE as drawn in 1-bit mode and
+    // as last shown by a 1-bit refresh, and the gray level the panel shows.
+    uint8_t* mono_;
+    uint8_t* monoShown_;
+    uint8_t* panel_;
+    bool blockPartial_ = true;
+    uint8_t rotation_ = 0;
+    const GFXfont* font_ = nullptr;
+    uint8_t textSize_ = 1;
+    uint16_t textColor_ = 0;
+    bool wrap_ = true;
+    int16_t cursorX_ = 0;
+    int16_t cursorY_ = 0;
+};
+
+#endif
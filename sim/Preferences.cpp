@@ -0,0 +1,56 @@
+#include "Preferences.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "sim.h"
+
+std::string Preferences::path(const char* key) {
+    return sim::statePath("nvs") + "/" + name_ + "/" + key;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    std::string dir = sim::statePath("nvs") + "/" + name;
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0) {
+        // As nvs_open(), a namespace can only be opened read-only once it
+        // has been written.
+        if (readOnly) return false;
+        mkdir(sim::statePath("nvs").c_str(), 0755);
+        if (mkdir(dir.c_str(), 0755) != 0) return false;
+    }
+    name_ = name;
+    readOnly_ = readOnly;
+    return true;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    if (name_.empty()) return 0;
+    FILE* fp = fopen(path(key).c_str(), "rb");
+    if (!fp) return 0;
+    // Like the device, a blob larger than the buffer is not read at all.
+    size_t n = fread(buf, 1, maxLen, fp);
+    bool more = fgetc(fp) != EOF;
+    fclose(fp);
+    return more ? 0 : n;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (name_.empty() || readOnly_) return 0;
+    // Written aside and renamed over, as NVS never leaves a torn blob.
+    std::string p = path(key);
+    std::string tmp = p + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) return 0;
+    size_t n = fwrite(value, 1, len, fp);
+    if (fclose(fp) != 0 || n != len || rename(tmp.c_str(), p.c_str()) != 0) {
+        ::remove(tmp.c_str());
+        return 0;
+    }
+    return len;
+}
+
+bool Preferences::remove(const char* key) {
+    if (name_.empty() || readOnly_) return false;
+    return ::remove(path(key).c_str()) == 0;
+}
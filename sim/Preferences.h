@@ -0,0 +1,23 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+#include <stddef.h>
+
+#include <string>
+
+// NVS namespace whose blobs are host files under the simulator's state
+// directory, so they survive power cycles as on the device.
+class Preferences {
+   public:
+    bool begin(const char* name, bool readOnly = false);
+    void end() { name_.clear(); }
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+    size_t putBytes(const char* key, const void* value, size_t len);
+    bool remove(const char* key);
+
+   private:
+    std::string path(const char* key);
+    std::string name_;
+    bool readOnly_ = false;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PRINT_H
+#define PRINT_H
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WString.h"
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size);
+    size_t write(const char* s);
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v);
+    size_t print(double v, int decimals = 2);
+    size_t println() { return write("\n"); }
+    size_t println(const char* s) { return print(s) + println(); }
+    size_t println(const String& s) { return print(s) + println(); }
+    size_t println(int v) { return print(v) + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "PubSubClient.h"
+
+#include "WiFi.h"
+#include "sim.h"
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+    host_ = domain;
+    port_ = port;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+    bufferSize_ = size;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+    connected_ = WiFi.status() == WL_CONNECTED && sim::envLong("SIM_MQTT", 0);
+    if (connected_) delay(sim::envLong("SIM_MQTT_CONNECT_MS", 50));
+    return connected_;
+}
+
+void PubSubClient::disconnect() { connected_ = false; }
+
+bool PubSubClient::connected() {
+    if (WiFi.status() != WL_CONNECTED) connected_ = false;
+    return connected_;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload,
+                           unsigned int length, bool retained) {
+    // Mirror the library: the whole packet must fit in the buffer.
+    size_t packet = 5 + 2 + strlen(topic) + length;
+    if (!connected() || packet > bufferSize_) return false;
+    FILE* fp = fopen(sim::statePath("mqtt.log").c_str(), "ab");
+    if (!fp) return false;
+    fprintf(fp, "%s %u ", topic, length);
+    fwrite(payload, 1, length, fp);
+    fputc('\n', fp);
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+#include <string>
+
+#include "WiFiClient.h"
+
+// MQTT client stand-in. There is no broker: connect() succeeds when
+// SIM_MQTT=1 and WiFi is up, and every publish is appended to mqtt.log in the
+// simulator state directory.
+class PubSubClient {
+   public:
+    PubSubClient(WiFiClient& client) {}
+
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() { return bufferSize_; }
+    bool connect(const char* id);
+    void disconnect();
+    bool connected();
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const uint8_t* payload,
+                 unsigned int length, bool retained = false);
+    bool loop() { return connected(); }
+
+   private:
+    std::string host_;
+    uint16_t port_ = 1883;
+    uint16_t bufferSize_ = 256;
+    bool connected_ = false;
+};
+
+#endif
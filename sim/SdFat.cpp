@@ -0,0 +1,117 @@
+#include "SdFat.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+SdFat sd;
+
+File& File::operator=(File&& o) {
+    if (this != &o) {
+        close();
+        fp_ = o.fp_;
+        o.fp_ = nullptr;
+    }
+    return *this;
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+    return fp_ ? fwrite(buf, 1, size, fp_) : 0;
+}
+
+int File::available() {
+    if (!fp_) return 0;
+    return size() - position();
+}
+
+int File::read() {
+    return fp_ ? fgetc(fp_) : -1;
+}
+
+int File::read(uint8_t* buf, size_t size) {
+    if (!fp_) return -1;
+    return fread(buf, 1, size, fp_);
+}
+
+bool File::seek(uint32_t pos) { return fp_ && fseek(fp_, pos, SEEK_SET) == 0; }
+
+uint32_t File::position() { return fp_ ? ftell(fp_) : 0; }
+
+uint32_t File::size() {
+    if (!fp_) return 0;
+    struct stat st;
+    fflush(fp_);
+    return fstat(fileno(fp_), &st) == 0 ? st.st_size : 0;
+}
+
+bool File::getModifyDateTime(uint16_t* pdate, uint16_t* ptime) {
+    struct stat st;
+    if (!fp_ || fstat(fileno(fp_), &st) != 0) return false;
+    struct tm tm;
+    localtime_r(&st.st_mtime, &tm);
+    *pdate = (tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday;
+    *ptime = tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2;
+    return true;
+}
+
+bool File::sync() { return fp_ && fflush(fp_) == 0; }
+
+bool File::preAllocate(uint64_t length) {
+    if (!fp_) return false;
+    return fallocate(fileno(fp_), FALLOC_FL_KEEP_SIZE, 0, length) == 0;
+}
+
+bool File::truncate() {
+    if (!fp_ || fflush(fp_) != 0) return false;
+    return ftruncate(fileno(fp_), ftell(fp_)) == 0;
+}
+
+bool File::close() {
+    if (!fp_) return false;
+    fclose(fp_);
+    fp_ = nullptr;
+    return true;
+}
+
+std::string SdFat::hostPath(const char* path) {
+    std::string p = sim::statePath("sd");
+    if (path[0] != '/') p += '/';
+    return p + path;
+}
+
+bool SdFat::exists(const char* path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool SdFat::remove(const char* path) {
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool SdFat::rename(const char* oldPath, const char* newPath) {
+    // FAT rename refuses to replace an existing entry.
+    if (exists(newPath)) return false;
+    return ::rename(hostPath(oldPath).c_str(), hostPath(newPath).c_str()) == 0;
+}
+
+File SdFat::open(const char* path, int mode) {
+    std::string p = hostPath(path);
+    const char* fmode = "rb";
+    if (mode & (O_WRONLY | O_RDWR)) {
+        if (mode & O_TRUNC) {
+            fmode = "w+b";
+        } else if (exists(path)) {
+            fmode = "r+b";
+        } else if (mode & O_CREAT) {
+            fmode = "w+b";
+        } else {
+            return File();
+        }
+    }
+    FILE* fp = fopen(p.c_str(), fmode);
+    if (fp && (mode & O_AT_END)) fseek(fp, 0, SEEK_END);
+    return File(fp);
+}
@@ -0,0 +1,67 @@
+#ifndef SDFAT_H
+#define SDFAT_H
+#include <stdio.h>
+
+#include <string>
+
+#include "Stream.h"
+
+#define O_RDONLY 0x00
+#define O_WRONLY 0x01
+#define O_RDWR 0x02
+#define O_AT_END 0x04
+#define O_APPEND 0x08
+#define O_CREAT 0x10
+#define O_TRUNC 0x20
+#define O_EXCL 0x40
+#define FILE_READ O_RDONLY
+#define FILE_WRITE (O_RDWR | O_CREAT | O_AT_END)
+
+// SD card file backed by a host file under the simulator's sd/ directory.
+class File : public Stream {
+   public:
+    File() {}
+    File(FILE* fp) : fp_(fp) {}
+    File(File&& o) : fp_(o.fp_) { o.fp_ = nullptr; }
+    File& operator=(File&& o);
+    ~File() { close(); }
+
+    explicit operator bool() const { return fp_ != nullptr; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size) override;
+    size_t write(const void* buf, size_t size) {
+        return write((const uint8_t*)buf, size);
+    }
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int read(void* buf, size_t size) { return read((uint8_t*)buf, size); }
+    bool seek(uint32_t pos);
+    uint32_t position();
+    uint32_t size();
+    // Modify time from the directory entry, in FAT date and time format.
+    bool getModifyDateTime(uint16_t* pdate, uint16_t* ptime);
+    bool sync();
+    // Reserve space for the file without changing its size.
+    bool preAllocate(uint64_t length);
+    // Cut the file off at the current position.
+    bool truncate();
+    bool close();
+
+   private:
+    FILE* fp_ = nullptr;
+};
+
+class SdFat {
+   public:
+    bool begin() { return true; }
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* oldPath, const char* newPath);
+    File open(const char* path, int mode = FILE_READ);
+
+   private:
+    std::string hostPath(const char* path);
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include "Print.h"
+
+class Stream : public Print {
+   public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual int read(uint8_t* buf, size_t size);
+    size_t readBytes(uint8_t* buf, size_t size);
+    size_t readBytes(char* buf, size_t size) {
+        return readBytes((uint8_t*)buf, size);
+    }
+    void setTimeout(unsigned long ms) { timeoutMs_ = ms; }
+
+   protected:
+    unsigned long timeoutMs_ = 1000;
+};
+
+#endif
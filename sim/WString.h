@@ -0,0 +1,51 @@
+#ifndef WSTRING_H
+#define WSTRING_H
+#include <string>
+
+class String {
+   public:
+    String() {}
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned int v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2);
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.length(); }
+    bool isEmpty() const { return s_.empty(); }
+    int indexOf(char c) const;
+    String substring(unsigned int from) const { return String(s_.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const {
+        return String(s_.substr(from, to - from));
+    }
+    int toInt() const { return atoi(s_.c_str()); }
+
+    String& operator+=(const String& o) {
+        s_ += o.s_;
+        return *this;
+    }
+    String& operator+=(const char* o) {
+        s_ += o;
+        return *this;
+    }
+    String& operator+=(char c) {
+        s_ += c;
+        return *this;
+    }
+    friend String operator+(const String& a, const String& b) {
+        return String(a.s_ + b.s_);
+    }
+    bool operator==(const String& o) const { return s_ == o.s_; }
+    bool operator==(const char* o) const { return s_ == o; }
+    bool operator!=(const String& o) const { return s_ != o.s_; }
+    char operator[](unsigned int i) const { return s_[i]; }
+
+   private:
+    std::string s_;
+};
+
+#endif
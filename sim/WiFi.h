@@ -0,0 +1,89 @@
+#ifndef WIFI_H
+#define WIFI_H
+#include <atomic>
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_START = 2,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+    ARDUINO_EVENT_MAX = 40,
+} arduino_event_id_t;
+
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+typedef size_t wifi_event_id_t;
+
+// Simulated station. Association completes SIM_WIFI_CONNECT_MS after begin(),
+// or SIM_WIFI_FAST_CONNECT_MS with a BSSID, channel and static IP, unless
+// SIM_WIFI_FAIL is set, in which case each one-second attempt ends in a
+// disconnect event. With SIM_WIFI_STALE set the access point has a new BSSID
+// and connecting to the old one fails the same way. Event callbacks run on a
+// separate thread, like the WiFi event task.
+class WiFiClass {
+   public:
+    bool mode(wifi_mode_t m);
+    wifi_mode_t getMode() { return mode_; }
+    wl_status_t begin(const char* ssid, const char* pass, int32_t channel = 0,
+                      const uint8_t* bssid = NULL, bool connect = true);
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress());
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t n = 0);
+    uint8_t* BSSID();
+    int32_t channel();
+    int8_t RSSI();
+    wifi_event_id_t onEvent(WiFiEventCb cb,
+                            arduino_event_id_t event = ARDUINO_EVENT_MAX);
+
+   private:
+    static const int kMaxHandlers = 8;
+    struct Handler {
+        WiFiEventCb cb;
+        arduino_event_id_t event;
+    };
+    bool fails();
+    long connectMs();
+    void runEvents(unsigned generation);
+    void fire(arduino_event_id_t event);
+
+    Handler handlers_[kMaxHandlers];
+    int numHandlers_ = 0;
+    // Bumped by begin() and disconnect() to retire the event thread.
+    std::atomic<unsigned> generation_{0};
+    wifi_mode_t mode_ = WIFI_OFF;
+    std::atomic<bool> started_{false};
+    std::atomic<unsigned long> beginMs_{0};
+    bool staticIP_ = false;
+    bool direct_ = false;  // begin() was given a BSSID and channel
+    uint8_t bssid_[6] = {0};
+    int32_t channel_ = 0;
+};
+
+extern WiFiClass WiFi;
+
+#endif
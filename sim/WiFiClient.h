@@ -0,0 +1,31 @@
+#ifndef WIFICLIENT_H
+#define WIFICLIENT_H
+#include "Arduino.h"
+#include "Stream.h"
+
+// TCP client over host sockets. Connections are refused while the simulated
+// WiFi link is down.
+class WiFiClient : public Stream {
+   public:
+    WiFiClient() {}
+    ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    int connect(const char* host, uint16_t port);
+    int connect(IPAddress ip, uint16_t port);
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    uint8_t connected();
+    void stop();
+    operator bool() { return connected(); }
+
+   private:
+    int fd_ = -1;
+    bool eof_ = false;
+};
+
+#endif
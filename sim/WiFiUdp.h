@@ -0,0 +1,4 @@
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+#include "WiFi.h"
+#endif
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Local stand-in for the calendar server, for use with the native simulator.
+
+Serves images at /calendar.png and /calendar.ink without the
+weather/maps/chromedriver dependencies of server/server.py. Only the Python
+standard library is required. Without --image/--ink a synthetic 825x1200
+grayscale calendar is served.
+"""
+
+import os
+import sys
+import zlib
+import hashlib
+import struct
+import argparse
+import logging
+import threading
+from email.utils import formatdate
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "server"))
+import ink  # noqa: E402
+
+log = logging.getLogger("calendar-stub")
+
+
+def png_chunk(tag, data):
+    chunk = tag + data
+    return struct.pack(">I", len(data)) + chunk + struct.pack(">I", zlib.crc32(chunk))
+
+
+def synthetic_gray(width=825, height=1200, day=0):
+    """
+    A banner, a grey-scale ramp and some blocky "text" rows, roughly the
+    shape of a real calendar so compression ratios are representative. A
+    small "today" marker moves with the day, like the real calendar's
+    day-to-day changes.
+    """
+    marker = 20 + (day * 90) % (width - 120)
+    rows = []
+    for y in range(height):
+        row = bytearray(width)
+        for x in range(width):
+            if 410 <= y < 460 and marker <= x < marker + 100:
+                v = 0x40
+            elif y < 150:
+                v = 0x20
+            elif y < 400:
+                v = (x * 255 // width) & 0xE0
+            elif (y // 24) % 3 == 0 and (x // 12) % 5 != 4 and x % 12 < 9:
+                v = 0x00
+            else:
+                v = 0xFF
+            row[x] = v
+        rows.append(bytes(row))
+    return rows
+
+
+def gray_png(rows):
+    width, height = len(rows[0]), len(rows)
+    ihdr = struct.pack(">IIBBBBB", width, height, 8, 0, 0, 0, 0)
+    idat = zlib.compress(b"".join(b"\x00" + row for row in rows), 9)
+    return (
+        b"\x89PNG\r\n\x1a\n"
+        + png_chunk(b"IHDR", ihdr)
+        + png_chunk(b"IDAT", idat)
+        + png_chunk(b"IEND", b"")
+    )
+
+
+def gray_ink(rows):
+    """
+    Same layout as Page.save_ink() in server/views/page.py: the portrait
+    image rotated clockwise onto the landscape panel, 3-bit levels packed
+    two per byte and run-length coded.
+    """
+    width, height = len(rows[0]), len(rows)
+    payload = bytearray()
+    for py in range(width):
+        for px in range(0, height, 2):
+            hi = rows[height - 1 - px][py] >> 5
+            lo = rows[height - 2 - px][py] >> 5
+            payload.append(hi << 4 | lo)
+    payload = ink.encode(bytes(payload))
+    return ink.header(len(payload), ink.ENCODING_RLE) + payload
+
+
+class CalendarHandler(BaseHTTPRequestHandler):
+    # path -> (content type, body)
+    images = {}
+    # shared by every representation of the calendar, as in server.py
+    etag = ""
+    last_modified = ""
+    # serve a new day's calendar on every request
+    vary = False
+    day = 0
+    lock = threading.Lock()
+
+    def not_modified(self, etag):
+        """
+        Same conditional behaviour as server.py: the ETag wins over dates.
+        """
+        if_none_match = self.headers.get("If-None-Match")
+        if_modified_since = self.headers.get("If-Modified-Since")
+        if (if_none_match and if_none_match == etag) or (
+            not if_none_match and if_modified_since == self.last_modified
+        ):
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return True
+        return False
+
+    def next_request(self):
+        with self.lock:
+            if self.vary:
+                CalendarHandler.day += 1
+                load_synthetic(CalendarHandler.day)
+            return dict(self.images), self.etag
+
+    def do_GET(self):
+        images, etag = self.next_request()
+        if self.path not in images:
+            self.send_error(404)
+            return
+        content_type, body = images[self.path]
+        if self.not_modified(etag):
+            return
+        self.send_body(content_type, body, etag)
+
+    def do_POST(self):
+        """
+        A tile-hash manifest posted to either image returns a tile delta.
+        """
+        images, etag = self.next_request()
+        if self.path not in images:
+            self.send_error(404)
+            return
+        manifest = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        _, body = images["/calendar.ink"]
+        if self.not_modified(etag):
+            return
+        delta = ink.delta(body, manifest)
+        tiles = int.from_bytes(delta[6:8], "little")
+        log.info(f"delta of {tiles}/{ink.TILE_COUNT} tiles, {len(delta)} bytes")
+        self.send_body("application/octet-stream", delta, etag)
+
+    def send_body(self, content_type, body, etag):
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("ETag", etag)
+        self.send_header("Last-Modified", self.last_modified)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        log.info(format % args)
+
+
+def set_image(path, content_type, body):
+    images = CalendarHandler.images
+    images[path] = (content_type, body)
+    # The .ink holds what the panel shows, the PNG stands in without one.
+    _, tagged = images.get("/calendar.ink", images.get("/calendar.png"))
+    CalendarHandler.etag = '"%s"' % hashlib.sha1(tagged).hexdigest()
+    CalendarHandler.last_modified = formatdate(usegmt=True)
+
+
+def load_synthetic(day):
+    rows = synthetic_gray(day=day)
+    set_image("/calendar.png", "image/png", gray_png(rows))
+    set_image("/calendar.ink", "application/octet-stream", gray_ink(rows))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--image", help="PNG to serve, eg. server/views/calendar.png")
+    parser.add_argument("--ink", help=".ink to serve, eg. server/views/calendar.ink")
+    parser.add_argument(
+        "--vary", action="store_true", help="serve a changed calendar on every request"
+    )
+    parser.add_argument(
+        "--dump", metavar="DIR", help="write the synthetic calendar.png/.ink to DIR and exit"
+    )
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s - %(name)s - %(message)s")
+
+    load_synthetic(0)
+    if args.dump:
+        os.makedirs(args.dump, exist_ok=True)
+        for path, (_, body) in CalendarHandler.images.items():
+            with open(os.path.join(args.dump, path.lstrip("/")), "wb") as f:
+                f.write(body)
+        return
+    CalendarHandler.vary = args.vary and not (args.image or args.ink)
+    if args.image:
+        with open(args.image, "rb") as f:
+            set_image("/calendar.png", "image/png", f.read())
+    if args.ink:
+        with open(args.ink, "rb") as f:
+            set_image("/calendar.ink", "application/octet-stream", f.read())
+    for path, (_, body) in CalendarHandler.images.items():
+        log.info(f"serving {len(body)} byte image at {path} on port {args.port}")
+
+    httpd = ThreadingHTTPServer(("127.0.0.1", args.port), CalendarHandler)
+    try:
+        httpd.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    httpd.server_close()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,4 @@
+#ifndef DRIVER_RTC_IO_H
+#define DRIVER_RTC_IO_H
+#include "esp_sleep.h"
+#endif
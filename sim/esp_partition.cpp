@@ -0,0 +1,107 @@
+#include "esp_partition.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+
+#include "sim.h"
+
+// Data partitions of partitions.csv that the firmware opens.
+static const esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x290000,
+     0xB0000, "framebuf", false},
+};
+
+static std::string flashPath(const esp_partition_t* p) {
+    return sim::statePath((std::string("flash_") + p->label + ".bin").c_str());
+}
+
+// Open the partition's backing file, creating it erased on first use.
+static FILE* openFlash(const esp_partition_t* p) {
+    std::string path = flashPath(p);
+    FILE* fp = fopen(path.c_str(), "r+b");
+    if (fp) return fp;
+
+    fp = fopen(path.c_str(), "w+b");
+    if (!fp) return NULL;
+    uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xff, sizeof(erased));
+    for (uint32_t off = 0; off < p->size; off += sizeof(erased)) {
+        fwrite(erased, 1, sizeof(erased), fp);
+    }
+    return fp;
+}
+
+const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char* label) {
+    for (const esp_partition_t& p : partitions) {
+        if (p.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p.subtype != subtype) {
+            continue;
+        }
+        if (label && strcmp(label, p.label) != 0) continue;
+        return &p;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size) {
+    if (src_offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    FILE* fp = openFlash(partition);
+    if (!fp) return ESP_FAIL;
+    fseek(fp, src_offset, SEEK_SET);
+    size_t n = fread(dst, 1, size, fp);
+    fclose(fp);
+    return n == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size) {
+    if (dst_offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    FILE* fp = openFlash(partition);
+    if (!fp) return ESP_FAIL;
+
+    // NOR flash can only program 1s to 0s; unerased writes corrupt data.
+    uint8_t buf[SPI_FLASH_SEC_SIZE];
+    const uint8_t* in = (const uint8_t*)src;
+    size_t done = 0;
+    while (done < size) {
+        size_t n = size - done < sizeof(buf) ? size - done : sizeof(buf);
+        fseek(fp, dst_offset + done, SEEK_SET);
+        fread(buf, 1, n, fp);
+        for (size_t i = 0; i < n; i++) buf[i] &= in[done + i];
+        fseek(fp, dst_offset + done, SEEK_SET);
+        fwrite(buf, 1, n, fp);
+        done += n;
+    }
+    fclose(fp);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size) {
+    if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    FILE* fp = openFlash(partition);
+    if (!fp) return ESP_FAIL;
+
+    uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xff, sizeof(erased));
+    fseek(fp, offset, SEEK_SET);
+    for (size_t off = 0; off < size; off += sizeof(erased)) {
+        fwrite(erased, 1, sizeof(erased), fp);
+    }
+    fclose(fp);
+
+    // Sector erases dominate flash write time on the device.
+    long eraseMs = sim::envLong("SIM_FLASH_ERASE_MS", 25);
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(eraseMs * (size / SPI_FLASH_SEC_SIZE)));
+    return ESP_OK;
+}
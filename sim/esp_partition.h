@@ -0,0 +1,43 @@
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+// Host stand-in for the ESP-IDF partition API. Each data partition is a file
+// in the simulator state dir with NOR flash semantics: erased bytes are 0xFF
+// and writes can only clear bits.
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_36 = 36,
+    GPIO_NUM_39 = 39,
+} gpio_num_t;
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+} esp_sleep_wakeup_cause_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio, int level);
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+[[noreturn]] void esp_deep_sleep_start();
+
+#endif
@@ -0,0 +1,190 @@
+#include "ezTime.h"
+
+#include <stdlib.h>
+
+#include "WiFi.h"
+#include "sim.h"
+
+static time_t baseTime = 0;
+static unsigned long baseMillis = 0;
+
+time_t makeTime(tmElements_t& tm) {
+    struct tm t = {};
+    t.tm_year = tm.Year + 70;
+    t.tm_mon = tm.Month - 1;
+    t.tm_mday = tm.Day;
+    t.tm_hour = tm.Hour;
+    t.tm_min = tm.Minute;
+    t.tm_sec = tm.Second;
+    return timegm(&t);
+}
+
+void breakTime(time_t t, tmElements_t& tm) {
+    struct tm b;
+    gmtime_r(&t, &b);
+    tm.Second = b.tm_sec;
+    tm.Minute = b.tm_min;
+    tm.Hour = b.tm_hour;
+    tm.Wday = b.tm_wday + 1;
+    tm.Day = b.tm_mday;
+    tm.Month = b.tm_mon + 1;
+    tm.Year = b.tm_year - 70;
+}
+
+void setTime(time_t t) {
+    baseTime = t;
+    baseMillis = millis();
+}
+
+time_t now() { return baseTime + (millis() - baseMillis) / 1000; }
+
+void setServer(const String& ntpServer) {}
+
+void setInterval(uint16_t seconds) {}
+
+bool waitForSync(uint16_t timeout) {
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        if (timeout && millis() - start >= timeout * 1000UL) return false;
+        delay(10);
+    }
+    delay(sim::envLong("SIM_NTP_MS", 100));
+    setTime(sim::worldEpoch());
+    return true;
+}
+
+void updateNTP() { waitForSync(); }
+
+// Format a broken-down local time using ezTime's PHP-style format letters.
+static String format(time_t local, int offsetMinutes, const char* abbr,
+                     const char* fmt) {
+    struct tm b;
+    gmtime_r(&local, &b);
+    std::string out;
+    char buf[16];
+    for (const char* f = fmt; *f; f++) {
+        switch (*f) {
+            case '\\':
+                if (f[1]) out += *++f;
+                continue;
+            case 'Y':
+                snprintf(buf, sizeof(buf), "%04d", b.tm_year + 1900);
+                break;
+            case 'y':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_year % 100);
+                break;
+            case 'm':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_mon + 1);
+                break;
+            case 'd':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_mday);
+                break;
+            case 'H':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_hour);
+                break;
+            case 'i':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_min);
+                break;
+            case 's':
+                snprintf(buf, sizeof(buf), "%02d", b.tm_sec);
+                break;
+            case 'T':
+                snprintf(buf, sizeof(buf), "%s", abbr);
+                break;
+            case 'P':
+            case 'O': {
+                int east = -offsetMinutes;
+                snprintf(buf, sizeof(buf), *f == 'P' ? "%c%02d:%02d" : "%c%02d%02d",
+                         east < 0 ? '-' : '+', abs(east) / 60, abs(east) % 60);
+                break;
+            }
+            default:
+                buf[0] = *f;
+                buf[1] = 0;
+                break;
+        }
+        out += buf;
+    }
+    return String(out);
+}
+
+String dateTime(time_t t, const String& fmt) {
+    return format(t, 0, "UTC", fmt.c_str());
+}
+
+bool Timezone::setLocation(const String& location) {
+    // The real library asks timezoned.rop.nl over UDP.
+    if (WiFi.status() != WL_CONNECTED) return false;
+    delay(sim::envLong("SIM_TZ_LOOKUP_MS", 150));
+    // The POSIX rule is the last line of the host's zoneinfo file.
+    std::string path = "/usr/share/zoneinfo/" + std::string(location.c_str());
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == NULL) return false;
+    std::string data;
+    char buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    fclose(f);
+    size_t end = data.find_last_not_of('\n');
+    size_t start = data.rfind('\n', end);
+    if (end == std::string::npos || start == std::string::npos) return false;
+    olson_ = location;
+    posix_ = String(data.substr(start + 1, end - start).c_str());
+    return true;
+}
+
+bool Timezone::setPosix(const String& posix) {
+    olson_ = "";
+    posix_ = posix;
+    return true;
+}
+
+void Timezone::apply() {
+    setenv("TZ", olson_.length() ? olson_.c_str() : posix_.c_str(), 1);
+    tzset();
+}
+
+int16_t Timezone::getOffset(time_t utc) {
+    if (!utc) utc = ::now();
+    apply();
+    struct tm b;
+    localtime_r(&utc, &b);
+    return -b.tm_gmtoff / 60;
+}
+
+time_t Timezone::tzTime(time_t t, ezLocalOrUTC_t localOrUTC) {
+    if (localOrUTC == UTC_TIME) return t - getOffset(t) * 60;
+    apply();
+    struct tm b;
+    gmtime_r(&t, &b);
+    b.tm_isdst = -1;
+    return mktime(&b);
+}
+
+time_t Timezone::now() { return tzTime(::now()); }
+
+String Timezone::dateTime(const String& fmt) {
+    return dateTime(::now(), fmt);
+}
+
+String Timezone::dateTime(time_t utc, const String& fmt) {
+    int16_t offset = getOffset(utc);
+    struct tm b;
+    localtime_r(&utc, &b);
+    return format(utc - offset * 60, offset, b.tm_zone, fmt.c_str());
+}
+
+static struct tm localNow(Timezone& tz) {
+    time_t local = tz.now();
+    struct tm b;
+    gmtime_r(&local, &b);
+    return b;
+}
+
+uint8_t Timezone::hour() { return localNow(*this).tm_hour; }
+uint8_t Timezone::minute() { return localNow(*this).tm_min; }
+uint8_t Timezone::second() { return localNow(*this).tm_sec; }
+uint8_t Timezone::day() { return localNow(*this).tm_mday; }
+uint8_t Timezone::weekday() { return localNow(*this).tm_wday + 1; }
+uint8_t Timezone::month() { return localNow(*this).tm_mon + 1; }
+uint16_t Timezone::year() { return localNow(*this).tm_year + 1900; }
@@ -0,0 +1,67 @@
+#ifndef EZTIME_H
+#define EZTIME_H
+#include "Arduino.h"
+
+// Host stand-in for ropg/ezTime. "NTP" returns the simulator's world clock
+// and Olson names are resolved through the host's zoneinfo database; both
+// still require the simulated WiFi link, like the real network lookups.
+
+#define SECS_PER_MIN (60UL)
+#define SECS_PER_HOUR (3600UL)
+#define SECS_PER_DAY (SECS_PER_HOUR * 24UL)
+
+#define RFC3339 "Y-m-d\\TH:i:sP"
+#define ISO8601 "Y-m-d\\TH:i:sO"
+
+typedef enum { UTC_TIME, LOCAL_TIME } ezLocalOrUTC_t;
+
+typedef struct {
+    uint8_t Second;
+    uint8_t Minute;
+    uint8_t Hour;
+    uint8_t Wday;  // day of week, sunday is day 1
+    uint8_t Day;
+    uint8_t Month;
+    uint8_t Year;  // offset from 1970
+} tmElements_t;
+
+time_t makeTime(tmElements_t& tm);
+void breakTime(time_t t, tmElements_t& tm);
+
+void setTime(time_t t);
+time_t now();
+void setServer(const String& ntpServer);
+void setInterval(uint16_t seconds = 0);
+bool waitForSync(uint16_t timeout = 0);
+void updateNTP();
+String dateTime(time_t t, const String& format = RFC3339);
+
+class Timezone {
+   public:
+    bool setLocation(const String& location = "GeoIP");
+    bool setPosix(const String& posix);
+    String getOlson() { return olson_; }
+    String getPosix() { return posix_; }
+    time_t now();
+    // Local time of a UTC time, or with LOCAL_TIME the UTC time of a local
+    // time.
+    time_t tzTime(time_t t, ezLocalOrUTC_t localOrUTC = UTC_TIME);
+    int16_t getOffset(time_t utc = 0);  // minutes west of UTC
+    String dateTime(const String& format = RFC3339);
+    String dateTime(time_t t, const String& format = RFC3339);
+    uint8_t hour();
+    uint8_t minute();
+    uint8_t second();
+    uint8_t day();
+    uint8_t weekday();
+    uint8_t month();
+    uint16_t year();
+
+   private:
+    void apply();
+
+    String olson_;
+    String posix_ = "UTC0";
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <pthread.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct SimTask {
+    TaskFunction_t fn;
+    void* param;
+};
+
+struct SimQueue {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+struct SimSemaphore {
+    std::timed_mutex mu;
+};
+
+struct SimEventGroup {
+    std::mutex mu;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+static void* runTask(void* arg) {
+    SimTask* task = (SimTask*)arg;
+    task->fn(task->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name,
+                                   uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+    // Handles stay valid for the life of the process; tasks are few.
+    SimTask* task = new SimTask{fn, param};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, runTask, task) != 0) {
+        delete task;
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name,
+                       uint32_t stackDepth, void* param, UBaseType_t priority,
+                       TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority,
+                                   handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL) pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+TickType_t xTaskGetTickCount() { return millis(); }
+
+BaseType_t xPortGetCoreID() { return ARDUINO_RUNNING_CORE; }
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    SimQueue* q = new SimQueue();
+    q->length = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+// Wait on the queue condition until pred holds or the ticks run out.
+template <typename Pred>
+static bool waitFor(SimQueue* q, std::unique_lock<std::mutex>& lock,
+                    TickType_t wait, Pred pred) {
+    if (wait == portMAX_DELAY) {
+        q->cv.wait(lock, pred);
+        return true;
+    }
+    return q->cv.wait_for(lock, std::chrono::milliseconds(wait), pred);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(q->mu);
+    if (!waitFor(q, lock, wait, [q] { return q->items.size() < q->length; })) {
+        return errQUEUE_FULL;
+    }
+    const uint8_t* p = (const uint8_t*)item;
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(q->mu);
+    if (!waitFor(q, lock, wait, [q] { return !q->items.empty(); })) {
+        return errQUEUE_EMPTY;
+    }
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    q->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    std::lock_guard<std::mutex> lock(q->mu);
+    return q->items.size();
+}
+
+EventGroupHandle_t xEventGroupCreate() { return new SimEventGroup(); }
+
+void vEventGroupDelete(EventGroupHandle_t group) { delete group; }
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mu);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mu);
+    EventBits_t old = group->bits;
+    group->bits &= ~bits;
+    return old;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mu);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t wait) {
+    std::unique_lock<std::mutex> lock(group->mu);
+    auto ready = [group, bits, waitForAll] {
+        EventBits_t set = group->bits & bits;
+        return waitForAll ? set == bits : set != 0;
+    };
+    if (wait == portMAX_DELAY) {
+        group->cv.wait(lock, ready);
+    } else {
+        group->cv.wait_for(lock, std::chrono::milliseconds(wait), ready);
+    }
+    EventBits_t result = group->bits;
+    if (clearOnExit && ready()) group->bits &= ~bits;
+    return result;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new SimSemaphore(); }
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    if (wait == portMAX_DELAY) {
+        sem->mu.lock();
+        return pdTRUE;
+    }
+    return sem->mu.try_lock_for(std::chrono::milliseconds(wait)) ? pdTRUE
+                                                                 : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    sem->mu.unlock();
+    return pdTRUE;
+}
@@ -0,0 +1,27 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+// Host stand-in for the FreeRTOS kernel bundled with the ESP32 core. Tasks
+// are host threads and ticks are milliseconds.
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_FULL 0
+#define errQUEUE_EMPTY 0
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+#ifndef ARDUINO_RUNNING_CORE
+#define ARDUINO_RUNNING_CORE 1
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef FREERTOS_EVENT_GROUPS_H
+#define FREERTOS_EVENT_GROUPS_H
+#include "FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+typedef struct SimEventGroup* EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+// Returns the bits when the wait ended, before any are cleared.
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t wait);
+
+#endif
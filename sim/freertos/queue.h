@@ -0,0 +1,15 @@
+#ifndef FREERTOS_QUEUE_H
+#define FREERTOS_QUEUE_H
+#include "FreeRTOS.h"
+
+typedef struct SimQueue* QueueHandle_t;
+
+// Fixed-size items are copied in and out, as with the real kernel.
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+#define xQueueSendToBack xQueueSend
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef FREERTOS_SEMPHR_H
+#define FREERTOS_SEMPHR_H
+#include "FreeRTOS.h"
+
+typedef struct SimSemaphore* SemaphoreHandle_t;
+
+// Only mutexes; not recursive, like xSemaphoreCreateMutex().
+SemaphoreHandle_t xSemaphoreCreateMutex();
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef struct SimTask* TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name,
+                                   uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name,
+                       uint32_t stackDepth, void* param, UBaseType_t priority,
+                       TaskHandle_t* handle);
+// Only self-deletion (NULL) is supported; the calling thread exits.
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+
+#endif
@@ -0,0 +1,376 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "HTTPClient.h"
+#include "WiFi.h"
+#include "sim.h"
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t m) {
+    mode_ = m;
+    if (m == WIFI_OFF) {
+        started_ = false;
+        generation_++;
+    }
+    return true;
+}
+
+// The simulated access point.
+static const uint8_t kBSSID[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+static const uint8_t kStaleBSSID[6] = {0x24, 0x0a, 0xc4, 0x65, 0x43, 0x21};
+static const int32_t kChannel = 6;
+
+static const uint8_t* apBSSID() {
+    return sim::envLong("SIM_WIFI_STALE", 0) ? kStaleBSSID : kBSSID;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* pass,
+                             int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+    if (mode_ == WIFI_OFF) mode_ = WIFI_STA;
+    direct_ = bssid != NULL && channel > 0;
+    if (direct_) memcpy(bssid_, bssid, sizeof(bssid_));
+    channel_ = channel;
+    started_ = true;
+    beginMs_ = millis();
+    unsigned generation = ++generation_;
+    std::thread([this, generation] { runEvents(generation); }).detach();
+    return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    started_ = false;
+    generation_++;
+    if (wifiOff) mode_ = WIFI_OFF;
+    return true;
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1) {
+    staticIP_ = local != IPAddress();
+    return true;
+}
+
+bool WiFiClass::fails() {
+    if (sim::envLong("SIM_WIFI_FAIL", 0)) return true;
+    return direct_ && (channel_ != kChannel ||
+                       memcmp(bssid_, apBSSID(), sizeof(bssid_)) != 0);
+}
+
+long WiFiClass::connectMs() {
+    if (direct_ && staticIP_) {
+        return sim::envLong("SIM_WIFI_FAST_CONNECT_MS", 300);
+    }
+    return sim::envLong("SIM_WIFI_CONNECT_MS", 1500);
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventCb cb, arduino_event_id_t event) {
+    if (numHandlers_ == kMaxHandlers) return 0;
+    handlers_[numHandlers_++] = {cb, event};
+    return numHandlers_;
+}
+
+void WiFiClass::fire(arduino_event_id_t event) {
+    for (int i = 0; i < numHandlers_; i++) {
+        if (handlers_[i].event == event ||
+            handlers_[i].event == ARDUINO_EVENT_MAX) {
+            handlers_[i].cb(event);
+        }
+    }
+}
+
+// The event task of one begin(), until the next begin() or disconnect().
+void WiFiClass::runEvents(unsigned generation) {
+    bool fail = fails();
+    unsigned long at = beginMs_ + (fail ? 1000 : connectMs());
+    while (true) {
+        long wait = (long)(at - millis());
+        if (wait > 0) delay(wait);
+        if (generation_ != generation || !started_) return;
+        if (!fail) break;
+        fire(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+        at += 1000;
+    }
+    fire(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+    fire(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+}
+
+wl_status_t WiFiClass::status() {
+    if (!started_ || mode_ == WIFI_OFF) return WL_DISCONNECTED;
+    if (fails()) return WL_NO_SSID_AVAIL;
+    if ((long)(millis() - beginMs_) < connectMs()) return WL_DISCONNECTED;
+    return WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+    return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP() {
+    return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask() {
+    return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0)
+                                    : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t n) {
+    return status() == WL_CONNECTED && n == 0 ? IPAddress(192, 168, 1, 1)
+                                              : IPAddress();
+}
+
+uint8_t* WiFiClass::BSSID() {
+    static uint8_t bssid[6];
+    if (status() != WL_CONNECTED) return NULL;
+    memcpy(bssid, apBSSID(), sizeof(bssid));
+    return bssid;
+}
+
+int32_t WiFiClass::channel() {
+    return status() == WL_CONNECTED ? kChannel : 0;
+}
+
+int8_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? -60 : 0; }
+
+int Stream::read(uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (n < size && available() > 0) {
+        int c = read();
+        if (c < 0) break;
+        buf[n++] = c;
+    }
+    return n;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t size) {
+    size_t n = 0;
+    unsigned long start = millis();
+    while (n < size && millis() - start < timeoutMs_) {
+        int r = read(buf + n, size - n);
+        if (r > 0) {
+            n += r;
+            start = millis();
+        } else {
+            delay(1);
+        }
+    }
+    return n;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    stop();
+    if (WiFi.status() != WL_CONNECTED) return 0;
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host, service.c_str(), &hints, &res) != 0) return 0;
+    for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            fd_ = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(res);
+    eof_ = false;
+    return fd_ >= 0;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+    if (fd_ < 0) return 0;
+    ssize_t n = send(fd_, buf, size, MSG_NOSIGNAL);
+    return n < 0 ? 0 : n;
+}
+
+int WiFiClient::available() {
+    if (fd_ < 0) return 0;
+    int n = 0;
+    if (ioctl(fd_, FIONREAD, &n) < 0) return 0;
+    if (n == 0) {
+        // Distinguish "nothing yet" from an orderly shutdown by the peer.
+        pollfd p = {fd_, POLLIN, 0};
+        if (poll(&p, 1, 0) > 0 && (p.revents & (POLLIN | POLLHUP))) {
+            char c;
+            if (recv(fd_, &c, 1, MSG_PEEK) == 0) eof_ = true;
+        }
+    }
+    return n;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+    if (fd_ < 0 || eof_) return -1;
+    pollfd p = {fd_, POLLIN, 0};
+    if (poll(&p, 1, 0) <= 0) return 0;
+    ssize_t n = recv(fd_, buf, size, 0);
+    if (n == 0) eof_ = true;
+    return n <= 0 ? -1 : n;
+}
+
+uint8_t WiFiClient::connected() {
+    if (fd_ < 0) return 0;
+    // Like the ESP32 client, stay "connected" while unread data remains.
+    return available() > 0 || !eof_;
+}
+
+void WiFiClient::stop() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    eof_ = false;
+}
+
+static bool equalsIgnoreCase(const std::string& a, const char* b) {
+    return strcasecmp(a.c_str(), b) == 0;
+}
+
+bool HTTPClient::begin(const char* url) {
+    std::string u(url);
+    const std::string scheme = "http://";
+    if (u.compare(0, scheme.size(), scheme) != 0) return false;
+    u = u.substr(scheme.size());
+    size_t slash = u.find('/');
+    std::string hostPort = u.substr(0, slash);
+    path_ = slash == std::string::npos ? "/" : u.substr(slash);
+    size_t colon = hostPort.find(':');
+    host_ = hostPort.substr(0, colon);
+    port_ = colon == std::string::npos
+                ? 80
+                : (uint16_t)atoi(hostPort.substr(colon + 1).c_str());
+    reqHeaders_.clear();
+    size_ = -1;
+    return true;
+}
+
+void HTTPClient::end() { client_.stop(); }
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+    reqHeaders_.emplace_back(name.c_str(), value.c_str());
+}
+
+void HTTPClient::collectHeaders(const char* keys[], size_t count) {
+    respHeaders_.clear();
+    for (size_t i = 0; i < count; i++) respHeaders_.emplace_back(keys[i], "");
+}
+
+String HTTPClient::header(const char* name) {
+    for (auto& h : respHeaders_) {
+        if (equalsIgnoreCase(h.first, name)) return String(h.second);
+    }
+    return String();
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+    return header(name).length() > 0;
+}
+
+int HTTPClient::GET() { return sendRequest("GET", NULL, 0); }
+
+int HTTPClient::POST(uint8_t* payload, size_t size) {
+    return sendRequest("POST", payload, size);
+}
+
+bool HTTPClient::readLine(std::string& line) {
+    line.clear();
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs_) {
+        int c = client_.read();
+        if (c < 0) {
+            if (!client_.connected()) return false;
+            delay(1);
+            continue;
+        }
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+        line += (char)c;
+    }
+    return false;
+}
+
+int HTTPClient::sendRequest(const char* method, const uint8_t* payload,
+                            size_t size) {
+    if (!client_.connect(host_.c_str(), port_)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    for (auto& h : respHeaders_) h.second.clear();
+
+    std::string req = std::string(method) + " " + path_ + " HTTP/1.0\r\n";
+    req += "Host: " + host_ + "\r\n";
+    req += "User-Agent: ESP32HTTPClient\r\n";
+    req += "Connection: close\r\n";
+    for (auto& h : reqHeaders_) req += h.first + ": " + h.second + "\r\n";
+    if (payload) req += "Content-Length: " + std::to_string(size) + "\r\n";
+    req += "\r\n";
+    if (client_.write((const uint8_t*)req.data(), req.size()) != req.size()) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    if (payload && size && client_.write(payload, size) != size) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+
+    std::string line;
+    if (!readLine(line)) return HTTPC_ERROR_READ_TIMEOUT;
+    size_t sp = line.find(' ');
+    if (sp == std::string::npos) return HTTPC_ERROR_CONNECTION_LOST;
+    int code = atoi(line.c_str() + sp + 1);
+
+    size_ = -1;
+    while (readLine(line) && !line.empty()) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        if (equalsIgnoreCase(name, "Content-Length")) {
+            size_ = atoi(value.c_str());
+        }
+        for (auto& h : respHeaders_) {
+            if (equalsIgnoreCase(h.first, name.c_str())) h.second = value;
+        }
+    }
+    return code;
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+        case HTTPC_ERROR_CONNECTION_REFUSED:
+            return "connection refused";
+        case HTTPC_ERROR_SEND_HEADER_FAILED:
+            return "send header failed";
+        case HTTPC_ERROR_NOT_CONNECTED:
+            return "not connected";
+        case HTTPC_ERROR_CONNECTION_LOST:
+            return "connection lost";
+        case HTTPC_ERROR_READ_TIMEOUT:
+            return "read Timeout";
+        default:
+            return String();
+    }
+}
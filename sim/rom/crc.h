@@ -0,0 +1,17 @@
+#ifndef ROM_CRC_H
+#define ROM_CRC_H
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3) as in the ESP32's ROM: pass 0 to start, or the result
+// of the previous call to continue.
+static inline uint32_t crc32_le(uint32_t crc, const uint8_t* buf,
+                                uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef ROM_RTC_H
+#define ROM_RTC_H
+#include "esp_sleep.h"
+#endif
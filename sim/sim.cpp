@@ -0,0 +1,248 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "Arduino.h"
+
+// Provided by the firmware.
+void setup();
+void loop();
+
+// Linker-provided bounds of the RTC_DATA_ATTR section.
+extern char __start_rtc_sim_data[];
+extern char __stop_rtc_sim_data[];
+// Keep the section alive even if the firmware declares nothing in it.
+RTC_DATA_ATTR __attribute__((used)) static uint32_t rtcSectionAnchor;
+
+namespace sim {
+namespace {
+
+const uint32_t kStateMagic = 0x534d4b49;  // "IKMS"
+const uint32_t kStateVersion = 2;
+
+// Everything the simulated hardware keeps across deep sleep.
+struct State {
+    uint32_t magic;
+    uint32_t version;
+    int64_t worldEpoch;  // world time at the start of this wake
+    int64_t rtcEpoch;    // RTC time at the start of this wake
+    int64_t driftUs;     // RTC gain on the world clock not yet in whole seconds
+    uint8_t rtcSet;
+    uint8_t alarmSet;
+    uint8_t ext0Enabled;
+    uint8_t timerEnabled;
+    int64_t alarmEpoch;
+    uint64_t timerUs;
+    int32_t wakeupCause;
+    int32_t bootCount;
+    uint32_t rtcMemSize;
+};
+
+State state;
+std::chrono::steady_clock::time_point wakeStart;
+std::string dir;
+int remainingWakes = 1;
+char** savedArgv;
+
+int64_t elapsedSeconds() { return (int64_t)(wakeMicros() / 1000000); }
+
+bool loadState() {
+    FILE* fp = fopen(statePath("rtc.bin").c_str(), "rb");
+    if (!fp) return false;
+    State s;
+    bool ok = fread(&s, sizeof(s), 1, fp) == 1 && s.magic == kStateMagic &&
+              s.version == kStateVersion &&
+              s.rtcMemSize ==
+                  (uint32_t)(__stop_rtc_sim_data - __start_rtc_sim_data);
+    // RTC memory only survives a deep sleep, not a power cycle.
+    if (ok && s.wakeupCause != ESP_SLEEP_WAKEUP_UNDEFINED) {
+        ok = fread(__start_rtc_sim_data, 1, s.rtcMemSize, fp) == s.rtcMemSize;
+    }
+    fclose(fp);
+    if (ok) state = s;
+    return ok;
+}
+
+void saveState() {
+    FILE* fp = fopen(statePath("rtc.bin").c_str(), "wb");
+    if (!fp) {
+        note("cannot persist RTC memory to %s", statePath("rtc.bin").c_str());
+        return;
+    }
+    state.rtcMemSize = __stop_rtc_sim_data - __start_rtc_sim_data;
+    fwrite(&state, sizeof(state), 1, fp);
+    fwrite(__start_rtc_sim_data, 1, state.rtcMemSize, fp);
+    fclose(fp);
+}
+
+void coldBoot(int bootCount) {
+    memset(&state, 0, sizeof(state));
+    state.magic = kStateMagic;
+    state.version = kStateVersion;
+    state.worldEpoch = time(NULL);
+    state.wakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    state.bootCount = bootCount;
+}
+
+}  // namespace
+
+const std::string& stateDir() { return dir; }
+
+std::string statePath(const char* name) { return dir + "/" + name; }
+
+long envLong(const char* name, long fallback) {
+    const char* v = getenv(name);
+    return v && *v ? strtol(v, NULL, 10) : fallback;
+}
+
+double envDouble(const char* name, double fallback) {
+    const char* v = getenv(name);
+    return v && *v ? strtod(v, NULL) : fallback;
+}
+
+uint64_t wakeMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - wakeStart)
+        .count();
+}
+
+time_t worldEpoch() { return state.worldEpoch + elapsedSeconds(); }
+
+uint32_t rtcEpoch() {
+    if (!state.rtcSet) return 0;
+    return state.rtcEpoch + elapsedSeconds();
+}
+
+void rtcSetEpoch(uint32_t epoch) {
+    state.rtcEpoch = (int64_t)epoch - elapsedSeconds();
+    state.rtcSet = 1;
+}
+
+bool rtcIsSet() { return state.rtcSet; }
+
+void rtcSetAlarm(uint32_t epoch) {
+    state.alarmEpoch = epoch;
+    state.alarmSet = 1;
+}
+
+bool ext0WakeupEnabled() { return state.ext0Enabled; }
+
+void enableExt0Wakeup() { state.ext0Enabled = 1; }
+
+int wakeupCause() { return state.wakeupCause; }
+
+int bootCount() { return state.bootCount; }
+
+void note(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[sim] ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+void enableTimerWakeup(uint64_t us) {
+    state.timerEnabled = 1;
+    state.timerUs = us;
+}
+
+[[noreturn]] void deepSleep() {
+    double awake = wakeMicros() / 1e6;
+    int64_t world = worldEpoch();
+    int64_t sleepSeconds = -1;
+    int cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+    if (state.ext0Enabled && state.alarmSet && state.rtcSet) {
+        sleepSeconds = state.alarmEpoch - (int64_t)rtcEpoch();
+        if (sleepSeconds < 1) sleepSeconds = 1;
+        cause = ESP_SLEEP_WAKEUP_EXT0;
+    } else if (state.timerEnabled) {
+        sleepSeconds = state.timerUs / 1000000;
+        cause = ESP_SLEEP_WAKEUP_TIMER;
+    }
+
+    note("wake #%d awake for %.3f s", state.bootCount, awake);
+
+    if (sleepSeconds < 0) {
+        note("no wakeup source armed, device would sleep forever");
+        saveState();
+        exit(0);
+    }
+    note("deep sleep for %lld s", (long long)sleepSeconds);
+
+    // Carry the clocks across the sleep and disarm one-shot wake sources.
+    // A fast RTC, with a positive SIM_RTC_DRIFT_PPM, reaches its alarm
+    // early in world time.
+    int64_t rtc = rtcEpoch();
+    state.driftUs += sleepSeconds * envDouble("SIM_RTC_DRIFT_PPM", 0);
+    int64_t lag = state.driftUs / 1000000;
+    state.driftUs -= lag * 1000000;
+    state.worldEpoch = world + sleepSeconds - lag;
+    state.rtcEpoch = rtc + sleepSeconds;
+    state.alarmSet = 0;
+    state.ext0Enabled = 0;
+    state.timerEnabled = 0;
+    state.wakeupCause = cause;
+    state.bootCount++;
+    saveState();
+
+    fflush(stdout);
+    if (--remainingWakes > 0) {
+        // Re-exec so that ordinary RAM starts from scratch, as on a real
+        // wake; only the RTC_DATA_ATTR section comes back from disk.
+        std::string wakes = std::to_string(remainingWakes);
+        const char* argv[] = {savedArgv[0], "--wakes", wakes.c_str(), NULL};
+        execv("/proc/self/exe", (char* const*)argv);
+        execv(savedArgv[0], (char* const*)argv);
+        note("re-exec failed, stopping");
+    }
+    exit(0);
+}
+
+}  // namespace sim
+
+int main(int argc, char** argv) {
+    using namespace sim;
+    bool reset = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--reset")) {
+            reset = true;
+        } else if (!strcmp(argv[i], "--wakes") && i + 1 < argc) {
+            remainingWakes = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--reset] [--wakes N]\n", argv[0]);
+            return 2;
+        }
+    }
+    savedArgv = argv;
+    // Keep serial output in order with the simulator's own notes.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    rtcSectionAnchor = kStateMagic;
+
+    const char* d = getenv("SIM_STATE_DIR");
+    dir = d && *d ? d : ".sim";
+    mkdir(dir.c_str(), 0755);
+    mkdir(statePath("sd").c_str(), 0755);
+
+    if (reset || !loadState()) {
+        coldBoot(1);
+    } else if (state.wakeupCause == ESP_SLEEP_WAKEUP_UNDEFINED) {
+        // Last run never armed a wakeup; treat this as a power cycle.
+        coldBoot(state.bootCount + 1);
+    }
+    wakeStart = std::chrono::steady_clock::now();
+    note("wake #%d (cause %d)", state.bootCount, state.wakeupCause);
+
+    setup();
+    note("setup() returned without entering deep sleep");
+    return 1;
+}
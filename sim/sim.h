@@ -0,0 +1,45 @@
+#ifndef SIM_H
+#define SIM_H
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+
+// Host simulator plumbing shared by the fake board back-ends.
+namespace sim {
+
+// Directory holding persisted RTC memory, the SD card root and outputs.
+const std::string& stateDir();
+// Path of a file inside stateDir().
+std::string statePath(const char* name);
+
+// Integer/double knobs read from SIM_* environment variables.
+long envLong(const char* name, long fallback);
+double envDouble(const char* name, double fallback);
+
+// Microseconds since this wake started (what micros() reports on device).
+uint64_t wakeMicros();
+// Wall-clock time of the simulated world in UTC. It advances in real time
+// while awake and jumps forward across deep sleep.
+time_t worldEpoch();
+
+// The board's external RTC.
+uint32_t rtcEpoch();
+void rtcSetEpoch(uint32_t epoch);
+bool rtcIsSet();
+void rtcSetAlarm(uint32_t epoch);
+
+bool ext0WakeupEnabled();
+void enableExt0Wakeup();
+void enableTimerWakeup(uint64_t us);
+// Persist RTC memory and the clocks, then start the next wake (if any).
+[[noreturn]] void deepSleep();
+int wakeupCause();
+int bootCount();
+
+// Print a simulator status line on stderr.
+void note(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+}  // namespace sim
+
+#endif
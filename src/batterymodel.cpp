@@ -0,0 +1,129 @@
+#include "batterymodel.h"
+
+#include "lib.h"
+
+#define BATTERY_FILTER_MAGIC 0x31544142  // "BAT1"
+// Fraction bits of the average, so small readings still move it.
+#define BATTERY_EMA_FRACTION 4
+
+// A point of a discharge profile.
+struct BatteryPoint {
+    uint16_t millivolts;
+    uint8_t percent;
+};
+
+#if defined(BATT_2000MAH)
+// A capacity table based on a 3.7v 2000mAh LiPo discharge profile over ~50
+// days, highest voltage first.
+static const BatteryPoint capacityTable[] = {
+    {4250, 100}, {4220, 99}, {4190, 98}, {4170, 97}, {4150, 96}, {4140, 95},
+    {4120, 94}, {4110, 93}, {4100, 91}, {4090, 90}, {4080, 89}, {4080, 88},
+    {4080, 87}, {4080, 86}, {4070, 85}, {4070, 84}, {4070, 83}, {4070, 82},
+    {4060, 81}, {4060, 80}, {4050, 79}, {4040, 78}, {4030, 77}, {4020, 76},
+    {4000, 74}, {3990, 73}, {3980, 72}, {3970, 71}, {3960, 70}, {3960, 69},
+    {3950, 68}, {3950, 67}, {3940, 66}, {3940, 65}, {3930, 64}, {3930, 63},
+    {3920, 62}, {3910, 61}, {3900, 60}, {3890, 59}, {3870, 57}, {3860, 56},
+    {3850, 55}, {3840, 54}, {3830, 53}, {3820, 52}, {3800, 51}, {3790, 50},
+    {3780, 49}, {3770, 48}, {3760, 47}, {3750, 46}, {3740, 45}, {3730, 44},
+    {3720, 43}, {3710, 41}, {3700, 40}, {3700, 39}, {3690, 38}, {3690, 37},
+    {3680, 36}, {3680, 35}, {3670, 34}, {3660, 33}, {3650, 32}, {3650, 31},
+    {3640, 30}, {3630, 29}, {3620, 28}, {3620, 27}, {3620, 26}, {3610, 24},
+    {3600, 23}, {3590, 22}, {3570, 21}, {3560, 20}, {3540, 19}, {3530, 18},
+    {3510, 17}, {3510, 16}, {3500, 15}, {3490, 14}, {3480, 13}, {3470, 12},
+    {3450, 11}, {3400, 10}, {3340, 9}, {3330, 7}, {3310, 6}, {3290, 5},
+    {3260, 4}, {3240, 3}, {3210, 2}, {3160, 1}, {3100, 0},
+};
+#else
+#error "no battery profile, build with eg. -DBATT_2000MAH"
+#endif
+
+static const int numCapacityEntries =
+    sizeof(capacityTable) / sizeof(capacityTable[0]);
+
+// Average of the readings of earlier wakes, kept in RTC memory.
+struct BatteryAverage {
+    uint32_t magic;
+    uint32_t value;  // millivolts << BATTERY_EMA_FRACTION
+};
+
+RTC_DATA_ATTR static BatteryAverage average;
+
+/**
+  Read the battery voltage from BATTERY_SAMPLES samples of the ADC and fold
+  it into the average across wakes.
+
+  @returns the averaged battery voltage in millivolts.
+*/
+uint16_t batteryRead() {
+    uint16_t samples[BATTERY_SAMPLES];
+    for (int i = 0; i < BATTERY_SAMPLES; i++) {
+        samples[i] = board.readBattery() * 1000 + 0.5;
+    }
+    return batteryFilter(samples, BATTERY_SAMPLES);
+}
+
+/**
+  Fold samples of the battery voltage into the average across wakes.
+
+  @param samples the samples in millivolts, sorted in place.
+  @param count the number of samples, more than 2 * BATTERY_TRIM.
+  @returns the averaged battery voltage in millivolts.
+*/
+uint16_t batteryFilter(uint16_t* samples, int count) {
+    // Insertion sort, there are only a handful.
+    for (int i = 1; i < count; i++) {
+        uint16_t s = samples[i];
+        int j = i;
+        for (; j > 0 && samples[j - 1] > s; j--) samples[j] = samples[j - 1];
+        samples[j] = s;
+    }
+    uint32_t sum = 0;
+    for (int i = BATTERY_TRIM; i < count - BATTERY_TRIM; i++) sum += samples[i];
+    uint32_t kept = count - 2 * BATTERY_TRIM;
+    uint32_t reading = ((sum << BATTERY_EMA_FRACTION) + kept / 2) / kept;
+
+    uint32_t resetDelta = BATTERY_EMA_RESET_MV << BATTERY_EMA_FRACTION;
+    if (average.magic != BATTERY_FILTER_MAGIC ||
+        reading > average.value + resetDelta ||
+        reading + resetDelta < average.value) {
+        average.magic = BATTERY_FILTER_MAGIC;
+        average.value = reading;
+    } else {
+        // Signed, as the reading may be below the average.
+        int32_t delta = (int32_t)(reading - average.value);
+        average.value += delta / (1 << BATTERY_EMA_SHIFT);
+    }
+    return (average.value + (1 << (BATTERY_EMA_FRACTION - 1))) >>
+           BATTERY_EMA_FRACTION;
+}
+
+/**
+  Look up the charge left at a battery voltage, interpolating between the
+  points of the discharge profile.
+
+  @param millivolts the battery voltage.
+  @returns the charge left as a percentage.
+*/
+int batteryCapacity(uint16_t millivolts) {
+    if (millivolts >= capacityTable[0].millivolts) {
+        return capacityTable[0].percent;
+    }
+    // The first point at or below the voltage; the one before it is above.
+    int lo = 1, hi = numCapacityEntries;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (capacityTable[mid].millivolts <= millivolts) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if (lo == numCapacityEntries) return 0;
+
+    const BatteryPoint* below = &capacityTable[lo];
+    const BatteryPoint* above = &capacityTable[lo - 1];
+    uint32_t span = above->millivolts - below->millivolts;
+    uint32_t gained = (millivolts - below->millivolts) *
+                      (above->percent - below->percent);
+    return below->percent + (gained + span / 2) / span;
+}
@@ -0,0 +1,45 @@
+#ifndef BATTERYMODEL_H
+#define BATTERYMODEL_H
+#include <Arduino.h>
+
+// Battery charge from its voltage. A reading averages several ADC samples,
+// dropping the outliers, and is then smoothed across wakes by a moving
+// average in RTC memory so that decisions on the charge, eg. the near-empty
+// cutoff, do not flap with the noise of a single sample.
+
+// ADC samples taken per reading.
+#define BATTERY_SAMPLES 5
+// Samples dropped at each end of the sorted samples as outliers.
+#define BATTERY_TRIM 1
+// Weight of a new reading in the average across wakes, as a shift: 1/4.
+#define BATTERY_EMA_SHIFT 2
+// A reading this far from the average, eg. after charging, restarts it.
+#define BATTERY_EMA_RESET_MV 100
+
+/**
+  Read the battery voltage from BATTERY_SAMPLES samples of the ADC and fold
+  it into the average across wakes.
+
+  @returns the averaged battery voltage in millivolts.
+*/
+uint16_t batteryRead();
+
+/**
+  Fold samples of the battery voltage into the average across wakes.
+
+  @param samples the samples in millivolts, sorted in place.
+  @param count the number of samples, more than 2 * BATTERY_TRIM.
+  @returns the averaged battery voltage in millivolts.
+*/
+uint16_t batteryFilter(uint16_t* samples, int count);
+
+/**
+  Look up the charge left at a battery voltage, interpolating between the
+  points of the discharge profile.
+
+  @param millivolts the battery voltage.
+  @returns the charge left as a percentage.
+*/
+int batteryCapacity(uint16_t millivolts);
+
+#endif
@@ -3,7 +3,13 @@
 
 // Assign config values.
 const char* calendarUrl = "http://localhost:8080/calendar.png";
-const char* calendarDailyRefreshTime = "09:00:00";
+// When to refresh, eg. "07:00 Mon-Fri; 12:30 Mon-Fri 40%; 09:00 Sat,Sun" for
+// two refreshes on weekdays, the second only above 40% battery, and one at
+// weekends. See schedule.h.
+const char* calendarSchedule = "09:00:00";
+// How PNG calendars with photos or gradients are dithered to the panel's 8
+// gray levels: none, floyd-steinberg or atkinson. See dither.h.
+const char* calendarDither = "none";
 const int calendarRetries = 3;  // number of times to retry draw/download
 
 // Wifi config.
@@ -15,14 +21,17 @@ const int wifiRetries = 6;  // number of times to retry WiFi connection
 const char* ntpHost =
     "pool.ntp.org";  // the time server host (keep as pool.ntp.org if in doubt)
 const char* ntpTimezone = "Europe/Dublin";
+const int ntpSyncTolerance = 10;  // seconds the clock may be off before NTP
 
-// Remote logging config.
-bool mqttLoggerEnabled =
+// Remote logging config, needs the HAS_MQTT build flag.
+constexpr bool mqttLoggerEnabled =
     false;  // set to true for remote logging to a MQTT broker
 const char* mqttLoggerBroker = "localhost";  // the broker host
 const int mqttLoggerPort = 1883;
 const char* mqttLoggerClientID = "inkplate10-weather-client";
 const char* mqttLoggerTopic = "mqtt/inkplate10-weather-client";
 const int mqttLoggerRetries = 3;  // number of times to retry MQTT connection
+constexpr bool mqttLoggerTelemetry =
+    false;  // set to true to publish one binary packet per wake instead
 
 #endif
\ No newline at end of file
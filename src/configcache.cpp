@@ -0,0 +1,135 @@
+#include "configcache.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+// Marks a record written by configCacheSave(), "CFGC".
+#define CONFIG_CACHE_MAGIC 0x43464743
+// Size of the reads when taking the CRC of the config file.
+#define CONFIG_CACHE_READ_CHUNK 256
+
+// Identifies one version of the config file.
+struct ConfigFileKey {
+    uint32_t size;
+    uint32_t modified;  // FAT modify date in the high half, time in the low
+    uint32_t crc;
+};
+
+// The record kept in NVS.
+struct ConfigRecord {
+    uint32_t magic;
+    uint32_t version;
+    ConfigFileKey key;
+    DeviceConfig config;
+    uint32_t crc;  // of everything before it
+};
+
+/**
+  Get the size and modify time of the file, which are in its directory entry
+  so nothing is read from the file itself.
+*/
+static void statFile(File& file, ConfigFileKey* key) {
+    uint16_t date = 0;
+    uint16_t time = 0;
+    file.getModifyDateTime(&date, &time);
+    key->size = file.size();
+    key->modified = (uint32_t)date << 16 | time;
+}
+
+/**
+  Take the CRC of the whole file, leaving it at the start.
+*/
+static esp_err_t crcFile(File& file, uint32_t* crc) {
+    uint8_t buf[CONFIG_CACHE_READ_CHUNK];
+    uint32_t c = 0;
+    int n;
+
+    file.seek(0);
+    while ((n = file.read(buf, sizeof(buf))) > 0) c = crc32_le(c, buf, n);
+    file.seek(0);
+    if (n < 0) return ESP_FAIL;
+    *crc = c;
+    return ESP_OK;
+}
+
+/**
+  Seal the record with its CRC and write it to NVS.
+*/
+static esp_err_t writeRecord(ConfigRecord* record) {
+    record->crc = crc32_le(0, (const uint8_t*)record,
+                           offsetof(ConfigRecord, crc));
+
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_CACHE_NAMESPACE, false)) return ESP_FAIL;
+    size_t n = prefs.putBytes(CONFIG_CACHE_KEY, record, sizeof(*record));
+    prefs.end();
+    return n == sizeof(*record) ? ESP_OK : ESP_FAIL;
+}
+
+/**
+  Read the configuration cached for a config file.
+
+  @param file the open config file, left at the start.
+  @param config filled with the cached configuration.
+  @returns the esp_err_t code:
+  - ESP_OK if the cached configuration is of this file.
+  - ESP_ERR_NOT_FOUND if none is cached, or it is of an older layout.
+  - ESP_ERR_INVALID_CRC if the cached record is corrupt.
+  - ESP_ERR_INVALID_STATE if the file has changed since it was cached.
+*/
+esp_err_t configCacheLoad(File& file, DeviceConfig* config) {
+    ConfigRecord record;
+    Preferences prefs;
+    // Opening read-only fails if the namespace was never written.
+    if (!prefs.begin(CONFIG_CACHE_NAMESPACE, true)) return ESP_ERR_NOT_FOUND;
+    size_t n = prefs.getBytes(CONFIG_CACHE_KEY, &record, sizeof(record));
+    prefs.end();
+
+    if (n != sizeof(record) || record.magic != CONFIG_CACHE_MAGIC ||
+        record.version != CONFIG_CACHE_VERSION) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (crc32_le(0, (const uint8_t*)&record, offsetof(ConfigRecord, crc)) !=
+        record.crc) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    ConfigFileKey key;
+    statFile(file, &key);
+    if (key.size != record.key.size) return ESP_ERR_INVALID_STATE;
+    if (key.modified != record.key.modified) {
+        // Touched but maybe not changed, eg. copied back onto the card.
+        if (crcFile(file, &key.crc) != ESP_OK || key.crc != record.key.crc) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        // Keep the new time so the next wake need not read the file.
+        record.key = key;
+        if (writeRecord(&record) != ESP_OK) {
+            log(LOG_WARNING, "failed to update cached config");
+        }
+    }
+
+    memcpy(config, &record.config, sizeof(*config));
+    return ESP_OK;
+}
+
+/**
+  Cache the configuration parsed from a config file.
+
+  @param file the open config file, left at the start.
+  @param config the configuration parsed from the file.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_FAIL if the file cannot be read or the record cannot be written to
+  NVS.
+*/
+esp_err_t configCacheSave(File& file, const DeviceConfig* config) {
+    ConfigRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = CONFIG_CACHE_MAGIC;
+    record.version = CONFIG_CACHE_VERSION;
+    statFile(file, &record.key);
+    if (crcFile(file, &record.key.crc) != ESP_OK) return ESP_FAIL;
+    memcpy(&record.config, config, sizeof(*config));
+    return writeRecord(&record);
+}
@@ -0,0 +1,80 @@
+#ifndef CONFIGCACHE_H
+#define CONFIGCACHE_H
+#include <Arduino.h>
+#include <SdFat.h>
+
+#include "logger.h"
+#include "tz.h"
+
+// Keeps the configuration parsed from the YAML file on SD card in NVS as one
+// flat record, so later wakes read it back instead of parsing the file. The
+// record is keyed by the file's size, modify time and CRC: if the size and
+// time match the file is not read at all, and if only the time changed the
+// file is read and its CRC compared before it is parsed again.
+
+// Bump when DeviceConfig changes so a record of an older layout is ignored.
+#define CONFIG_CACHE_VERSION 3
+// NVS namespace and key the record is kept under.
+#define CONFIG_CACHE_NAMESPACE "config"
+#define CONFIG_CACHE_KEY "yaml"
+
+// Longest values, including the terminator.
+#define CONFIG_URL_MAX 192
+#define CONFIG_SCHEDULE_MAX 128
+#define CONFIG_DITHER_MAX 16
+#define CONFIG_SSID_MAX 33
+#define CONFIG_PASS_MAX 65
+#define CONFIG_HOST_MAX 64
+#define CONFIG_CLIENT_ID_MAX 64
+
+// The settings read from the config file. Strings missing from the file are
+// empty.
+struct DeviceConfig {
+    char calendarUrl[CONFIG_URL_MAX];
+    char calendarSchedule[CONFIG_SCHEDULE_MAX];
+    char calendarDither[CONFIG_DITHER_MAX];
+    int32_t calendarRetries;
+
+    char wifiSSID[CONFIG_SSID_MAX];
+    char wifiPass[CONFIG_PASS_MAX];
+    int32_t wifiRetries;
+
+    char ntpHost[CONFIG_HOST_MAX];
+    char ntpTimezone[TZ_POSIX_MAX];  // a name or a POSIX TZ rule
+    int32_t ntpSyncTolerance;
+
+    bool mqttLoggerEnabled;
+    char mqttLoggerBroker[CONFIG_HOST_MAX];
+    int32_t mqttLoggerPort;
+    char mqttLoggerClientID[CONFIG_CLIENT_ID_MAX];
+    char mqttLoggerTopic[LOG_TOPIC_MAX];
+    int32_t mqttLoggerRetries;
+    bool mqttLoggerTelemetry;
+};
+
+/**
+  Read the configuration cached for a config file.
+
+  @param file the open config file, left at the start.
+  @param config filled with the cached configuration.
+  @returns the esp_err_t code:
+  - ESP_OK if the cached configuration is of this file.
+  - ESP_ERR_NOT_FOUND if none is cached, or it is of an older layout.
+  - ESP_ERR_INVALID_CRC if the cached record is corrupt.
+  - ESP_ERR_INVALID_STATE if the file has changed since it was cached.
+*/
+esp_err_t configCacheLoad(File& file, DeviceConfig* config);
+
+/**
+  Cache the configuration parsed from a config file.
+
+  @param file the open config file, left at the start.
+  @param config the configuration parsed from the file.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_FAIL if the file cannot be read or the record cannot be written to
+  NVS.
+*/
+esp_err_t configCacheSave(File& file, const DeviceConfig* config);
+
+#endif
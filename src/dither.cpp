@@ -0,0 +1,162 @@
+#include "dither.h"
+
+#include "framebuffer.h"
+
+// Offset of a value into the quantisation table. A pixel with the error
+// diffused into it is at most about half a level step outside 0-255, since
+// each pixel passes on no more than its own error, but the table allows a
+// full 256 either way.
+#define DITHER_LUT_OFFSET 256
+#define DITHER_LUT_SIZE (3 * 256)
+
+// For each value from -256 to 511, the nearest gray level in the low 3 bits
+// and the value less the level's gray above them, so quantising a pixel is
+// one lookup.
+static int16_t quantise[DITHER_LUT_SIZE];
+static bool tableBuilt = false;
+
+static void buildTable() {
+    const int top = FRAMEBUFFER_LEVELS - 1;
+    for (int i = 0; i < DITHER_LUT_SIZE; i++) {
+        int v = i - DITHER_LUT_OFFSET;
+        int level = v <= 0 ? 0 : v >= 255 ? top : (v * top + 127) / 255;
+        int error = v - level * 255 / top;
+        quantise[i] = error * 8 | level;
+    }
+    tableBuilt = true;
+}
+
+/**
+  Floyd-Steinberg: the errors are in 16ths. below[x] holds the error for
+  pixel x of this row until it is read, then that for pixel x of the next
+  row, and below[-1] is scratch.
+*/
+static void ditherFloydSteinberg(int16_t* below, const uint8_t* gray,
+                                 uint8_t* levels, int width) {
+    int right = 0;  // for the next pixel
+    int left = 0;   // for the pixel below the last, less this one's share
+    int diag = 0;   // for the pixel below the next, less the next one's
+    for (int x = 0; x < width; x++) {
+        int q = quantise[gray[x] + ((below[x] + right + 8) >> 4) +
+                         DITHER_LUT_OFFSET];
+        int e = q >> 3;
+        levels[x] = q & 7;
+        below[x - 1] = left + 3 * e;
+        left = 5 * e + diag;
+        diag = e;
+        right = 7 * e;
+    }
+    below[width - 1] = left;
+}
+
+/**
+  Atkinson: the errors are in 8ths. below[] is as for Floyd-Steinberg, and
+  below2[x] holds the error for pixel x of the row after the next until it
+  is moved to below[x].
+*/
+static void ditherAtkinson(int16_t* below, int16_t* below2,
+                           const uint8_t* gray, uint8_t* levels, int width) {
+    int right = 0, right2 = 0;  // for the next two pixels
+    int left = 0, diag = 0;     // as for Floyd-Steinberg
+    for (int x = 0; x < width; x++) {
+        int q = quantise[gray[x] + ((below[x] + right + 4) >> 3) +
+                         DITHER_LUT_OFFSET];
+        int e = q >> 3;
+        levels[x] = q & 7;
+        below[x - 1] = left + e;
+        left = below2[x] + e + diag;
+        below2[x] = e;
+        diag = e;
+        right = right2 + e;
+        right2 = e;
+    }
+    below[width - 1] = left;
+}
+
+/**
+  Parse the name of a dithering kernel.
+
+  @param name none, floyd-steinberg or atkinson.
+  @param kernel set to the kernel, eg. DITHER_ATKINSON.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the name is unknown.
+*/
+esp_err_t ditherParse(const char* name, uint8_t* kernel) {
+    if (strcmp(name, "none") == 0) {
+        *kernel = DITHER_NONE;
+    } else if (strcmp(name, "floyd-steinberg") == 0) {
+        *kernel = DITHER_FLOYD_STEINBERG;
+    } else if (strcmp(name, "atkinson") == 0) {
+        *kernel = DITHER_ATKINSON;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+  Start dithering an image.
+
+  @param dither the state to set up.
+  @param kernel the kernel, eg. DITHER_FLOYD_STEINBERG.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the error buffers cannot be allocated.
+*/
+esp_err_t ditherBegin(Dither* dither, uint8_t kernel) {
+    dither->kernel = kernel;
+    dither->below = NULL;
+    dither->below2 = NULL;
+    if (kernel == DITHER_NONE) return ESP_OK;
+
+    if (!tableBuilt) buildTable();
+    // One more than a row, for below[-1].
+    dither->below = (int16_t*)calloc(DITHER_MAX_WIDTH + 1, sizeof(int16_t));
+    if (kernel == DITHER_ATKINSON) {
+        dither->below2 = (int16_t*)calloc(DITHER_MAX_WIDTH, sizeof(int16_t));
+    }
+    if (dither->below == NULL ||
+        (kernel == DITHER_ATKINSON && dither->below2 == NULL)) {
+        ditherEnd(dither);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+  Quantise the next row of the image to gray levels.
+
+  @param dither the image's state.
+  @param gray the row as 8-bit gray, 0 black to 255 white.
+  @param levels filled with the row as gray levels, 0 black to 7 white.
+  @param width the number of pixels, at most DITHER_MAX_WIDTH.
+*/
+void ditherRow(Dither* dither, const uint8_t* gray, uint8_t* levels,
+               int width) {
+    switch (dither->kernel) {
+        case DITHER_FLOYD_STEINBERG:
+            ditherFloydSteinberg(dither->below + 1, gray, levels, width);
+            break;
+        case DITHER_ATKINSON:
+            ditherAtkinson(dither->below + 1, dither->below2, gray, levels,
+                           width);
+            break;
+        default:
+            for (int x = 0; x < width; x++) levels[x] = gray[x] >> 5;
+            break;
+    }
+}
+
+/**
+  Free the state of an image.
+
+  @param dither the image's state.
+*/
+void ditherEnd(Dither* dither) {
+    free(dither->below);
+    free(dither->below2);
+    dither->below = NULL;
+    dither->below2 = NULL;
+    dither->kernel = DITHER_NONE;
+}
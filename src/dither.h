@@ -0,0 +1,74 @@
+#ifndef DITHER_H
+#define DITHER_H
+#include <Inkplate.h>
+
+// Error diffusion of 8-bit gray down to the panel's 8 gray levels, a row at
+// a time as the PNG decoder hands them over, so photos and maps do not band.
+// Each pixel is quantised through a lookup table and its error spread over
+// the pixels not yet drawn:
+//
+//   Floyd-Steinberg        Atkinson
+//         *  7                  *  1  1
+//      3  5  1   / 16        1  1  1      / 8
+//                               1
+//
+// Errors are integers, carried to the right in a register and down in one
+// row buffer, two for Atkinson which reaches two rows down. Atkinson spreads
+// only 6/8 of the error, which keeps more contrast on e-ink.
+
+// Error diffusion kernels.
+#define DITHER_NONE 0
+#define DITHER_FLOYD_STEINBERG 1
+#define DITHER_ATKINSON 2
+
+// Widest row that can be dithered.
+#define DITHER_MAX_WIDTH E_INK_WIDTH
+
+// State of an image being dithered.
+struct Dither {
+    uint8_t kernel;
+    int16_t* below;   // error for the next row, scaled by the kernel divisor
+    int16_t* below2;  // Atkinson only: error for the row after
+};
+
+/**
+  Parse the name of a dithering kernel.
+
+  @param name none, floyd-steinberg or atkinson.
+  @param kernel set to the kernel, eg. DITHER_ATKINSON.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the name is unknown.
+*/
+esp_err_t ditherParse(const char* name, uint8_t* kernel);
+
+/**
+  Start dithering an image.
+
+  @param dither the state to set up.
+  @param kernel the kernel, eg. DITHER_FLOYD_STEINBERG.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the error buffers cannot be allocated.
+*/
+esp_err_t ditherBegin(Dither* dither, uint8_t kernel);
+
+/**
+  Quantise the next row of the image to gray levels.
+
+  @param dither the image's state.
+  @param gray the row as 8-bit gray, 0 black to 255 white.
+  @param levels filled with the row as gray levels, 0 black to 7 white.
+  @param width the number of pixels, at most DITHER_MAX_WIDTH.
+*/
+void ditherRow(Dither* dither, const uint8_t* gray, uint8_t* levels,
+               int width);
+
+/**
+  Free the state of an image.
+
+  @param dither the image's state.
+*/
+void ditherEnd(Dither* dither);
+
+#endif
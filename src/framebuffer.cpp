@@ -0,0 +1,122 @@
+#include "framebuffer.h"
+
+#include "inkrle.h"
+#include "lib.h"
+
+static inline void putLevel(int px, int py, uint8_t level) {
+    uint8_t* p = board.DMemory4Bit + (E_INK_WIDTH / 2) * py + (px >> 1);
+    *p = (px & 1) ? (*p & 0xf0) | level : (*p & 0x0f) | (level << 4);
+}
+
+/**
+  Write a run of pixels straight into the 3-bit display buffer. Coordinates
+  are in the board's current rotation, as for board.drawPixel(), and pixels
+  falling outside the display are clipped.
+
+  @param x the x coordinate of the first pixel.
+  @param y the row.
+  @param levels the pixels as gray levels, 0 (black) to 7 (white).
+  @param w the number of pixels.
+*/
+void framebufferWriteRow(int x, int y, const uint8_t* levels, int w) {
+    int width = board.width();
+    if (y < 0 || y >= board.height() || x >= width) return;
+    if (x < 0) {
+        levels -= x;
+        w += x;
+        x = 0;
+    }
+    if (x + w > width) w = width - x;
+
+    // Map the logical row onto the panel; see Inkplate::writePixel().
+    switch (board.getRotation()) {
+        case 0:
+            for (int i = 0; i < w; i++) putLevel(x + i, y, levels[i] & 7);
+            break;
+        case 1:
+            for (int i = 0; i < w; i++) {
+                putLevel(E_INK_WIDTH - 1 - y, x + i, levels[i] & 7);
+            }
+            break;
+        case 2:
+            for (int i = 0; i < w; i++) {
+                putLevel(E_INK_WIDTH - 1 - x - i, E_INK_HEIGHT - 1 - y,
+                         levels[i] & 7);
+            }
+            break;
+        case 3:
+            for (int i = 0; i < w; i++) {
+                putLevel(y, E_INK_HEIGHT - 1 - x - i, levels[i] & 7);
+            }
+            break;
+    }
+}
+
+/**
+  Parse the header of a .ink image.
+
+  @param buf the first INK_HEADER_SIZE bytes of the image.
+  @param header the parsed header.
+  @returns true if buf starts with the .ink magic.
+*/
+bool inkParseHeader(const uint8_t* buf, InkHeader* header) {
+    if (memcmp(buf, INK_MAGIC, 4) != 0) return false;
+
+    header->version = buf[4];
+    header->rotation = buf[5];
+    header->encoding = buf[6];
+    header->width = buf[8] | buf[9] << 8;
+    header->height = buf[10] | buf[11] << 8;
+    header->size =
+        buf[12] | buf[13] << 8 | buf[14] << 16 | (uint32_t)buf[15] << 24;
+    return true;
+}
+
+/**
+  Copy or decode a .ink image payload straight into the 3-bit display buffer.
+
+  @param header the image's header.
+  @param read the input to pull the payload from.
+  @param ctx the context passed to read.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_SUPPORTED if the image is for another version, encoding,
+  panel or rotation.
+  - ESP_ERR_INVALID_SIZE if the payload ends early.
+  - ESP_ERR_INVALID_RESPONSE if the payload is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t framebufferLoadInk(const InkHeader* header, PngReadFn read,
+                             void* ctx) {
+    if (header->version != INK_VERSION || header->width != E_INK_WIDTH ||
+        header->height != E_INK_HEIGHT ||
+        header->rotation != board.getRotation()) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->encoding == INK_ENCODING_RLE) {
+        uint32_t bytesIn;
+        esp_err_t err = inkRleDecode(read, ctx, board.DMemory4Bit,
+                                     E_INK_WIDTH, E_INK_HEIGHT, &bytesIn);
+        if (err == ESP_OK && bytesIn != header->size) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        return err;
+    }
+    if (header->encoding != INK_ENCODING_RAW ||
+        header->size != FRAMEBUFFER_SIZE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Read straight into display memory, no intermediate buffer.
+    uint32_t filled = 0;
+    while (filled < FRAMEBUFFER_SIZE) {
+        int n =
+            read(ctx, board.DMemory4Bit + filled, FRAMEBUFFER_SIZE - filled);
+        if (n < 0) return ESP_ERR_TIMEOUT;
+        if (n == 0) return ESP_ERR_INVALID_SIZE;
+        filled += n;
+    }
+
+    return ESP_OK;
+}
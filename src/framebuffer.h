@@ -0,0 +1,70 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+#include <Inkplate.h>
+
+#include "png.h"
+
+// Number of gray levels in INKPLATE_3BIT mode.
+#define FRAMEBUFFER_LEVELS 8
+// Size of the 3-bit framebuffer: two pixels per byte, even x in the high
+// nibble, rows of E_INK_WIDTH pixels in the panel's native orientation.
+#define FRAMEBUFFER_SIZE (E_INK_WIDTH * E_INK_HEIGHT / 2)
+
+// The .ink image format: a header followed by the 3-bit framebuffer, either
+// as FRAMEBUFFER_SIZE bytes laid out exactly as in memory, so it can be
+// copied in without decoding, or run-length coded (see inkrle.h).
+#define INK_MAGIC "INK3"
+#define INK_VERSION 1
+#define INK_HEADER_SIZE 16
+#define INK_ENCODING_RAW 0
+#define INK_ENCODING_RLE 1
+
+// Header of a .ink image. Multi-byte fields are little-endian on the wire.
+struct InkHeader {
+    uint8_t version;
+    uint8_t rotation;  // board rotation the server laid the pixels out for
+    uint8_t encoding;  // INK_ENCODING_RAW or INK_ENCODING_RLE
+    uint16_t width;    // panel width, E_INK_WIDTH
+    uint16_t height;   // panel height, E_INK_HEIGHT
+    uint32_t size;     // payload bytes following the header
+};
+
+/**
+  Write a run of pixels straight into the 3-bit display buffer. Coordinates
+  are in the board's current rotation, as for board.drawPixel(), and pixels
+  falling outside the display are clipped.
+
+  @param x the x coordinate of the first pixel.
+  @param y the row.
+  @param levels the pixels as gray levels, 0 (black) to 7 (white).
+  @param w the number of pixels.
+*/
+void framebufferWriteRow(int x, int y, const uint8_t* levels, int w);
+
+/**
+  Parse the header of a .ink image.
+
+  @param buf the first INK_HEADER_SIZE bytes of the image.
+  @param header the parsed header.
+  @returns true if buf starts with the .ink magic.
+*/
+bool inkParseHeader(const uint8_t* buf, InkHeader* header);
+
+/**
+  Copy or decode a .ink image payload straight into the 3-bit display buffer.
+
+  @param header the image's header.
+  @param read the input to pull the payload from.
+  @param ctx the context passed to read.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_SUPPORTED if the image is for another version, encoding,
+  panel or rotation.
+  - ESP_ERR_INVALID_SIZE if the payload ends early.
+  - ESP_ERR_INVALID_RESPONSE if the payload is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t framebufferLoadInk(const InkHeader* header, PngReadFn read,
+                             void* ctx);
+
+#endif
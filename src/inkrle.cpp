@@ -0,0 +1,308 @@
+#include "inkrle.h"
+
+// Decoder input, kept on inkRleDecode()'s stack.
+struct RleInput {
+    PngReadFn read;
+    void* ctx;
+    uint8_t buf[INKRLE_INPUT_CHUNK];
+    size_t pos;
+    size_t len;
+    uint32_t total;
+    esp_err_t err;
+};
+
+// Encoder output; stops writing, but keeps counting, once full.
+struct RleOutput {
+    uint8_t* buf;
+    size_t size;
+    size_t len;
+};
+
+// Shortest run or copy worth a token of its own rather than literals.
+#define INKRLE_MIN_MATCH 3
+
+/**
+  Next input byte, or -1 at end of input or on error (see in->err).
+*/
+static inline int nextByte(RleInput* in) {
+    if (in->pos == in->len) {
+        int n = in->read(in->ctx, in->buf, sizeof(in->buf));
+        if (n <= 0) {
+            in->err = n < 0 ? ESP_ERR_TIMEOUT : ESP_ERR_INVALID_SIZE;
+            return -1;
+        }
+        in->pos = 0;
+        in->len = n;
+        in->total += n;
+    }
+    return in->buf[in->pos++];
+}
+
+/**
+  Read the varint extending a run or copy length.
+*/
+static bool readVarint(RleInput* in, uint32_t* value) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        int b = nextByte(in);
+        if (b < 0) return false;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    in->err = ESP_ERR_INVALID_RESPONSE;
+    return false;
+}
+
+static inline void putLevel(uint8_t* fb, uint32_t p, uint8_t level) {
+    uint8_t* b = fb + (p >> 1);
+    *b = (p & 1) ? (*b & 0xf0) | level : (*b & 0x0f) | (level << 4);
+}
+
+static inline uint8_t getLevel(const uint8_t* fb, uint32_t p) {
+    uint8_t b = fb[p >> 1];
+    return (p & 1) ? b & 0x0f : b >> 4;
+}
+
+static void fillRun(uint8_t* fb, uint32_t p, uint32_t len, uint8_t level) {
+    if (p & 1) {
+        putLevel(fb, p++, level);
+        len--;
+    }
+    memset(fb + (p >> 1), level << 4 | level, len >> 1);
+    if (len & 1) putLevel(fb, p + len - 1, level);
+}
+
+static void copyAbove(uint8_t* fb, uint32_t p, uint32_t len, int width) {
+    if (p & 1) {
+        putLevel(fb, p, getLevel(fb, p - width));
+        p++;
+        len--;
+    }
+    // Rows are an even number of pixels, so source and destination share
+    // alignment. Copy at most a row at a time as a span can overlap itself.
+    uint32_t bytes = len >> 1;
+    uint8_t* dst = fb + (p >> 1);
+    while (bytes > 0) {
+        uint32_t n = min(bytes, (uint32_t)width / 2);
+        memcpy(dst, dst - width / 2, n);
+        dst += n;
+        bytes -= n;
+    }
+    if (len & 1) {
+        uint32_t last = p + len - 1;
+        putLevel(fb, last, getLevel(fb, last - width));
+    }
+}
+
+static bool readLiteral(RleInput* in, uint8_t* fb, uint32_t p,
+                        uint32_t len) {
+    if (p & 1) {
+        // Packed pixels straddle framebuffer bytes; shift them in one by one.
+        for (uint32_t i = 0; i < len; i += 2) {
+            int b = nextByte(in);
+            if (b < 0) return false;
+            putLevel(fb, p + i, (b >> 4) & 7);
+            if (i + 1 < len) putLevel(fb, p + i + 1, b & 7);
+        }
+        return true;
+    }
+
+    uint8_t* dst = fb + (p >> 1);
+    uint32_t bytes = len >> 1;
+    while (bytes > 0) {
+        if (in->pos == in->len) {
+            int b = nextByte(in);
+            if (b < 0) return false;
+            *dst++ = b & 0x77;
+            bytes--;
+            continue;
+        }
+        uint32_t n = min(bytes, (uint32_t)(in->len - in->pos));
+        for (uint32_t i = 0; i < n; i++) {
+            dst[i] = in->buf[in->pos + i] & 0x77;
+        }
+        in->pos += n;
+        dst += n;
+        bytes -= n;
+    }
+    if (len & 1) {
+        int b = nextByte(in);
+        if (b < 0) return false;
+        putLevel(fb, p + len - 1, (b >> 4) & 7);
+    }
+    return true;
+}
+
+static inline void emit(RleOutput* out, uint8_t b) {
+    if (out->len < out->size) out->buf[out->len] = b;
+    out->len++;
+}
+
+/**
+  Write a run or copy token, extending its length with a varint if needed.
+*/
+static void emitSpan(RleOutput* out, uint8_t token, uint32_t len,
+                     uint32_t max) {
+    if (len < max) {
+        emit(out, token | (len - 1));
+        return;
+    }
+    emit(out, token | (max - 1));
+    len -= max;
+    while (len >= 0x80) {
+        emit(out, (len & 0x7f) | 0x80);
+        len >>= 7;
+    }
+    emit(out, len);
+}
+
+static void emitLiterals(RleOutput* out, const uint8_t* fb, uint32_t p,
+                         uint32_t end) {
+    while (p < end) {
+        uint32_t count = min(end - p, (uint32_t)INKRLE_SPAN_MAX);
+        emit(out, INKRLE_LITERAL | (count - 1));
+        for (uint32_t i = 0; i < count; i += 2) {
+            uint8_t lo = i + 1 < count ? getLevel(fb, p + i + 1) : 0;
+            emit(out, getLevel(fb, p + i) << 4 | lo);
+        }
+        p += count;
+    }
+}
+
+/**
+  Run-length code a 3-bit framebuffer, the inverse of inkRleDecode().
+
+  @param framebuffer the framebuffer to code, rows of width pixels packed two
+  per byte with the even pixel in the high nibble.
+  @param width the number of pixels per row.
+  @param height the number of rows.
+  @param out the buffer to write the coded image to.
+  @param size the size of out.
+  @param bytesOut the number of coded bytes written.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_SIZE if the coded image does not fit in out.
+*/
+esp_err_t inkRleEncode(const uint8_t* framebuffer, int width, int height,
+                       uint8_t* out, size_t size, uint32_t* bytesOut) {
+    RleOutput rle = {out, size, 0};
+    const uint32_t pixels = (uint32_t)width * height;
+    uint32_t literalStart = 0;
+    uint32_t p = 0;
+
+    // Greedy, as ink.py's encode(): take the longer of a run and a copy of
+    // the row above, or leave the pixel to a literal span.
+    while (p < pixels && rle.len <= size) {
+        uint8_t level = getLevel(framebuffer, p);
+        uint32_t run = 1;
+        while (p + run < pixels && getLevel(framebuffer, p + run) == level) {
+            run++;
+        }
+        uint32_t copy = 0;
+        if (p >= (uint32_t)width) {
+            while (p + copy < pixels &&
+                   getLevel(framebuffer, p + copy) ==
+                       getLevel(framebuffer, p + copy - width)) {
+                copy++;
+            }
+        }
+
+        if (max(run, copy) < INKRLE_MIN_MATCH) {
+            p++;
+            continue;
+        }
+
+        emitLiterals(&rle, framebuffer, literalStart, p);
+        if (copy >= run) {
+            emitSpan(&rle, INKRLE_COPY, copy, INKRLE_SPAN_MAX);
+            p += copy;
+        } else {
+            emitSpan(&rle, INKRLE_RUN | level << 4, run, INKRLE_RUN_MAX);
+            p += run;
+        }
+        literalStart = p;
+    }
+    emitLiterals(&rle, framebuffer, literalStart, p);
+
+    *bytesOut = rle.len;
+    return rle.len <= size ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+/**
+  Decode a run-length coded image straight into a 3-bit framebuffer. Uses no
+  heap and no buffers beyond a small input chunk on the stack, so images can
+  be decoded from several tasks at once.
+
+  @param read the input to pull the encoded image from.
+  @param ctx the context passed to read.
+  @param framebuffer the framebuffer to fill, rows of width pixels packed two
+  per byte with the even pixel in the high nibble.
+  @param width the number of pixels per row.
+  @param height the number of rows.
+  @param bytesIn the number of encoded bytes consumed.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_SIZE if the input ends before the image is complete.
+  - ESP_ERR_INVALID_RESPONSE if the input is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t inkRleDecode(PngReadFn read, void* ctx, uint8_t* framebuffer,
+                       int width, int height, uint32_t* bytesIn) {
+    RleInput in;
+    in.read = read;
+    in.ctx = ctx;
+    in.pos = in.len = 0;
+    in.total = 0;
+    in.err = ESP_OK;
+
+    const uint32_t pixels = (uint32_t)width * height;
+    uint32_t p = 0;
+    bool ok = true;
+    while (ok && p < pixels) {
+        int token = nextByte(&in);
+        if (token < 0) break;
+
+        uint32_t len;
+        if (token & INKRLE_RUN) {
+            len = (token & 0x0f) + 1;
+            uint32_t extra = 0;
+            if (len == INKRLE_RUN_MAX && !readVarint(&in, &extra)) break;
+            len += extra;
+        } else {
+            len = (token & 0x3f) + 1;
+            uint32_t extra = 0;
+            if ((token & INKRLE_COPY) && len == INKRLE_SPAN_MAX &&
+                !readVarint(&in, &extra)) {
+                break;
+            }
+            len += extra;
+        }
+        if (len > pixels - p) {
+            in.err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+
+        if (token & INKRLE_RUN) {
+            fillRun(framebuffer, p, len, (token >> 4) & 7);
+        } else if (token & INKRLE_COPY) {
+            if (p < (uint32_t)width) {
+                in.err = ESP_ERR_INVALID_RESPONSE;
+                break;
+            }
+            copyAbove(framebuffer, p, len, width);
+        } else {
+            ok = readLiteral(&in, framebuffer, p, len);
+        }
+        p += len;
+    }
+
+    // Only count what was consumed, not what was read ahead.
+    *bytesIn = in.total - (in.len - in.pos);
+    if (p < pixels) {
+        return in.err != ESP_OK ? in.err : ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,66 @@
+#ifndef INKRLE_H
+#define INKRLE_H
+#include <Arduino.h>
+
+#include "png.h"
+
+// Size of the buffer encoded input is pulled into.
+#define INKRLE_INPUT_CHUNK 512
+
+// Run-length coding of a 3-bit framebuffer, tuned for calendars: long runs
+// of white, rows that repeat the one above (borders, banners, text spacing)
+// and short literal spans for anti-aliased text and icons. Pixels are coded
+// in framebuffer order, row by row. Each token starts with one byte:
+//
+//   1LLLNNNN  run of N+1 pixels of level L
+//   01NNNNNN  copy N+1 pixels from the row above
+//   00NNNNNN  N+1 literal pixels follow, packed two per byte, high nibble
+//             first
+//
+// A run or copy with all N bits set is followed by a LEB128 varint that is
+// added to its length.
+#define INKRLE_RUN 0x80
+#define INKRLE_COPY 0x40
+#define INKRLE_LITERAL 0x00
+#define INKRLE_RUN_MAX 16
+#define INKRLE_SPAN_MAX 64
+
+/**
+  Run-length code a 3-bit framebuffer, the inverse of inkRleDecode().
+
+  @param framebuffer the framebuffer to code, rows of width pixels packed two
+  per byte with the even pixel in the high nibble.
+  @param width the number of pixels per row.
+  @param height the number of rows.
+  @param out the buffer to write the coded image to.
+  @param size the size of out.
+  @param bytesOut the number of coded bytes written.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_SIZE if the coded image does not fit in out.
+*/
+esp_err_t inkRleEncode(const uint8_t* framebuffer, int width, int height,
+                       uint8_t* out, size_t size, uint32_t* bytesOut);
+
+/**
+  Decode a run-length coded image straight into a 3-bit framebuffer. Uses no
+  heap and no buffers beyond a small input chunk on the stack, so images can
+  be decoded from several tasks at once.
+
+  @param read the input to pull the encoded image from.
+  @param ctx the context passed to read.
+  @param framebuffer the framebuffer to fill, rows of width pixels packed two
+  per byte with the even pixel in the high nibble.
+  @param width the number of pixels per row.
+  @param height the number of rows.
+  @param bytesIn the number of encoded bytes consumed.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_SIZE if the input ends before the image is complete.
+  - ESP_ERR_INVALID_RESPONSE if the input is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t inkRleDecode(PngReadFn read, void* ctx, uint8_t* framebuffer,
+                       int width, int height, uint32_t* bytesIn);
+
+#endif
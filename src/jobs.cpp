@@ -0,0 +1,66 @@
+#include "jobs.h"
+
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include "lib.h"
+
+// A bit per job, set when it finishes. Never deleted: a job's task may
+// still be returning from setting its bit when the caller wakes.
+static EventGroupHandle_t jobsDone;
+
+// What a job's task needs.
+struct JobTask {
+    Job* job;
+    EventBits_t bit;
+};
+
+static void jobTask(void* param) {
+    JobTask* task = (JobTask*)param;
+    task->job->err = task->job->fn(task->job->ctx);
+    xEventGroupSetBits(jobsDone, task->bit);
+    vTaskDelete(NULL);
+}
+
+/**
+  Run jobs concurrently, each on its own task, and wait for all of them to
+  finish. A job whose task cannot be created runs on the calling task
+  instead. Jobs may log and profile, but must not share other state or
+  sleep.
+
+  @param jobs the jobs to run; their results are stored in them.
+  @param count the number of jobs.
+  @returns the esp_err_t code:
+  - ESP_OK if all jobs ran, whatever their results.
+  - ESP_ERR_INVALID_ARG if there are more than JOBS_MAX jobs.
+*/
+esp_err_t jobsRun(Job* jobs, int count) {
+    if (count > JOBS_MAX) return ESP_ERR_INVALID_ARG;
+    if (jobsDone == NULL) jobsDone = xEventGroupCreate();
+
+    JobTask tasks[JOBS_MAX];
+    EventBits_t started = 0;
+    for (int i = 0; i < count; i++) {
+        tasks[i] = {&jobs[i], (EventBits_t)1 << i};
+        if (jobsDone != NULL &&
+            xTaskCreatePinnedToCore(jobTask, jobs[i].name, JOB_STACK_SIZE,
+                                    &tasks[i], 1, NULL,
+                                    jobs[i].core) == pdPASS) {
+            started |= tasks[i].bit;
+        }
+    }
+
+    // The calling task would only wait, so it takes the jobs left over.
+    for (int i = 0; i < count; i++) {
+        if (started & tasks[i].bit) continue;
+        logf(LOG_WARNING, "no task for job %s, running it inline",
+             jobs[i].name);
+        jobs[i].err = jobs[i].fn(jobs[i].ctx);
+    }
+
+    if (started) {
+        xEventGroupWaitBits(jobsDone, started, pdTRUE, pdTRUE,
+                            portMAX_DELAY);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,44 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+// Steps of the wake that only wait on the network, eg. NTP, the MQTT connect
+// and the calendar download, run at the same time on their own FreeRTOS
+// tasks, so the time connected is that of the slowest rather than the sum.
+
+// Most jobs run at once.
+#define JOBS_MAX 8
+// Stack of each job's task. Decoding a PNG in a job needs most of it.
+#define JOB_STACK_SIZE 8192
+// The core running the WiFi and lwIP tasks, for jobs that mostly wait on
+// sockets. The Arduino core, ARDUINO_RUNNING_CORE, is left for decoding.
+#define JOB_CORE_NETWORK 0
+
+// Runs a job, returning its result.
+typedef esp_err_t (*JobFn)(void* ctx);
+
+// A job and, once jobsRun() returns, its result.
+struct Job {
+    const char* name;
+    JobFn fn;
+    void* ctx;
+    BaseType_t core;  // the core to pin the job's task to
+    esp_err_t err;
+};
+
+/**
+  Run jobs concurrently, each on its own task, and wait for all of them to
+  finish. A job whose task cannot be created runs on the calling task
+  instead. Jobs may log and profile, but must not share other state or
+  sleep.
+
+  @param jobs the jobs to run; their results are stored in them.
+  @param count the number of jobs.
+  @returns the esp_err_t code:
+  - ESP_OK if all jobs ran, whatever their results.
+  - ESP_ERR_INVALID_ARG if there are more than JOBS_MAX jobs.
+*/
+esp_err_t jobsRun(Job* jobs, int count);
+
+#endif
@@ -1,107 +1,648 @@
 #include "lib.h"
 
+#include <HTTPClient.h>
+
+#if defined(SIMULATOR)
+#include "sim.h"
+#endif
+
+#if defined(HAS_MQTT)
 // remote mqtt logger
 WiFiClient espClient;
 PubSubClient client(espClient);
-MqttLogger mqttLogger(client, "", MqttLoggerMode::SerialOnly);
-// queue to store messages to publish once mqtt connection is established.
-cppQueue logQ(sizeof(char) * 100, LOG_QUEUE_MAX_ENTRIES, FIFO, true);
+#endif
 // inkplate10 board driver
 Inkplate board(INKPLATE_3BIT);
-// timezone store
-Timezone myTz;
+// battery charge drawn on the calendar on display, -1 if it shows a message
+RTC_DATA_ATTR static int8_t shownBatteryPercent = -1;
+// validators of the calendar image on display, sent with the next download
+RTC_DATA_ATTR HttpValidator calendarValidator;
+// validators of the calendar image downloaded this wake
+static HttpValidator downloadedValidator;
+
+// Set by the WiFi event handler while the station has an IP address.
+#define WIFI_GOT_IP_BIT (1 << 0)
+static EventGroupHandle_t wifiEvents;
+// Failed association attempts, counted by the WiFi event handler.
+static volatile uint16_t wifiDisconnects;
+static const char* wifiSSID;
+static const char* wifiPass;
+static unsigned long wifiStartMs;
+// Whether this wake's connection uses wifiCache.
+static bool wifiCached;
+
+// The access point and IP lease of the last connection, reused to connect
+// straight to the access point's channel with a static IP, skipping the scan
+// and DHCP.
+struct WiFiCache {
+    uint32_t key;  // hash of the SSID and password, 0 if empty
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint8_t wakes;  // wakes the lease was reused on since DHCP gave it
+};
+RTC_DATA_ATTR static WiFiCache wifiCache;
+
+// The rule of a timezone missing from the built-in table, looked up over the
+// network once and kept for later wakes.
+struct TzCache {
+    char name[TZ_NAME_MAX];
+    char posix[TZ_POSIX_MAX];
+};
+RTC_DATA_ATTR static TzCache tzCache;
+
+// The refresh schedule of this wake, see configureSchedule().
+static Schedule wakeSchedule;
+// How PNG images are dithered, see configureDither().
+static uint8_t imageDither = DITHER_NONE;
 
 /**
-  Connect to a WiFi network in Station Mode.
+  FNV-1a hash of the network credentials, so a change of network or password
+  does not reuse the cached connection.
+*/
+static uint32_t wifiKey(const char* ssid, const char* pass) {
+    uint32_t h = 2166136261u;
+    for (const char* c = ssid; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u;
+    // Hash the SSID's terminator too, to separate it from the password.
+    h *= 16777619u;
+    for (const char* c = pass; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u;
+    // 0 marks an empty cache.
+    return h ? h : 1;
+}
+
+/**
+  Handle WiFi events in the WiFi event task. Only signals the waiting task:
+  logging is not safe here.
+*/
+static void onWiFiEvent(arduino_event_id_t event) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            xEventGroupSetBits(wifiEvents, WIFI_GOT_IP_BIT);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            // The station reconnects by itself.
+            wifiDisconnects++;
+            xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+  Begin associating, with the cached access point and IP lease if they are
+  for this network and recent enough, otherwise with a scan and DHCP.
+*/
+static void beginWiFi() {
+    xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT);
+    wifiStartMs = millis();
+    WiFi.mode(WIFI_STA);
+    wifiCached = wifiCache.key == wifiKey(wifiSSID, wifiPass) &&
+                 wifiCache.wakes < WIFI_CACHE_MAX_WAKES;
+    if (wifiCached) {
+        wifiCache.wakes++;
+        WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                    IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+        WiFi.begin(wifiSSID, wifiPass, wifiCache.channel, wifiCache.bssid);
+    } else {
+        // Back to DHCP in case a static IP was configured.
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());
+        WiFi.begin(wifiSSID, wifiPass);
+    }
+}
+
+/**
+  Wait for an IP address, up to a time allowed since beginWiFi().
+
+  @param allowedMs the time allowed.
+  @returns true once connected.
+*/
+static bool waitForIP(unsigned long allowedMs) {
+    unsigned long elapsed = millis() - wifiStartMs;
+    TickType_t ticks =
+        elapsed < allowedMs ? pdMS_TO_TICKS(allowedMs - elapsed) : 0;
+    EventBits_t bits = xEventGroupWaitBits(wifiEvents, WIFI_GOT_IP_BIT,
+                                           pdFALSE, pdTRUE, ticks);
+    return bits & WIFI_GOT_IP_BIT;
+}
+
+/**
+  Start connecting to a WiFi network in Station Mode without waiting, so
+  other work can run during association and DHCP. Reuses the access point and
+  IP lease of the last connection to the network, kept in RTC memory. Call
+  waitWiFi() for the result.
 
   @param ssid the network SSID.
   @param pass the network password.
-  @param retries the number of connection attempts to make before returning an
-  error.
+*/
+void startWiFi(const char* ssid, const char* pass) {
+    if (wifiEvents == NULL) {
+        wifiEvents = xEventGroupCreate();
+        WiFi.onEvent(onWiFiEvent, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+        WiFi.onEvent(onWiFiEvent, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    wifiDisconnects = 0;
+    wifiSSID = ssid;
+    wifiPass = pass;
+    beginWiFi();
+}
+
+/**
+  Wait for the connection started by startWiFi(), woken by WiFi events rather
+  than polling. A connection with the cached access point and IP lease falls
+  back to a scan and DHCP if it does not come up within
+  WIFI_CACHED_MS.
+
+  @param retries the number of connection attempts to allow before returning
+  an error, WIFI_ATTEMPT_MS each.
   @returns the esp_err_t code:
   - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if startWiFi() has not been called.
   - ESP_ERR_TIMEOUT if number of retries is exceeded without success.
 */
-esp_err_t configureWiFi(const char* ssid, const char* pass, int retries) {
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, pass);
-    logf(LOG_INFO, "connecting to WiFi SSID %s...", ssid);
-
-    // Retry until success or give up
-    int attempts = 0;
-    while (attempts++ <= retries && WiFi.status() != WL_CONNECTED) {
-        logf(LOG_DEBUG, "connection attempt #%d...", attempts);
-        delay(1000);
+esp_err_t waitWiFi(int retries) {
+    if (wifiEvents == NULL) return ESP_ERR_INVALID_STATE;
+    logf(LOG_INFO, "connecting to WiFi SSID %s%s...", wifiSSID,
+         wifiCached ? " with cached access point and IP" : "");
+
+    // The time allowed runs from startWiFi(), not from now.
+    unsigned long waitStart = millis();
+    unsigned long allowed = (unsigned long)(retries + 1) * WIFI_ATTEMPT_MS;
+    unsigned long cachedAllowed = min(allowed, (unsigned long)WIFI_CACHED_MS);
+    if (wifiCached && !waitForIP(cachedAllowed)) {
+        // The access point moved channel or was replaced.
+        logf(LOG_NOTICE, "cached WiFi connection failed after %lums, scanning",
+             millis() - wifiStartMs);
+        wifiCache.key = 0;
+        WiFi.disconnect();
+        beginWiFi();
     }
+    bool connected = waitForIP(allowed);
+    for (uint16_t i = 0; i < wifiDisconnects; i++) telemetryRetry(RETRY_WIFI);
 
-    // If still not connected, error with timeout.
-    if (WiFi.status() != WL_CONNECTED) {
+    if (!connected) {
+        logf(LOG_DEBUG, "%u failed connection attempts",
+             (unsigned)wifiDisconnects);
         return ESP_ERR_TIMEOUT;
     }
-    // Print the IP address
-    logf(LOG_DEBUG, "IP address: %s", WiFi.localIP().toString());
+    logf(LOG_DEBUG, "IP address: %s, connected %s in %lums, waited %lums",
+         WiFi.localIP().toString().c_str(),
+         wifiCached ? "with cache" : "with scan and DHCP",
+         millis() - wifiStartMs, millis() - waitStart);
+
+    if (!wifiCached) {
+        memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+        wifiCache.channel = WiFi.channel();
+        wifiCache.ip = WiFi.localIP();
+        wifiCache.gateway = WiFi.gatewayIP();
+        wifiCache.subnet = WiFi.subnetMask();
+        wifiCache.dns = WiFi.dnsIP();
+        wifiCache.wakes = 0;
+        wifiCache.key = wifiKey(wifiSSID, wifiPass);
+    }
+
+    return ESP_OK;
+}
+
+/**
+  Forget the cached access point and IP lease if this wake connected with
+  them, so the next wake scans and asks DHCP again. Call when the network
+  fails after connecting, as it does when the lease has gone stale.
+*/
+void dropWiFiCache() {
+    if (!wifiCached) return;
+    log(LOG_NOTICE, "cached WiFi lease failed, renewing it next wake");
+    wifiCache.key = 0;
+}
+
+// An HTTP response body being streamed.
+struct HttpSource {
+    WiFiClient* stream;
+    int32_t remaining;  // -1 if the server sent no Content-Length
+};
+
+/**
+  Read the next chunk of an HTTP response body as soon as it arrives.
+*/
+static int readHttp(void* ctx, uint8_t* buf, size_t len) {
+    HttpSource* src = (HttpSource*)ctx;
+    if (src->remaining == 0) return 0;
+    if (src->remaining > 0 && len > (size_t)src->remaining) {
+        len = src->remaining;
+    }
+
+    unsigned long start = millis();
+    while (millis() - start < HTTP_READ_TIMEOUT_MS) {
+        size_t avail = src->stream->available();
+        if (avail > 0) {
+            int n = src->stream->read(buf, avail < len ? avail : len);
+            if (n > 0) {
+                if (src->remaining > 0) src->remaining -= n;
+                return n;
+            }
+        } else if (!src->stream->connected()) {
+            // Without a Content-Length the body ends when the server closes.
+            return src->remaining < 0 ? 0 : -1;
+        }
+        delay(1);
+    }
+    return -1;
+}
+
+/**
+  Send a conditional request for the calendar image and prepare to stream the
+  response body. The request is a GET, or a POST if there is a payload.
+
+  @param http the client to send the request with.
+  @param url the URL to request.
+  @param payload the POST body, or NULL to GET.
+  @param size the size of the POST body.
+  @param src the body source to initialise.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EDL if the request fails.
+  - ESP_ERR_ENOTMOD if the server has nothing newer than the calendar on
+  display.
+*/
+static esp_err_t httpRequest(HTTPClient& http, const char* url,
+                             uint8_t* payload, size_t size,
+                             HttpSource* src) {
+    const char* keys[] = {"ETag", "Last-Modified"};
+
+    http.begin(url);
+    http.collectHeaders(keys, 2);
+    if (calendarValidator.etag[0]) {
+        http.addHeader("If-None-Match", calendarValidator.etag);
+    }
+    if (calendarValidator.lastModified[0]) {
+        http.addHeader("If-Modified-Since", calendarValidator.lastModified);
+    }
+
+    int code;
+    if (payload) {
+        http.addHeader("Content-Type", "application/octet-stream");
+        code = http.POST(payload, size);
+    } else {
+        code = http.GET();
+    }
+    if (code == HTTP_CODE_NOT_MODIFIED) {
+        logf(LOG_INFO, "calendar unchanged (ETag %s)", calendarValidator.etag);
+        http.end();
+        return ESP_ERR_ENOTMOD;
+    }
+    if (code != HTTP_CODE_OK) {
+        logf(LOG_ERROR, "HTTP %s %s failed: %d %s", payload ? "POST" : "GET",
+             url, code,
+             HTTPClient::errorToString(code).c_str());
+        http.end();
+        return ESP_ERR_EDL;
+    }
+
+    // Values too long to keep are dropped rather than truncated.
+    String etag = http.header("ETag");
+    String lastModified = http.header("Last-Modified");
+    downloadedValidator.etag[0] = '\0';
+    downloadedValidator.lastModified[0] = '\0';
+    if (etag.length() < HTTP_ETAG_MAX) {
+        strcpy(downloadedValidator.etag, etag.c_str());
+    }
+    if (lastModified.length() < HTTP_DATE_MAX) {
+        strcpy(downloadedValidator.lastModified, lastModified.c_str());
+    }
 
+    src->stream = http.getStreamPtr();
+    src->remaining = http.getSize();
     return ESP_OK;
 }
 
 /**
   Download a file at a given URL. Store the file on disk at a given path.
+  The body is streamed to a temp file that only replaces the file at filePath
+  once the download is complete.
 
   @param url the URL of the file to download.
-  @param size the size of the file to download.
-  @param retries the number of download attempts to make before returning an
-  error.
+  @param size the size to preallocate when the server does not send a
+  Content-Length.
+  @param filePath the path on disk to store the file at.
   @returns the esp_err_t code:
   - ESP_OK if successful.
-  - ESP_ERR_TIMEOUT if number of retries is exceeded without success.
+  - ESP_ERR_EDL if download file fails.
+  - ESP_ERR_EFILEW if writing file to filePath fails.
+  - ESP_ERR_ENOTMOD if the file is unchanged since the calendar on display.
 */
 esp_err_t downloadFile(const char* url, int32_t size, const char* filePath) {
     logf(LOG_INFO, "downloading file at URL %s", url);
 
-    // Download file from URL
-    uint8_t* buf = board.downloadFile(url, &size);
-    if (!buf) {
-        return ESP_ERR_EDL;
+    HTTPClient http;
+    HttpSource src;
+    esp_err_t err = httpRequest(http, url, NULL, 0, &src);
+    if (err != ESP_OK) {
+        return err;
     }
 
     logf(LOG_DEBUG, "writing file to path %s", filePath);
-    SdFat sd = board.getSdFat();
+    SdWriter writer;
+    err = sdWriterBegin(&writer, filePath,
+                        src.remaining >= 0 ? src.remaining : size);
+    if (err != ESP_OK) {
+        http.end();
+        return ESP_ERR_EFILEW;
+    }
 
-    // Write image buffer to SD card
-    if (sd.exists(filePath)) {
-        sd.remove(filePath);
+    uint8_t buf[1460];  // one TCP segment
+    int n;
+    while ((n = readHttp(&src, buf, sizeof(buf))) > 0) {
+        if (sdWriterWrite(&writer, buf, n) != ESP_OK) break;
     }
+    http.end();
 
-    File sdfile = sd.open(filePath, FILE_WRITE);
-    if (!sdfile) {
-        return ESP_ERR_EFILEW;
+    if (n < 0) {
+        log(LOG_ERROR, "download interrupted, keeping previous file");
+        sdWriterAbort(&writer);
+        return ESP_ERR_EDL;
     }
 
-    sdfile.write(buf, size);
-    sdfile.close();
+    return sdWriterCommit(&writer);
+}
 
+#if defined(HAS_SDCARD)
+/**
+  Read the next chunk of a file on SD card.
+*/
+static int readFile(void* ctx, uint8_t* buf, size_t len) {
+    return ((File*)ctx)->read(buf, len);
+}
+#endif
+
+/**
+  Quantise a decoded row to the panel's gray levels, dithering it with the
+  Dither passed as ctx, and write it to the display buffer.
+*/
+static void drawRow(void* ctx, int y, const uint8_t* gray, int width) {
+    static uint8_t levels[E_INK_WIDTH];
+    if (width > E_INK_WIDTH) width = E_INK_WIDTH;
+    ditherRow((Dither*)ctx, gray, levels, width);
+    framebufferWriteRow(0, y, levels, width);
+}
+
+/**
+  Rebuild the calendar from the copy kept in flash, patched with the tiles
+  that changed on the server since.
+
+  @param url the URL of the calendar image, which also serves tile deltas.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if no complete calendar is kept in flash.
+  - ESP_ERR_EDL if the request fails or the delta cannot be applied.
+  - ESP_ERR_ENOTMOD if the URL is unchanged since the calendar on display or
+  none of its tiles changed.
+*/
+static esp_err_t loadDelta(const char* url) {
+    unsigned long start = millis();
+
+    // Manifest goes out as little-endian uint32s, the ESP32's byte order.
+    uint32_t manifest[TILE_COUNT];
+    esp_err_t err = tilesLoadManifest(manifest);
+    if (err == ESP_OK) {
+        err = tilesRestore();
+    }
+    if (err != ESP_OK) {
+        logf(LOG_DEBUG, "no stored calendar for a delta update: %s",
+             esp_err_to_name(err));
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    HTTPClient http;
+    HttpSource src;
+    err = httpRequest(http, url, (uint8_t*)manifest, sizeof(manifest), &src);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    TileDeltaInfo info;
+    err = tilesApplyDelta(readHttp, &src, &info);
+    http.end();
+    if (err != ESP_OK) {
+        logf(LOG_WARNING, "tile delta failed: %s", esp_err_to_name(err));
+        return ESP_ERR_EDL;
+    }
+
+    logf(LOG_DEBUG,
+         "patched %u/%u tiles from %u bytes in %lums, changed region "
+         "(%u,%u)-(%u,%u)",
+         info.tiles, TILE_COUNT, info.bytesIn, millis() - start, info.x0,
+         info.y0, info.x1, info.y1);
+
+    // Without validators the panel may not show the calendar kept in flash,
+    // as after power on or an error message, so it is drawn regardless.
+    bool shown = calendarValidator.etag[0] || calendarValidator.lastModified[0];
+    if (info.tiles == 0 && shown) {
+        // A new ETag for the calendar on display. Keep it so the next wake
+        // gets a 304.
+        calendarValidatorSave();
+        return ESP_ERR_ENOTMOD;
+    }
     return ESP_OK;
 }
 
+// Input whose first bytes were already read to detect the image format.
+struct SniffedSource {
+    const uint8_t* head;
+    size_t headLen;
+    PngReadFn read;
+    void* ctx;
+};
+
 /**
-  Load an image to the display buffer.
+  Replay the bytes read to detect the format, then continue with the input.
+*/
+static int readSniffed(void* ctx, uint8_t* buf, size_t len) {
+    SniffedSource* src = (SniffedSource*)ctx;
+    if (src->headLen == 0) return src->read(src->ctx, buf, len);
+
+    size_t n = min(len, src->headLen);
+    memcpy(buf, src->head, n);
+    src->head += n;
+    src->headLen -= n;
+    return n;
+}
 
-  @param filePath the path of the file on disk.
+/**
+  Load an image to the display buffer. For a URL, the calendar kept in flash
+  is patched with the tiles that changed on the server if possible. A .ink
+  image is copied straight into the framebuffer. A PNG is decoded as it
+  streams in, straight into the framebuffer, without first buffering the file.
+
+  @param filePath the path of the file on disk, or an http:// URL.
   @returns the esp_err_t code:
   - ESP_OK if successful.
   - ESP_ERR_EDL if download file fails.
-  - ESP_ERR_EFILEW if writing file to filePath fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+  - ESP_ERR_ENOTMOD if the URL is unchanged since the calendar on display.
 */
 esp_err_t loadImage(const char* filePath) {
     logf(LOG_INFO, "drawing image from path: %s", filePath);
 
-    if (!board.drawImage(filePath, 0, 0, false, true)) {
+    esp_err_t err;
+    if (strncmp(filePath, "http://", 7) == 0) {
+        err = loadDelta(filePath);
+        if (err == ESP_OK || err == ESP_ERR_ENOTMOD) {
+            return err;
+        }
+
+        err = loadImage(filePath, NULL);
+    } else {
+#if defined(HAS_SDCARD)
+        File file = sd.open(filePath, FILE_READ);
+        if (!file) {
+            return ESP_ERR_EDRAW;
+        }
+        err = loadImage(readFile, &file);
+        file.close();
+#else
         return ESP_ERR_EDRAW;
+#endif
+    }
+
+    return err;
+}
+
+/**
+  Throughput of a stage in kB/s, which is bytes per millisecond.
+*/
+static unsigned long throughput(uint32_t bytes, uint32_t us) {
+    return us > 0 ? (unsigned long)(bytes * 1000ULL / us) : 0;
+}
+
+/**
+  Decode a pipelined image into the display buffer. Takes no context of its
+  own: loadImage() dithers with imageDither.
+*/
+static esp_err_t decodeImage(PngReadFn read, void* readCtx, void*) {
+    return loadImage(read, readCtx);
+}
+
+/**
+  Load an image at a URL to the display buffer. The image is received by a
+  task on the network core while it is decoded on the calling task, through
+  a lock-free ring, so receiving and decoding overlap.
+
+  @param url the http:// URL of the image.
+  @param stats filled with the time spent receiving and decoding, may be
+  NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EDL if download file fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+  - ESP_ERR_ENOTMOD if the URL is unchanged since the calendar on display.
+*/
+esp_err_t loadImage(const char* url, PipelineStats* stats) {
+    HTTPClient http;
+    HttpSource src;
+    esp_err_t err = httpRequest(http, url, NULL, 0, &src);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    PipelineStats pipeline;
+    err = pipelineRun(readHttp, &src, decodeImage, NULL, &pipeline);
+    if (err == ESP_ERR_NO_MEM) {
+        // Nothing was read yet, so decode on this task alone.
+        log(LOG_WARNING, "no memory for the receive task, decoding inline");
+        memset(&pipeline, 0, sizeof(pipeline));
+        err = loadImage(readHttp, &src);
+    } else {
+        logf(LOG_DEBUG,
+             "received %u bytes at %lukB/s, waited %lums for the decoder; "
+             "decoded at %lukB/s, waited %lums for data",
+             pipeline.bytes, throughput(pipeline.bytes, pipeline.receiveUs),
+             (unsigned long)(pipeline.receiveWaitUs / 1000),
+             throughput(pipeline.bytes, pipeline.decodeUs),
+             (unsigned long)(pipeline.decodeWaitUs / 1000));
     }
+    http.end();
+
+    if (stats) *stats = pipeline;
+    return err;
+}
+
+/**
+  Load an image to the display buffer from a stream, detecting whether it is
+  a .ink or a PNG image from its first bytes.
+
+  @param read the input to pull the image from.
+  @param ctx the context passed to read.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EDL if reading the input fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+*/
+esp_err_t loadImage(PngReadFn read, void* ctx) {
+    esp_err_t err;
+    unsigned long start = millis();
+
+    uint8_t head[INK_HEADER_SIZE];
+    size_t headLen = 0;
+    while (headLen < INK_HEADER_SIZE) {
+        int n = read(ctx, head + headLen, INK_HEADER_SIZE - headLen);
+        if (n < 0) return ESP_ERR_EDL;
+        if (n == 0) break;
+        headLen += n;
+    }
+
+    InkHeader ink;
+    if (headLen == INK_HEADER_SIZE && inkParseHeader(head, &ink)) {
+        err = framebufferLoadInk(&ink, read, ctx);
+        if (err != ESP_OK) {
+            logf(LOG_ERROR, "ink image v%u load failed: %s", ink.version,
+                 esp_err_to_name(err));
+            return err == ESP_ERR_TIMEOUT ? ESP_ERR_EDL : ESP_ERR_EDRAW;
+        }
+
+        logf(LOG_DEBUG, "%s %u byte ink image in %lums",
+             ink.encoding == INK_ENCODING_RLE ? "decoded" : "copied", ink.size,
+             millis() - start);
+        return ESP_OK;
+    }
+
+    Dither dither;
+    if (ditherBegin(&dither, imageDither) != ESP_OK) {
+        log(LOG_WARNING, "no memory to dither the PNG, quantising it");
+        ditherBegin(&dither, DITHER_NONE);
+    }
+    PngInfo info;
+    SniffedSource src = {head, headLen, read, ctx};
+    err = pngDecode(readSniffed, &src, drawRow, &dither, &info);
+    ditherEnd(&dither);
+    if (err != ESP_OK) {
+        logf(LOG_ERROR, "PNG decode failed: %s", esp_err_to_name(err));
+        return err == ESP_ERR_TIMEOUT ? ESP_ERR_EDL : ESP_ERR_EDRAW;
+    }
+
+    logf(LOG_DEBUG, "decoded %ux%u PNG from %u bytes in %lums, %u bytes used",
+         info.width, info.height, info.bytesIn, millis() - start,
+         info.memoryUsed);
 
     return ESP_OK;
 }
 
+/**
+  Remember the validators of the calendar image just sent to the display, so
+  the next download can be skipped if the server has nothing new.
+*/
+void calendarValidatorSave() { calendarValidator = downloadedValidator; }
+
+/**
+  Forget the validators of the calendar image, eg. because something else has
+  been drawn over it. The next download is unconditional.
+*/
+void calendarValidatorReset() {
+    memset(&calendarValidator, 0, sizeof(calendarValidator));
+}
+
 /**
   Load an image to the display buffer.
 
@@ -121,6 +662,18 @@ esp_err_t loadImage(uint8_t* buf, int x, int y, int w, int h) {
     return ESP_OK;
 }
 
+/**
+  Show the display buffer on the panel, in the cheapest way that shows it.
+*/
+static void showFrame() {
+    static const char* const refreshNames[] = {"3-bit", "1-bit",
+                                               "1-bit partial", "no"};
+    unsigned long start = millis();
+    uint8_t refresh = refreshDisplay();
+    logf(LOG_DEBUG, "%s refresh in %lums", refreshNames[refresh],
+         millis() - start);
+}
+
 /**
   Draw the battery status to the display.
 
@@ -185,11 +738,24 @@ void displayBatteryStatus(int batteryRemainingPercent, bool invert) {
   error.
 */
 void displayMessage(const char* msg, int batteryRemainingPercent) {
+    profilerBegin(PHASE_MESSAGE);
+    // The message covers the calendar, so it must be redrawn next time.
+    calendarValidatorReset();
     board.clearDisplay();
-    // If previous image exists, load into board buffer.
-    esp_err_t err = loadImage(CALENDAR_RW_PATH);
+    // Draw over the last good calendar, kept in flash.
+    unsigned long start = millis();
+    esp_err_t err = tilesRestore();
+#ifdef HAS_SDCARD
     if (err != ESP_OK) {
-        log(LOG_WARNING, "load previous image error");
+        err = loadImage(CALENDAR_RW_PATH);
+    }
+#endif
+    if (err != ESP_OK) {
+        board.clearDisplay();
+        logf(LOG_WARNING, "load previous image error: %s",
+             esp_err_to_name(err));
+    } else {
+        logf(LOG_DEBUG, "restored previous image in %lums", millis() - start);
     }
 
     int cX = E_INK_HEIGHT / 2;
@@ -208,11 +774,79 @@ void displayMessage(const char* msg, int batteryRemainingPercent) {
 
     displayBatteryStatus(batteryRemainingPercent, true);
 
-    board.display();
+    showFrame();
+    shownBatteryPercent = -1;
+    profilerEnd(PHASE_MESSAGE);
+}
+
+/**
+  Redraw the calendar and battery status the panel shows, if it shows them
+  in black and white, so the next refresh can be a partial update. Leaves
+  the display buffer dirty.
+*/
+void displayPreload() {
+    if (shownBatteryPercent < 0 || !refreshCanPartial()) return;
+
+    unsigned long start = millis();
+    board.clearDisplay();
+    esp_err_t err = tilesRestore();
+    if (err == ESP_OK) {
+        displayBatteryStatus(shownBatteryPercent, false);
+        err = refreshPreload();
+    }
+    if (err != ESP_OK) {
+        logf(LOG_DEBUG, "cannot preload panel: %s", esp_err_to_name(err));
+    } else {
+        logf(LOG_DEBUG, "preloaded panel in %lums", millis() - start);
+    }
+}
+
+/**
+  Draw the battery status over the calendar in the display buffer and show
+  it on the panel.
+
+  @param batteryRemainingPercent the percentage remaining battery capacity.
+*/
+void displayCalendar(int batteryRemainingPercent) {
+    displayBatteryStatus(batteryRemainingPercent, false);
+
+    profilerBegin(PHASE_DISPLAY);
+    showFrame();
+    profilerEnd(PHASE_DISPLAY);
+    shownBatteryPercent = batteryRemainingPercent;
+}
+
+/**
+  Update the battery status on the calendar the panel shows, if it changed
+  and the panel shows it in black and white.
+
+  @param batteryRemainingPercent the percentage remaining battery capacity.
+  @returns the esp_err_t code:
+  - ESP_OK if the battery status was updated.
+  - ESP_ERR_NOT_FOUND if it has not changed.
+  - ESP_ERR_NOT_SUPPORTED if it would take a 3-bit refresh.
+  - any error of tilesRestore().
+*/
+esp_err_t displayBatteryChange(int batteryRemainingPercent) {
+    if (shownBatteryPercent == batteryRemainingPercent) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Only worth it without a 3-bit refresh, which takes as long as
+    // refreshing the calendar.
+    if (shownBatteryPercent < 0 || !refreshShowsMono()) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    board.clearDisplay();
+    esp_err_t err = tilesRestore();
+    if (err != ESP_OK) return err;
+    displayCalendar(batteryRemainingPercent);
+    return ESP_OK;
 }
 
+#if defined(HAS_MQTT)
 /**
-  Connect to a MQTT broker for remote logging.
+  Connect to a MQTT broker for remote logging. Only built with HAS_MQTT.
 
   @param broker the hostname of the MQTT broker.
   @param port the port of the MQTT broker.
@@ -240,197 +874,201 @@ esp_err_t configureMQTT(const char* broker, int port, const char* topic,
         return ESP_ERR_TIMEOUT;
     }
 
-    mqttLogger.setTopic(topic);
-    mqttLogger.setMode(MqttLoggerMode::MqttAndSerial);
+    logAttachMqtt(&client, topic);
 
     logf(LOG_INFO, "connected to MQTT broker %s:%d", broker, port);
 
     return ESP_OK;
 }
+#endif
 
 /**
-  Converts a priority into a log level prefix.
+  Set the timezone used for local time, from the built-in table of POSIX TZ
+  rules or a POSIX TZ rule given as is. A timezone missing from the table is
+  looked up over the network once, if connected, and its rule kept in RTC
+  memory for later wakes.
 
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @returns the string value of the priority.
+  @param timezoneName the name of the timezone in Olson format (eg.
+  Europe/Dublin), or a POSIX TZ rule (eg. IST-1GMT0,M10.5.0,M3.5.0/1).
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the timezone is unknown and could not be looked up,
+  local time stays UTC.
+  - ESP_ERR_INVALID_ARG if the POSIX TZ rule cannot be parsed.
 */
-const char* msgPrefix(uint16_t pri) {
-    char* priority;
+esp_err_t configureTimezone(const char* timezoneName) {
+    if (timezoneName == NULL || *timezoneName == '\0') {
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    switch (pri) {
-        case LOG_CRIT:
-            priority = (char*)"CRITICAL";
-            break;
-        case LOG_ERROR:
-            priority = (char*)"ERROR";
-            break;
-        case LOG_WARNING:
-            priority = (char*)"WARNING";
-            break;
-        case LOG_NOTICE:
-            priority = (char*)"NOTICE";
-            break;
-        case LOG_INFO:
-            priority = (char*)"INFO";
-            break;
-        case LOG_DEBUG:
-            priority = (char*)"DEBUG";
-            break;
-        default:
-            priority = (char*)"INFO";
-            break;
+    const char* posix = tzLookup(timezoneName);
+    if (posix == NULL && strncmp(tzCache.name, timezoneName,
+                                 sizeof(tzCache.name)) == 0) {
+        posix = tzCache.posix;
+    }
+    if (posix == NULL) {
+        if (!WiFi.isConnected()) return ESP_ERR_NOT_FOUND;
+        Timezone tz;
+        if (!tz.setLocation(timezoneName) || tz.getPosix().length() == 0 ||
+            tz.getPosix().length() >= sizeof(tzCache.posix) ||
+            strlen(timezoneName) >= sizeof(tzCache.name)) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        strcpy(tzCache.name, timezoneName);
+        strcpy(tzCache.posix, tz.getPosix().c_str());
+        posix = tzCache.posix;
+        logf(LOG_INFO, "looked up timezone %s: %s", timezoneName, posix);
     }
 
-    char* prefix = new char[35];
-    sprintf(prefix, "%s - %s - ", myTz.dateTime(RFC3339).c_str(), priority);
-    return prefix;
+    esp_err_t err = tzSet(posix);
+    if (err == ESP_OK) logf(LOG_DEBUG, "timezone %s", posix);
+    return err;
 }
 
 /**
-  Log a message.
+  If the real-time clock may have drifted too far since it was last synced,
+  synchronize it with a single NTP exchange.
 
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @param msg the message to log.
+  @param ntpHost the hostname of the NTP server (eg. pool.ntp.org).
+  @param toleranceSeconds how far off the RTC is allowed to be before
+  syncing.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_ENTP if updating the NTP client fails.
 */
-void log(uint16_t pri, const char* msg) {
-    if (pri > LOG_LEVEL) return;
-
-    const char* prefix = msgPrefix(pri);
-    size_t prefixLen = strlen(prefix);
-    size_t msgLen = strlen(msg);
-    char buf[prefixLen + msgLen + 1];
-    strcpy(buf, prefix);
-    strcat(buf, msg);
-    ensureQueue(buf);
-}
+esp_err_t configureTime(const char* ntpHost, int toleranceSeconds) {
+    log(LOG_INFO, "configuring network time and RTC...");
 
-/**
-  Log a message with formatting.
+    bool rtcSet = board.rtcIsSet();
+    if (rtcSet) {
+        int32_t errorMs = timekeeperPredictError(now());
+        if (errorMs >= 0 && errorMs <= toleranceSeconds * 1000L) {
+            logf(LOG_DEBUG, "RTC predicted within %ldms, skipping NTP",
+                 (long)errorMs);
+            return ESP_OK;
+        }
+    }
 
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @param fmt the format of the log message
-*/
-void logf(uint16_t pri, const char* fmt, ...) {
-    if (pri > LOG_LEVEL) return;
+    // One exchange now; nothing needs ezTime to resync later in the wake.
+    setServer(ntpHost);
+    setInterval(0);
+    if (!waitForSync()) {
+        return ESP_ERR_ENTP;
+    }
 
-    const char* prefix = msgPrefix(pri);
-    size_t prefixLen = strlen(prefix);
-    size_t msgLen = strlen(fmt);
-    char a[prefixLen + msgLen + 1];
-    strcpy(a, prefix);
-    strcat(a, fmt);
+    // The RTC keeps UTC.
+    time_t rtcTime = rtcSet ? board.rtcGetEpoch() : 0;
+    time_t nowTime = now();
+    board.rtcSetEpoch(nowTime);
+    int32_t driftPpb = timekeeperSynced(rtcTime, nowTime);
+    logf(LOG_DEBUG, "RTC synced to %s, was %lds off, drift %ldppb",
+         dateTime(nowTime, RFC3339).c_str(),
+         rtcSet ? (long)(rtcTime - nowTime) : 0L, (long)driftPpb);
 
-    va_list args;
-    va_start(args, fmt);
-    size_t size = snprintf(NULL, 0, a, args);
-    char b[size + 1];
-    vsprintf(b, a, args);
-    ensureQueue(b);
-    va_end(args);
+    return ESP_OK;
 }
 
 /**
-  Ensure log queue is populated/emptied based on MQTT connection.
+  Set the refresh schedule for this wake and plan its wakes for the battery
+  charge, see schedule.h for the format. Until then, or if the schedule
+  cannot be parsed, the calendar refreshes daily at
+  CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME.
 
-  @param msg the log message.
+  @param spec the schedule (eg. 07:00 Mon-Fri; 09:00 Sat,Sun).
+  @param batteryPercent the battery charge.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the schedule cannot be parsed.
+  - ESP_ERR_INVALID_SIZE if it has too many slots.
 */
-void ensureQueue(char* logMsg) {
-    if (!client.connected()) {
-        // populate log queue while no mqtt connection
-        logQ.push(logMsg);
-    } else {
-        // send queued logs once we are connected.
-        if (logQ.getCount() > 0) {
-            mqttLogger.setMode(MqttLoggerMode::MqttOnly);
-            while (!logQ.isEmpty()) {
-                logQ.pop(logMsg);
-                mqttLogger.println(logMsg);
-            }
-            mqttLogger.setMode(MqttLoggerMode::MqttAndSerial);
-        }
-    }
-    // print/send the current log
-    mqttLogger.println(logMsg);
+esp_err_t configureSchedule(const char* spec, int batteryPercent) {
+    Schedule schedule;
+    esp_err_t err = scheduleParse(spec, &schedule);
+    if (err != ESP_OK) return err;
+
+    schedulePlan(&schedule, batteryPercent);
+    wakeSchedule = schedule;
+    logf(LOG_DEBUG, "%d wakes a week at %d%% battery", wakeSchedule.numWakes,
+         batteryPercent);
+    return ESP_OK;
 }
 
 /**
-  Connect to an NTP server and synchronize the on-board real-time clock.
+  Set how PNG images are dithered to the panel's gray levels, see dither.h.
+  Until then, or if the name is unknown, they are not dithered.
 
-  @param host the hostname of the NTP server (eg. pool.ntp.org).
-  @param timezoneName the name of the timezone in Olson format (eg.
-  Europe/Dublin)
+  @param name the kernel, none, floyd-steinberg or atkinson.
   @returns the esp_err_t code:
   - ESP_OK if successful.
-  - ESP_ERR_ENTP if updating the NTP client fails.
+  - ESP_ERR_INVALID_ARG if the name is unknown.
 */
-esp_err_t configureTime(const char* ntpHost, const char* timezoneName) {
-    log(LOG_INFO, "configuring network time and RTC...");
-
-    setServer(ntpHost);
-
-    if (!waitForSync()) {
-        return ESP_ERR_ENTP;
-    }
-    myTz.setLocation(F(timezoneName));
-
-    updateNTP();
-    // Sync RTC with NTP time
-    // time_t nowTime = now();
-    time_t nowTime = myTz.now();
-    board.rtcSetEpoch(nowTime);
-    logf(LOG_DEBUG, "RTC synced to %s", dateTime(nowTime, RFC3339).c_str());
+esp_err_t configureDither(const char* name) {
+    uint8_t kernel;
+    esp_err_t err = ditherParse(name, &kernel);
+    if (err != ESP_OK) return err;
 
+    imageDither = kernel;
     return ESP_OK;
 }
 
 /**
-  Get the next scheduled time to wake from deep sleep.
+  Get the next time to wake from deep sleep in the refresh schedule.
 
-  @param refreshTime the time of the day to wake in HH::MM:SS format (eg.
-  09:00:00). error.
   @returns the epoch time of when to wake.
   If the real-time clock is not configured, it will return the last configured
   RTC epoch time + DEEP_SLEEP_FALLBACK_SECONDS.
 */
-time_t getWakeTime(const char* refreshTime) {
+time_t getWakeTime() {
     if (!board.rtcIsSet()) {
         log(LOG_WARNING, "cannot determine wake time: RTC not set");
         return board.rtcGetEpoch() + DEEP_SLEEP_FALLBACK_SECONDS;
     }
+    if (wakeSchedule.numWakes == 0) {
+        scheduleParse(CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME,
+                      &wakeSchedule);
+        schedulePlan(&wakeSchedule, 100);
+    }
 
-    tmElements_t tm;
-    int hr, min, sec;
-    sscanf(refreshTime, "%d:%d:%d", &hr, &min, &sec);
-
-    tm.Hour = hr;
-    tm.Minute = min;
-    tm.Second = sec;
+    // The schedule is in local time, the RTC keeps UTC. A wake a little
+    // early for a refresh counts as that refresh: the RTC drifts between NTP
+    // syncs. Local days are not 24 hours long when daylight saving changes,
+    // so the next wake is found in local time.
+    time_t nowTime = now();
+    time_t localTime = scheduleNext(&wakeSchedule,
+                                    tzLocalTime(nowTime) + WAKE_EARLY_MARGIN);
+    return tzUTCTime(localTime);
+}
 
-    tm.Day = myTz.day();
-    tm.Month = myTz.month();
-    tm.Year = CalendarYrToTm(myTz.year());
+/**
+  Enter deep sleep until the next wake in the refresh schedule.
+*/
+void sleep() {
+    logf(LOG_DEBUG, "setting deep sleep RTC wakeup on pin %d", GPIO_NUM_39);
 
-    time_t targetTime = makeTime(tm);
-    time_t nowTime = myTz.now();
+    time_t targetWakeTime = getWakeTime();
+    board.rtcSetAlarmEpoch(targetWakeTime, RTC_ALARM_MATCH_DHHMMSS);
+    esp_sleep_enable_ext0_wakeup(GPIO_NUM_39, 0);
 
-    // Rollover to tomorrow
-    if (nowTime > targetTime) {
-        targetTime += SECS_PER_DAY;
-    }
+    logf(LOG_DEBUG, "waking at %s", dateTime(targetWakeTime, RFC3339).c_str());
 
-    return targetTime;
+    deepSleep();
 }
 
 /**
-  Enter deep sleep with RTC alarm.
+  Enter deep sleep after a failed wake, until a retry wake if the retry
+  budgets allow one or else until the next wake in the refresh schedule.
 
-  @param refreshTime the time of the day to wake in HH:MM:SS format (eg.
-  09:00:00). error.
+  @param failure the operation that failed, RETRY_WIFI to RETRY_DRAW.
+  @param batteryPercent the battery charge.
 */
-void sleep(const char* refreshTime) {
+void sleepRetry(uint8_t failure, int batteryPercent) {
+    // Without the time there is no telling when to retry.
+    if (!board.rtcIsSet()) sleep();
+
     logf(LOG_DEBUG, "setting deep sleep RTC wakeup on pin %d", GPIO_NUM_39);
 
-    time_t targetWakeTime = getWakeTime(refreshTime);
+    time_t targetWakeTime =
+        retryWakeTime(failure, now(), getWakeTime(), batteryPercent);
     board.rtcSetAlarmEpoch(targetWakeTime, RTC_ALARM_MATCH_DHHMMSS);
     esp_sleep_enable_ext0_wakeup(GPIO_NUM_39, 0);
 
@@ -447,7 +1085,7 @@ void sleep(const char* refreshTime) {
 void sleep(const int seconds) {
     logf(LOG_DEBUG, "setting deep sleep RTC wakeup on pin %d", GPIO_NUM_39);
 
-    time_t targetWakeTime = myTz.now() + seconds;
+    time_t targetWakeTime = now() + seconds;
     board.rtcSetAlarmEpoch(targetWakeTime, RTC_ALARM_MATCH_DHHMMSS);
     esp_sleep_enable_ext0_wakeup(GPIO_NUM_39, 0);
 
@@ -460,7 +1098,22 @@ void sleep(const int seconds) {
   Enter deep sleep.
 */
 void deepSleep() {
+    const LogStats* stats = logStats();
+    logf(LOG_DEBUG, "logged %u lines, %u truncated, %u dropped unpublished",
+         stats->lines, stats->truncated, stats->dropped);
     log(LOG_NOTICE, "deep sleeping now");
+    if constexpr (FEATURE_MQTT) {
+        if (telemetryEnabled()) {
+            profilerBegin(PHASE_MQTT);
+            esp_err_t err = telemetryPublish(client);
+            profilerEnd(PHASE_MQTT);
+            if (err != ESP_OK) {
+                // Too late for the packet itself, but still on serial.
+                logf(LOG_WARNING, "failed to publish telemetry: %s",
+                     esp_err_to_name(err));
+            }
+        }
+    }
     WiFi.disconnect();
     WiFi.mode(WIFI_OFF);
 
@@ -468,5 +1121,10 @@ void deepSleep() {
     board.sdCardSleep();
 #endif
 
+    profilerFinish(now());
+#if defined(SIMULATOR)
+    profilerExportTrace(sim::statePath("trace.json").c_str());
+#endif
+
     esp_deep_sleep_start();
 }
\ No newline at end of file
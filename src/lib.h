@@ -3,29 +3,65 @@
 #include <Inkplate.h>
 #include <WiFi.h>
 #include <WiFiUdp.h>
-#include <cppQueue.h>
 #include <driver/rtc_io.h>
 #include <ezTime.h>
+#include <freertos/event_groups.h>
 #include <rom/rtc.h>
 
 #include "Merienda_Regular16pt7b.h"
 #include "Merienda_Regular12pt7b.h"
-#include "MqttLogger.h"
+#include "batterymodel.h"
+#include "configcache.h"
+#include "dither.h"
+#include "framebuffer.h"
+#include "jobs.h"
+#include "logger.h"
+#include "pipeline.h"
+#include "png.h"
+#include "profiler.h"
+#include "refresh.h"
+#include "retry.h"
+#include "schedule.h"
+#include "sdwriter.h"
+#include "subsystems.h"
+#include "telemetry.h"
+#include "tiles.h"
+#include "timekeeper.h"
+#include "tz.h"
 
 #define CalendarYrToTm(Y) ((Y)-1970)
 #define SECONDS_IN_YEAR 86400 * 365
 // The number of seconds to sleep if RTC not configured correctly.
 #define DEEP_SLEEP_FALLBACK_SECONDS 120
-// log message entry history size
-#define LOG_QUEUE_MAX_ENTRIES 10
 // The file path on SD card to load config.
 #define CONFIG_FILE_PATH "/config.yaml"
-// Fallback time to refresh.
+// Fallback time to refresh, also the schedule until one is configured.
 #define CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME "09:00:00"
+// A wake up to this many seconds before the refresh time counts as that day's
+// refresh.
+#define WAKE_EARLY_MARGIN 300
+// Seconds the RTC may be off before it is synced with NTP, if not configured.
+#define NTP_DEFAULT_TOLERANCE 10
+// Longest timezone name kept with a rule looked up over the network.
+#define TZ_NAME_MAX 48
 // The path on SD card where calendar images are downloaded to and read from.
 #define CALENDAR_RW_PATH "/calendar.png"
 // Guestimate file size for PNG image @ 1200x825
 #define CALENDAR_IMAGE_SIZE E_INK_WIDTH* E_INK_HEIGHT * 4 + 100
+// Give up on a download if no data arrives for this long.
+#define HTTP_READ_TIMEOUT_MS 5000
+// Longest ETag and Last-Modified header values kept between wakes.
+#define HTTP_ETAG_MAX 64
+#define HTTP_DATE_MAX 32
+// Time allowed per WiFi connection attempt.
+#define WIFI_ATTEMPT_MS 1000
+// Time allowed to connect with the cached access point and IP lease before
+// falling back to a scan and DHCP.
+#define WIFI_CACHED_MS 1500
+// Wakes a cached IP lease is reused on before it is renewed with DHCP. A
+// static IP always associates, so a lease reassigned by the router is only
+// noticed when the cache is renewed.
+#define WIFI_CACHE_MAX_WAKES 8
 
 // Enum of errors that might be encountered.
 #define ESP_ERR_ERRNO_BASE (0)
@@ -33,71 +69,128 @@
 #define ESP_ERR_EDRAW (2 + ESP_ERR_ERRNO_BASE)   // Draw error
 #define ESP_ERR_EFILEW (3 + ESP_ERR_ERRNO_BASE)  // File write error
 #define ESP_ERR_ENTP (4 + ESP_ERR_ERRNO_BASE)    // NTP error
+#define ESP_ERR_ENOTMOD (5 + ESP_ERR_ERRNO_BASE) // Calendar not modified
 
-// Enum of log verbosity levels.
-#define LOG_CRIT 0
-#define LOG_ERROR 1
-#define LOG_WARNING 2
-#define LOG_NOTICE 3
-#define LOG_INFO 4
-#define LOG_DEBUG 5
-
-#ifndef LOG_LEVEL
-// Debug logging by default.
-#define LOG_LEVEL LOG_DEBUG
-#endif
-
-// The remote logging instance.
-extern MqttLogger mqttLogger;
-// The log message queue.
-extern cppQueue logQ;
+// HTTP cache validators of a downloaded image.
+struct HttpValidator {
+    char etag[HTTP_ETAG_MAX];
+    char lastModified[HTTP_DATE_MAX];
+};
+
+// The MQTT client used for remote logging, only built with HAS_MQTT.
+extern PubSubClient client;
 // The Inkplate board driver instance.
 extern Inkplate board;
-// The timezone object to store localised time
-extern Timezone myTz;
 // Battery icon bitmap array.
 extern uint8_t* epdBitmapAll[4];
 extern uint8_t* epdBitmapAllInverted[4];
 extern const int batteryIconSize;
 
 /**
-  Connect to a WiFi network in Station Mode.
+  Start connecting to a WiFi network in Station Mode without waiting, so
+  other work can run during association and DHCP. Reuses the access point and
+  IP lease of the last connection to the network, kept in RTC memory. Call
+  waitWiFi() for the result.
 
   @param ssid the network SSID.
   @param pass the network password.
-  @param retries the number of connection attempts to make before returning an
-  error.
+*/
+void startWiFi(const char* ssid, const char* pass);
+
+/**
+  Wait for the connection started by startWiFi(), woken by WiFi events rather
+  than polling. A connection with the cached access point and IP lease falls
+  back to a scan and DHCP if it does not come up within WIFI_CACHED_MS.
+
+  @param retries the number of connection attempts to allow before returning
+  an error, WIFI_ATTEMPT_MS each.
   @returns the esp_err_t code:
   - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if startWiFi() has not been called.
   - ESP_ERR_TIMEOUT if number of retries is exceeded without success.
 */
-esp_err_t configureWiFi(const char* ssid, const char* pass, int retries);
+esp_err_t waitWiFi(int retries);
+
+/**
+  Forget the cached access point and IP lease if this wake connected with
+  them, so the next wake scans and asks DHCP again. Call when the network
+  fails after connecting, as it does when the lease has gone stale.
+*/
+void dropWiFiCache();
 
 /**
   Download a file at a given URL. Store the file on disk at a given path.
+  The body is streamed to a temp file that only replaces the file at filePath
+  once the download is complete.
 
   @param url the URL of the file to download.
-  @param size the size of the file to download.
-  @param retries the number of download attempts to make before returning an
-  error.
+  @param size the size to preallocate when the server does not send a
+  Content-Length.
+  @param filePath the path on disk to store the file at.
   @returns the esp_err_t code:
   - ESP_OK if successful.
-  - ESP_ERR_TIMEOUT if number of retries is exceeded without success.
+  - ESP_ERR_EDL if download file fails.
+  - ESP_ERR_EFILEW if writing file to filePath fails.
+  - ESP_ERR_ENOTMOD if the file is unchanged since the calendar on display.
 */
 esp_err_t downloadFile(const char* url, int32_t size, const char* filePath);
 
 /**
-  Load an image to the display buffer.
+  Load an image to the display buffer. For a URL, the calendar kept in flash
+  is patched with the tiles that changed on the server if possible. A .ink
+  image is copied straight into the framebuffer. A PNG is decoded as it
+  streams in, straight into the framebuffer, without first buffering the file.
 
-  @param filePath the path of the file on disk.
-  error.
+  @param filePath the path of the file on disk, or an http:// URL.
   @returns the esp_err_t code:
   - ESP_OK if successful.
   - ESP_ERR_EDL if download file fails.
-  - ESP_ERR_EFILEW if writing file to filePath fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+  - ESP_ERR_ENOTMOD if the URL is unchanged since the calendar on display.
 */
 esp_err_t loadImage(const char* filePath);
 
+/**
+  Load an image at a URL to the display buffer. The image is received by a
+  task on the network core while it is decoded on the calling task, through
+  a lock-free ring, so receiving and decoding overlap.
+
+  @param url the http:// URL of the image.
+  @param stats filled with the time spent receiving and decoding, may be
+  NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EDL if download file fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+  - ESP_ERR_ENOTMOD if the URL is unchanged since the calendar on display.
+*/
+esp_err_t loadImage(const char* url, PipelineStats* stats);
+
+/**
+  Load an image to the display buffer from a stream, detecting whether it is
+  a .ink or a PNG image from its first bytes.
+
+  @param read the input to pull the image from.
+  @param ctx the context passed to read.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EDL if reading the input fails.
+  - ESP_ERR_EDRAW if the image cannot be decoded.
+*/
+esp_err_t loadImage(PngReadFn read, void* ctx);
+
+/**
+  Remember the validators of the calendar image just sent to the display, so
+  the next download can be skipped if the server has nothing new.
+*/
+void calendarValidatorSave();
+
+/**
+  Forget the validators of the calendar image, eg. because something else has
+  been drawn over it. The next download is unconditional.
+*/
+void calendarValidatorReset();
+
 /**
   Load an image to the display buffer.
 
@@ -129,35 +222,110 @@ void displayBatteryStatus(int batteryRemainingPercent, bool invert);
 void displayMessage(const char* msg, int batteryRemainingPercent);
 
 /**
-  Connect to an NTP server and synchronize the on-board real-time clock.
+  Redraw the calendar and battery status the panel shows, if it shows them
+  in black and white, so the next refresh can be a partial update. Leaves
+  the display buffer dirty.
+*/
+void displayPreload();
+
+/**
+  Draw the battery status over the calendar in the display buffer and show
+  it on the panel.
+
+  @param batteryRemainingPercent the percentage remaining battery capacity.
+*/
+void displayCalendar(int batteryRemainingPercent);
+
+/**
+  Update the battery status on the calendar the panel shows, if it changed
+  and the panel shows it in black and white.
+
+  @param batteryRemainingPercent the percentage remaining battery capacity.
+  @returns the esp_err_t code:
+  - ESP_OK if the battery status was updated.
+  - ESP_ERR_NOT_FOUND if it has not changed.
+  - ESP_ERR_NOT_SUPPORTED if it would take a 3-bit refresh.
+  - any error of tilesRestore().
+*/
+esp_err_t displayBatteryChange(int batteryRemainingPercent);
+
+/**
+  Set the timezone used for local time, from the built-in table of POSIX TZ
+  rules or a POSIX TZ rule given as is. A timezone missing from the table is
+  looked up over the network once, if connected, and its rule kept in RTC
+  memory for later wakes.
 
-  @param ntpHost the hostname of the NTP server (eg. pool.ntp.org).
   @param timezoneName the name of the timezone in Olson format (eg.
-  Europe/Dublin)
+  Europe/Dublin), or a POSIX TZ rule (eg. IST-1GMT0,M10.5.0,M3.5.0/1).
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the timezone is unknown and could not be looked up,
+  local time stays UTC.
+  - ESP_ERR_INVALID_ARG if the POSIX TZ rule cannot be parsed.
+*/
+esp_err_t configureTimezone(const char* timezoneName);
+
+/**
+  If the real-time clock may have drifted too far since it was last synced,
+  synchronize it with a single NTP exchange.
+
+  @param ntpHost the hostname of the NTP server (eg. pool.ntp.org).
+  @param toleranceSeconds how far off the RTC is allowed to be before
+  syncing.
   @returns the esp_err_t code:
   - ESP_OK if successful.
   - ESP_ERR_ENTP if updating the NTP client fails.
 */
-esp_err_t configureTime(const char* ntpHost, const char* timezoneName);
+esp_err_t configureTime(const char* ntpHost, int toleranceSeconds);
+
+/**
+  Set the refresh schedule for this wake and plan its wakes for the battery
+  charge, see schedule.h for the format. Until then, or if the schedule
+  cannot be parsed, the calendar refreshes daily at
+  CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME.
+
+  @param spec the schedule (eg. 07:00 Mon-Fri; 09:00 Sat,Sun).
+  @param batteryPercent the battery charge.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the schedule cannot be parsed.
+  - ESP_ERR_INVALID_SIZE if it has too many slots.
+*/
+esp_err_t configureSchedule(const char* spec, int batteryPercent);
+
+/**
+  Set how PNG images are dithered to the panel's gray levels, see dither.h.
+  Until then, or if the name is unknown, they are not dithered.
+
+  @param name the kernel, none, floyd-steinberg or atkinson.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the name is unknown.
+*/
+esp_err_t configureDither(const char* name);
 
 /**
-  Get the next scheduled time to wake from deep sleep.
+  Get the next time to wake from deep sleep in the refresh schedule.
 
-  @param refreshTime the time of the day to wake in HH::MM:SS format (eg.
-  09:00:00). error.
   @returns the epoch time of when to wake.
   If the real-time clock is not configured, it will return the last configured
   RTC epoch time + DEEP_SLEEP_FALLBACK_SECONDS.
 */
-time_t getWakeTime(const char* refreshTime);
+time_t getWakeTime();
 
 /**
-  Enter deep sleep.
+  Enter deep sleep until the next wake in the refresh schedule.
+*/
+void sleep();
 
-  @param refreshTime the time of the day to wake in HH:MM:SS format (eg.
-  09:00:00). error.
+/**
+  Enter deep sleep after a failed wake, until a retry wake if the retry
+  budgets allow one or else until the next wake in the refresh schedule.
+
+  @param failure the operation that failed, RETRY_WIFI to RETRY_DRAW.
+  @param batteryPercent the battery charge.
 */
-void sleep(const char* refreshTime);
+void sleepRetry(uint8_t failure, int batteryPercent);
 
 /**
   Enter deep sleep.
@@ -172,7 +340,7 @@ void sleep(const int seconds);
 void deepSleep();
 
 /**
-  Connect to a MQTT broker for remote logging.
+  Connect to a MQTT broker for remote logging. Only built with HAS_MQTT.
 
   @param broker the hostname of the MQTT broker.
   @param port the port of the MQTT broker.
@@ -187,35 +355,4 @@ void deepSleep();
 esp_err_t configureMQTT(const char* broker, int port, const char* topic,
                         const char* clientID, int max_retries);
 
-/**
-  Log a message.
-
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @param msg the message to log.
-*/
-void log(uint16_t pri, const char* msg);
-
-/**
-  Log a message with formatting.
-
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @param fmt the format of the log message
-*/
-void logf(uint16_t pri, const char* fmt, ...);
-
-/**
-  Converts a priority into a log level prefix.
-
-  @param pri the log level / priority of the message, see LOG_LEVEL.
-  @returns the string value of the priority.
-*/
-const char* msgPrefix(uint16_t pri);
-
-/**
-  Ensure log queue is populated/emptied based on MQTT connection.
-
-  @param msg the log message
-*/
-void ensureQueue(char* msg);
-
 #endif
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include "logger.h"
+
+#include <freertos/semphr.h>
+
+#include "lib.h"
+
+#define LOG_RING_MAGIC 0x31474f4c  // "LOG1"
+
+// The ring of held messages lives in RTC memory so messages from a wake that
+// never got online, eg. a WiFi timeout, are published on a later one. Each
+// message is stored as a LogEntry followed by its text, wrapping around the
+// end of the ring.
+struct LogRing {
+    uint32_t magic;
+    uint16_t boot;  // boot ID of this wake
+    uint16_t seq;   // sequence number of the next message this wake
+    uint16_t head;  // where the next message is written
+    uint16_t tail;  // the oldest message
+    uint16_t used;
+    uint8_t data[LOG_ARENA_SIZE];
+};
+
+static_assert(LOG_LINE_MAX <= 256, "message length must fit a LogEntry");
+
+static const char* const levelNames[] = {"CRITICAL", "ERROR", "WARNING",
+                                         "NOTICE",   "INFO",  "DEBUG"};
+
+RTC_DATA_ATTR static LogRing ring;
+
+// Serialises logging from concurrent tasks, which share the buffers below.
+static SemaphoreHandle_t logMutex;
+// The line being logged, formatted once in place.
+static char line[LOG_LINE_MAX];
+// A message taken from the ring to be published.
+static char pending[LOG_LINE_MAX];
+static LogEntry pendingEntry;
+// Held lines published together once connected.
+static char batch[LOG_BATCH_MAX];
+
+static PubSubClient* mqtt;
+static char mqttTopic[LOG_TOPIC_MAX];
+static LogStats stats;
+// Whether lines are held in the ring for MQTT this wake, see logHold().
+static bool holding = true;
+// Bytes of this wake's messages in the ring, which sit together at its head.
+static uint16_t wakeHeld;
+
+static void lock() {
+    if (logMutex) xSemaphoreTake(logMutex, portMAX_DELAY);
+}
+
+static void unlock() {
+    if (logMutex) xSemaphoreGive(logMutex);
+}
+
+static void ringWrite(const void* data, size_t len) {
+    size_t first = min(len, (size_t)(LOG_ARENA_SIZE - ring.head));
+    memcpy(ring.data + ring.head, data, first);
+    memcpy(ring.data, (const uint8_t*)data + first, len - first);
+    ring.head = (ring.head + len) % LOG_ARENA_SIZE;
+    ring.used += len;
+}
+
+static void ringRead(void* data, size_t len) {
+    size_t first = min(len, (size_t)(LOG_ARENA_SIZE - ring.tail));
+    memcpy(data, ring.data + ring.tail, first);
+    memcpy((uint8_t*)data + first, ring.data, len - first);
+    ring.tail = (ring.tail + len) % LOG_ARENA_SIZE;
+    ring.used -= len;
+}
+
+/**
+  Take the oldest message out of the ring into pendingEntry and pending.
+*/
+static void ringPop() {
+    ringRead(&pendingEntry, sizeof(pendingEntry));
+    ringRead(pending, pendingEntry.len);
+    pending[pendingEntry.len] = '\0';
+    if (pendingEntry.boot == ring.boot) {
+        wakeHeld -= sizeof(LogEntry) + pendingEntry.len;
+    }
+}
+
+static void ringPush(const LogEntry* entry, const char* msg) {
+    while (LOG_ARENA_SIZE - ring.used < (int)sizeof(LogEntry) + entry->len) {
+        ringPop();
+        stats.dropped++;
+    }
+    ringWrite(entry, sizeof(LogEntry));
+    ringWrite(msg, entry->len);
+    wakeHeld += sizeof(LogEntry) + entry->len;
+}
+
+/**
+  Publish the batch of held lines.
+
+  @param len the length of the batch.
+*/
+static void publishBatch(size_t len) {
+    if (len > 0) mqtt->publish(mqttTopic, (const uint8_t*)batch, len);
+}
+
+/**
+  Write the timestamp and level of a line, eg.
+  "2023-03-08T09:00:00+00:00 - INFO - ", without ezTime's heap-allocated
+  dateTime() strings.
+
+  @param buf the buffer to write to, LOG_LINE_MAX bytes.
+  @param pri the log level / priority of the message.
+  @param utc the time the message was logged.
+  @returns the length of the prefix.
+*/
+static size_t formatPrefix(char* buf, uint8_t pri, time_t utc) {
+    tmElements_t tm;
+    int32_t offsetSeconds = tzOffset(utc);
+    breakTime(utc + offsetSeconds, tm);
+    // Minutes east of UTC.
+    int offset = offsetSeconds / 60;
+    int n = snprintf(buf, LOG_LINE_MAX,
+                     "%04d-%02d-%02dT%02d:%02d:%02d%c%02d:%02d - %s - ",
+                     tm.Year + 1970, tm.Month, tm.Day, tm.Hour, tm.Minute,
+                     tm.Second, offset < 0 ? '-' : '+', abs(offset) / 60,
+                     abs(offset) % 60,
+                     pri <= LOG_DEBUG ? levelNames[pri] : levelNames[LOG_INFO]);
+    return min((size_t)n, (size_t)LOG_LINE_MAX - 1);
+}
+
+/**
+  Publish the formatted line, or keep its message in the ring until there is
+  a MQTT connection.
+
+  @param entry the message's level, time and length.
+  @param prefixLen the length of the line's prefix.
+*/
+static void publishLine(const LogEntry* entry, size_t prefixLen) {
+    if (mqtt == NULL || !mqtt->connected()) {
+        ringPush(entry, line + prefixLen);
+        return;
+    }
+    // Lines held while disconnected, from this wake or earlier ones, go out
+    // first and in order, newline-separated in as few messages as fit. They
+    // were printed to serial when logged. Each is tagged with its boot ID and
+    // sequence number, as in telemetry packets.
+    size_t batchLen = 0;
+    while (ring.used > 0) {
+        char held[LOG_LINE_MAX];
+        ringPop();
+        size_t n = formatPrefix(held, pendingEntry.pri, pendingEntry.time);
+        n += snprintf(held + n, sizeof(held) - n, "#%u.%u - %s",
+                      (unsigned)pendingEntry.boot, (unsigned)pendingEntry.seq,
+                      pending);
+        n = min(n, sizeof(held) - 1);
+        if (batchLen > 0 && batchLen + 1 + n > sizeof(batch)) {
+            publishBatch(batchLen);
+            batchLen = 0;
+        }
+        if (batchLen > 0) batch[batchLen++] = '\n';
+        memcpy(batch + batchLen, held, n);
+        batchLen += n;
+    }
+    publishBatch(batchLen);
+    mqtt->publish(mqttTopic, line);
+}
+
+/**
+  Print the formatted line and, with MQTT built in, publish it.
+
+  @param entry the message's level, time and length.
+  @param prefixLen the length of the line's prefix.
+*/
+static void emitLine(LogEntry* entry, size_t prefixLen) {
+    size_t len = prefixLen + entry->len;
+    entry->boot = ring.boot;
+    entry->seq = ring.seq++;
+    stats.lines++;
+    Serial.write((const uint8_t*)line, len);
+    Serial.write('\n');
+
+    // Without MQTT nothing would ever publish held lines, so none are held.
+    if constexpr (FEATURE_MQTT) {
+        if (holding) publishLine(entry, prefixLen);
+    }
+}
+
+/**
+  Set up the log ring for this wake. Keeps the messages held in RTC memory by
+  earlier wakes unless the ring is not valid, eg. after a power cycle.
+*/
+void logInit() {
+    if (ring.magic != LOG_RING_MAGIC || ring.head >= LOG_ARENA_SIZE ||
+        ring.tail >= LOG_ARENA_SIZE || ring.used > LOG_ARENA_SIZE ||
+        (ring.tail + ring.used) % LOG_ARENA_SIZE != ring.head) {
+        memset(&ring, 0, sizeof(ring));
+        ring.magic = LOG_RING_MAGIC;
+    }
+    ring.boot++;
+    ring.seq = 0;
+    holding = true;
+    wakeHeld = 0;
+    if (logMutex == NULL) logMutex = xSemaphoreCreateMutex();
+}
+
+/**
+  Log a message.
+
+  @param pri the log level / priority of the message, see LOG_LEVEL.
+  @param msg the message to log.
+*/
+void log(uint16_t pri, const char* msg) {
+    if (pri > LOG_LEVEL) return;
+
+    LogEntry entry = {0, 0, (uint32_t)now(), (uint8_t)pri, 0};
+    lock();
+    size_t len = formatPrefix(line, pri, entry.time);
+    size_t msgLen = strlen(msg);
+    if (msgLen > sizeof(line) - 1 - len) {
+        msgLen = sizeof(line) - 1 - len;
+        stats.truncated++;
+    }
+    memcpy(line + len, msg, msgLen);
+    line[len + msgLen] = '\0';
+    entry.len = msgLen;
+    emitLine(&entry, len);
+    unlock();
+}
+
+/**
+  Log a message with formatting.
+
+  @param pri the log level / priority of the message, see LOG_LEVEL.
+  @param fmt the format of the log message
+*/
+void logf(uint16_t pri, const char* fmt, ...) {
+    if (pri > LOG_LEVEL) return;
+
+    LogEntry entry = {0, 0, (uint32_t)now(), (uint8_t)pri, 0};
+    lock();
+    size_t len = formatPrefix(line, pri, entry.time);
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line + len, sizeof(line) - len, fmt, args);
+    va_end(args);
+    if (n < 0) n = 0;
+    if ((size_t)n > sizeof(line) - 1 - len) {
+        n = sizeof(line) - 1 - len;
+        stats.truncated++;
+    }
+    entry.len = n;
+    emitLine(&entry, len);
+    unlock();
+}
+
+/**
+  Set whether log lines are held in the ring for MQTT this wake. Lines are
+  held from logInit() until the config says whether anything will publish
+  them. Turning it off drops the lines this wake held, which only went to
+  serial.
+
+  @param hold true if remote logging or telemetry is enabled this wake.
+*/
+void logHold(bool hold) {
+    lock();
+    holding = hold;
+    if (!hold) {
+        // This wake's messages are the newest, so they end at the head.
+        ring.head = (ring.head + LOG_ARENA_SIZE - wakeHeld) % LOG_ARENA_SIZE;
+        ring.used -= wakeHeld;
+        wakeHeld = 0;
+    }
+    unlock();
+}
+
+/**
+  Publish log lines to a MQTT topic from now on, starting with those held in
+  the ring while there was no connection.
+
+  @param client the connected MQTT client.
+  @param topic the topic to publish logs to.
+*/
+void logAttachMqtt(PubSubClient* client, const char* topic) {
+    lock();
+    mqtt = client;
+    snprintf(mqttTopic, sizeof(mqttTopic), "%s", topic);
+    // Room for a batch of held lines.
+    size_t size = LOG_BATCH_MAX + LOG_TOPIC_MAX + 16;
+    if (mqtt->getBufferSize() < size) mqtt->setBufferSize(size);
+    unlock();
+}
+
+/**
+  Hand the messages held in the ring to a callback, oldest first, removing
+  them from the ring.
+
+  @param fn the callback, returning false to stop and keep the remaining
+  messages. It must not log.
+  @param ctx the context passed to fn.
+  @returns the number of messages handed over.
+*/
+int logDrain(LogDrainFn fn, void* ctx) {
+    int count = 0;
+    lock();
+    while (ring.used > 0) {
+        // Peek so a refused message stays in the ring.
+        uint16_t tail = ring.tail, used = ring.used, held = wakeHeld;
+        ringPop();
+        if (!fn(ctx, &pendingEntry, pending)) {
+            ring.tail = tail;
+            ring.used = used;
+            wakeHeld = held;
+            break;
+        }
+        count++;
+    }
+    unlock();
+    return count;
+}
+
+/**
+  Get the log line counters.
+
+  @returns the counters since boot.
+*/
+const LogStats* logStats() { return &stats; }
@@ -0,0 +1,117 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+// Enum of log verbosity levels.
+#define LOG_CRIT 0
+#define LOG_ERROR 1
+#define LOG_WARNING 2
+#define LOG_NOTICE 3
+#define LOG_INFO 4
+#define LOG_DEBUG 5
+
+#ifndef LOG_LEVEL
+// Debug logging by default.
+#define LOG_LEVEL LOG_DEBUG
+#endif
+
+// Longest log line including its timestamp and level prefix. Longer lines
+// are truncated. Keeps a line and its topic within PubSubClient's default
+// 256 byte packet.
+#define LOG_LINE_MAX 192
+// Longest MQTT topic for log lines.
+#define LOG_TOPIC_MAX 64
+// Size of the ring in RTC memory holding log messages until they can be
+// published over MQTT, across deep sleeps. When it is full the oldest
+// messages are dropped. RTC slow memory is 8KB and shared with the profiler.
+#define LOG_ARENA_SIZE 3072
+// Largest MQTT message of held lines published together once connected.
+#define LOG_BATCH_MAX 1024
+
+// A message held in the log ring, followed by its text.
+struct __attribute__((packed)) LogEntry {
+    uint16_t boot;  // boot ID of the wake that logged the message
+    uint16_t seq;   // sequence number of the message in its wake
+    uint32_t time;  // UTC time the message was logged
+    uint8_t pri;    // log level / priority
+    uint8_t len;    // length of the message text
+};
+
+// Counters of the lines logged since boot.
+struct LogStats {
+    uint32_t lines;      // lines logged
+    uint32_t truncated;  // lines cut short at LOG_LINE_MAX
+    uint32_t dropped;    // lines dropped from the ring before publishing
+};
+
+/**
+  Set up the log ring for this wake. Keeps the messages held in RTC memory by
+  earlier wakes unless the ring is not valid, eg. after a power cycle.
+*/
+void logInit();
+
+/**
+  Log a message.
+
+  @param pri the log level / priority of the message, see LOG_LEVEL.
+  @param msg the message to log.
+*/
+void log(uint16_t pri, const char* msg);
+
+/**
+  Log a message with formatting.
+
+  @param pri the log level / priority of the message, see LOG_LEVEL.
+  @param fmt the format of the log message
+*/
+void logf(uint16_t pri, const char* fmt, ...);
+
+/**
+  Set whether log lines are held in the ring for MQTT this wake. Lines are
+  held from logInit() until the config says whether anything will publish
+  them. Turning it off drops the lines this wake held, which only went to
+  serial.
+
+  @param hold true if remote logging or telemetry is enabled this wake.
+*/
+void logHold(bool hold);
+
+/**
+  Publish log lines to a MQTT topic from now on, starting with those held in
+  the ring while there was no connection.
+
+  @param client the connected MQTT client.
+  @param topic the topic to publish logs to.
+*/
+void logAttachMqtt(PubSubClient* client, const char* topic);
+
+/**
+  Receive a log message held in the ring.
+
+  @param ctx the caller's context.
+  @param entry the message's boot ID, sequence number, level, time and length.
+  @param msg the message, without timestamp or level prefix.
+  @returns true to carry on, false to stop and keep this message.
+*/
+typedef bool (*LogDrainFn)(void* ctx, const LogEntry* entry, const char* msg);
+
+/**
+  Hand the messages held in the ring to a callback, oldest first, removing
+  them from the ring.
+
+  @param fn the callback, returning false to stop and keep the remaining
+  messages. It must not log.
+  @param ctx the context passed to fn.
+  @returns the number of messages handed over.
+*/
+int logDrain(LogDrainFn fn, void* ctx);
+
+/**
+  Get the log line counters.
+
+  @returns the counters since boot.
+*/
+const LogStats* logStats();
+
+#endif
@@ -1,15 +1,216 @@
+#if defined(HAS_SDCARD)
 #include <ArduinoJson.h>
 #include <ArduinoYaml.h>
-#include <StreamUtils.h>
-#if defined(HAS_SDCARD)
 #include <SdFat.h>
+#include <StreamUtils.h>
 #endif
 
 #include "lib.h"
 #include "battery.h"
 
+// Settings of the steps run as jobs once WiFi is up.
+struct TimeJobArgs {
+    const char* ntpHost;
+    int toleranceSeconds;
+};
+
+#if defined(HAS_MQTT)
+struct MqttJobArgs {
+    const char* broker;
+    int port;
+    const char* topic;
+    const char* clientID;
+    int retries;
+};
+#endif
+
+struct CalendarJobArgs {
+    const char* url;
+    const char* imagePath;  // where the calendar is drawn from
+    int retries;
+};
+
+/**
+  Synchronize the RTC with network time if it may have drifted too far.
+*/
+static esp_err_t runTimeJob(void* ctx) {
+    TimeJobArgs* args = (TimeJobArgs*)ctx;
+    profilerBegin(PHASE_TIME);
+    esp_err_t err = configureTime(args->ntpHost, args->toleranceSeconds);
+    profilerEnd(PHASE_TIME);
+    return err;
+}
+
+#if defined(HAS_MQTT)
+/**
+  Connect to the MQTT broker for remote logging.
+*/
+static esp_err_t runMqttJob(void* ctx) {
+    MqttJobArgs* args = (MqttJobArgs*)ctx;
+    profilerBegin(PHASE_MQTT);
+    esp_err_t err = configureMQTT(args->broker, args->port, args->topic,
+                                  args->clientID, args->retries);
+    profilerEnd(PHASE_MQTT);
+    return err;
+}
+#endif
+
+#if defined(HAS_SDCARD)
+/**
+  Copy a string setting, which is left empty if missing from the file.
+
+  @returns true if it fits.
+*/
+static bool copySetting(char* dst, size_t size, const char* value) {
+    return snprintf(dst, size, "%s", value ? value : "") < (int)size;
+}
+
+/**
+  Parse the YAML config file.
+
+  @param file the open config file, left at the start.
+  @param config filled with the settings in the file.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the file is not valid YAML.
+  - ESP_ERR_INVALID_SIZE if a setting is too long.
+*/
+static esp_err_t parseConfig(File& file, DeviceConfig* config) {
+    StaticJsonDocument<768> doc;
+    ReadBufferingStream bufferedFile(file, 64);
+    DeserializationError dse = deserializeYml(doc, bufferedFile);
+    file.seek(0);
+    if (dse) {
+        logf(LOG_ERROR, "failed to deserialize YAML: %s", dse.c_str());
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Zeroed so the padding is the same each time the config is cached.
+    memset(config, 0, sizeof(*config));
+    bool fits = true;
+
+    JsonObject calendarCfg = doc["calendar"];
+    fits &= copySetting(config->calendarUrl, sizeof(config->calendarUrl),
+                        calendarCfg["url"]);
+    // A single daily_refresh_time is a schedule of one slot.
+    const char* schedule = calendarCfg["schedule"];
+    if (!schedule) {
+        schedule = calendarCfg["daily_refresh_time"] |
+                   CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME;
+    }
+    fits &= copySetting(config->calendarSchedule,
+                        sizeof(config->calendarSchedule), schedule);
+    fits &= copySetting(config->calendarDither,
+                        sizeof(config->calendarDither),
+                        calendarCfg["dither"] | "none");
+    config->calendarRetries = calendarCfg["retries"];
+
+    JsonObject wifiCfg = doc["wifi"];
+    fits &= copySetting(config->wifiSSID, sizeof(config->wifiSSID),
+                        wifiCfg["ssid"]);
+    fits &= copySetting(config->wifiPass, sizeof(config->wifiPass),
+                        wifiCfg["pass"]);
+    config->wifiRetries = wifiCfg["retries"];
+
+    JsonObject ntpCfg = doc["ntp"];
+    fits &= copySetting(config->ntpHost, sizeof(config->ntpHost),
+                        ntpCfg["host"]);
+    fits &= copySetting(config->ntpTimezone, sizeof(config->ntpTimezone),
+                        ntpCfg["timezone"]);
+    config->ntpSyncTolerance = ntpCfg["tolerance"] | NTP_DEFAULT_TOLERANCE;
+
+    JsonObject mqttLoggerCfg = doc["mqtt_logger"];
+    config->mqttLoggerEnabled = mqttLoggerCfg["enabled"];
+    fits &= copySetting(config->mqttLoggerBroker,
+                        sizeof(config->mqttLoggerBroker),
+                        mqttLoggerCfg["broker"]);
+    config->mqttLoggerPort = mqttLoggerCfg["port"];
+    fits &= copySetting(config->mqttLoggerClientID,
+                        sizeof(config->mqttLoggerClientID),
+                        mqttLoggerCfg["clientId"]);
+    fits &= copySetting(config->mqttLoggerTopic,
+                        sizeof(config->mqttLoggerTopic),
+                        mqttLoggerCfg["topic"]);
+    config->mqttLoggerRetries = mqttLoggerCfg["retries"];
+    config->mqttLoggerTelemetry = mqttLoggerCfg["telemetry"];
+
+    if (!fits) {
+        log(LOG_ERROR, "config file has a setting that is too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+#endif
+
+/**
+  Make an attempt at drawing the calendar into the display buffer.
+
+  @param imagePath the path of the calendar image on disk, or its URL.
+  @param attempt the number of earlier attempts.
+  @returns the esp_err_t code of loadImage().
+*/
+static esp_err_t drawCalendar(const char* imagePath, int attempt) {
+    logf(LOG_DEBUG, "calendar draw attempt #%d", attempt + 1);
+    if (attempt > 0) telemetryRetry(RETRY_DRAW);
+
+    profilerBegin(PHASE_DRAW);
+    board.clearDisplay();
+    esp_err_t err = loadImage(imagePath);
+    profilerEnd(PHASE_DRAW);
+    return err;
+}
+
+#if defined(HAS_SDCARD)
+/**
+  Download the calendar image to SD card, retrying on errors.
+*/
+static esp_err_t runDownloadJob(void* ctx) {
+    CalendarJobArgs* args = (CalendarJobArgs*)ctx;
+    esp_err_t err;
+    int attempts = 0;
+    do {
+        if (attempts > 0) {
+            delay(retryBackoff(attempts));
+            telemetryRetry(RETRY_DOWNLOAD);
+        }
+        logf(LOG_DEBUG, "calendar download attempt #%d", attempts + 1);
+
+        profilerBegin(PHASE_DOWNLOAD);
+        err = downloadFile(args->url, CALENDAR_IMAGE_SIZE, args->imagePath);
+        profilerEnd(PHASE_DOWNLOAD);
+        if (err == ESP_ERR_ENOTMOD) {
+            break;
+        }
+        if (err != ESP_OK) {
+            log(LOG_ERROR, "file download error");
+            telemetryError(err);
+        }
+    } while (err != ESP_OK && ++attempts <= args->retries);
+    return err;
+}
+#else
+/**
+  Make the first attempt at drawing the calendar, streamed from the server.
+*/
+static esp_err_t runDrawJob(void* ctx) {
+    return drawCalendar(((CalendarJobArgs*)ctx)->imagePath, 0);
+}
+#endif
+
 void setup() {
+    profilerInit();
+    logInit();
+    profilerBegin(PHASE_BOOT);
     Serial.begin(115200);
+#if !defined(HAS_SDCARD)
+    #include "config.h"
+    static_assert(FEATURE_MQTT || !mqttLoggerEnabled,
+                  "mqttLoggerEnabled needs the HAS_MQTT build flag");
+    // The credentials are built in, so associate and get an address while
+    // the board starts up and reads the battery.
+    profilerBegin(PHASE_WIFI);
+    startWiFi(wifiSSID, wifiPass);
+#endif
     // Init inkplate board.
     board.begin();
     // Set board to portait mode.
@@ -19,6 +220,7 @@ void setup() {
     board.rtcGetRtcData();
     time_t bootTime = board.rtcGetEpoch();
     setTime(bootTime);
+    profilerEnd(PHASE_BOOT);
 
     log(LOG_NOTICE, "##### Inkplate10 Weather Calendar wake up #####");
     esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
@@ -44,20 +246,27 @@ void setup() {
             break;
     }
 
-    // Read battery voltage.
-    double bvolt = board.readBattery();
-    logf(LOG_INFO, "battery voltage: %sv", String(bvolt, 2));
+    // Read battery voltage, averaged over samples and earlier wakes.
+    profilerBegin(PHASE_BATTERY);
+    uint16_t batteryMillivolts = batteryRead();
+    profilerEnd(PHASE_BATTERY);
+    double bvolt = batteryMillivolts / 1000.0;
+    telemetrySetBattery(bvolt);
+    logf(LOG_INFO, "battery voltage: %sv", String(bvolt, 2).c_str());
     // Get the battery percentage remaining.
-    int batteryRemainingPercent = getBatteryCapacity(bvolt);
+    int batteryRemainingPercent = batteryCapacity(batteryMillivolts);
     logf(LOG_INFO, "approx battery capacity: %d%%", batteryRemainingPercent);
 
 #if defined(HAS_SDCARD)
     // Init storage.
-    if (!board.sdCardInit()) {
+    profilerBegin(PHASE_SDCARD);
+    int16_t sdOk = board.sdCardInit();
+    profilerEnd(PHASE_SDCARD);
+    if (!sdOk) {
         const char* errMsg = "SD card init failure";
         log(LOG_ERROR, errMsg);
         displayMessage(errMsg, batteryRemainingPercent);
-        sleep(CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME);
+        sleep();
     }
 #endif
 
@@ -75,141 +284,250 @@ void setup() {
 
 #if defined(HAS_SDCARD)
     // Attempt to get config yaml file.
+    profilerBegin(PHASE_CONFIG);
     File file = sd.open(CONFIG_FILE_PATH, FILE_READ);
     if (!file) {
         const char* errMsg = "Failed to open config file";
         logf(LOG_ERROR, errMsg);
         displayMessage(errMsg, batteryRemainingPercent);
-        sleep(CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME);
+        sleep();
     }
 
-    // Attempt to parse yaml file.
-    StaticJsonDocument<768> doc;
-    ReadBufferingStream bufferedFile(file, 64);
-    DeserializationError dse = deserializeYml(doc, bufferedFile);
-    if (dse) {
-        const char* errMsg = "Failed to load config from file";
-        logf(LOG_ERROR, "failed to deserialize YAML: %s", dse.c_str());
-        displayMessage(errMsg, batteryRemainingPercent);
-        sleep(CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME);
+    // The YAML is only parsed when the file has changed since it was last
+    // parsed, otherwise the cached result is used.
+    DeviceConfig config;
+    esp_err_t cacheErr = configCacheLoad(file, &config);
+    if (cacheErr != ESP_OK) {
+        logf(LOG_INFO, "parsing config file (cache: %s)",
+             esp_err_to_name(cacheErr));
+        if (parseConfig(file, &config) != ESP_OK) {
+            const char* errMsg = "Failed to load config from file";
+            displayMessage(errMsg, batteryRemainingPercent);
+            sleep();
+        }
+        if (configCacheSave(file, &config) != ESP_OK) {
+            log(LOG_WARNING, "failed to cache config");
+        }
     }
     file.close();
+    profilerEnd(PHASE_CONFIG);
 
     // Assign config values.
-    JsonObject calendarCfg = doc["calendar"];
-    const char* calendarUrl = calendarCfg["url"];
-    const char* calendarDailyRefreshTime = calendarCfg["daily_refresh_time"];
-    int calendarRetries = calendarCfg["retries"];
+    const char* calendarUrl = config.calendarUrl;
+    const char* calendarSchedule = config.calendarSchedule;
+    const char* calendarDither = config.calendarDither;
+    int calendarRetries = config.calendarRetries;
 
     // Wifi config.
-    JsonObject wifiCfg = doc["wifi"];
-    const char* wifiSSID = wifiCfg["ssid"];
-    const char* wifiPass = wifiCfg["pass"];
-    int wifiRetries = wifiCfg["retries"];
+    const char* wifiSSID = config.wifiSSID;
+    const char* wifiPass = config.wifiPass;
+    int wifiRetries = config.wifiRetries;
 
     // NTP config.
-    const char* ntpHost = doc["ntp"]["host"];
-    const char* ntpTimezone = doc["ntp"]["timezone"];
+    const char* ntpHost = config.ntpHost;
+    const char* ntpTimezone = config.ntpTimezone;
+    int ntpSyncTolerance = config.ntpSyncTolerance;
 
     // Remote logging config.
-    JsonObject mqttLoggerCfg = doc["mqtt_logger"];
-    bool mqttLoggerEnabled = mqttLoggerCfg["enabled"];
-    const char* mqttLoggerBroker = mqttLoggerCfg["broker"];
-    int mqttLoggerPort = mqttLoggerCfg["port"];
-    const char* mqttLoggerClientID = mqttLoggerCfg["clientId"];
-    const char* mqttLoggerTopic = mqttLoggerCfg["topic"];
-    int mqttLoggerRetries = mqttLoggerCfg["retries"];
-#else
-    #include "config.h"
+    bool mqttLoggerEnabled = config.mqttLoggerEnabled;
+    const char* mqttLoggerBroker = config.mqttLoggerBroker;
+    int mqttLoggerPort = config.mqttLoggerPort;
+    const char* mqttLoggerClientID = config.mqttLoggerClientID;
+    const char* mqttLoggerTopic = config.mqttLoggerTopic;
+    int mqttLoggerRetries = config.mqttLoggerRetries;
+    bool mqttLoggerTelemetry = config.mqttLoggerTelemetry;
+
+    // Associate and get an address while the SD card is tidied up.
+    profilerBegin(PHASE_WIFI);
+    startWiFi(wifiSSID, wifiPass);
+    // Put back the previous calendar if a replace was cut short.
+    sdWriterRecover(CALENDAR_RW_PATH);
 #endif
 
-    // Attempt to connect to WiFi.
-    err = configureWiFi(wifiSSID, wifiPass, wifiRetries);
+    // Only hold log lines for MQTT if this wake will publish them.
+    logHold(FEATURE_MQTT && mqttLoggerEnabled);
+
+    // Local time comes from the built-in timezone rules, so the wake time is
+    // right even if WiFi fails below.
+    esp_err_t tzErr = configureTimezone(ntpTimezone);
+    // Fewer refreshes as the battery runs down.
+    err = configureSchedule(calendarSchedule, batteryRemainingPercent);
+    if (err != ESP_OK) {
+        logf(LOG_WARNING, "invalid schedule \"%s\", refreshing daily at %s",
+             calendarSchedule, CONFIG_DEFAULT_CALENDAR_DAILY_REFRESH_TIME);
+        telemetryError(err);
+    }
+    err = configureDither(calendarDither);
+    if (err != ESP_OK) {
+        logf(LOG_WARNING, "unknown dither \"%s\", not dithering",
+             calendarDither);
+        telemetryError(err);
+    }
+
+    // Redraw what the panel shows while WiFi associates, so the refresh at
+    // the end of the wake can be a partial update.
+    displayPreload();
+
+    // Wait for the WiFi connection started above.
+    err = waitWiFi(wifiRetries);
+    profilerEnd(PHASE_WIFI);
     if (err == ESP_ERR_TIMEOUT) {
         const char* errMsg = "wifi connect timeout";
         log(LOG_ERROR, errMsg);
+        telemetryError(err);
         displayMessage(errMsg, batteryRemainingPercent);
-        sleep(calendarDailyRefreshTime);
+        sleepRetry(RETRY_WIFI, batteryRemainingPercent);
     }
 
-    // Attempt to synchronize clocks with network time.
-    err = configureTime(ntpHost, ntpTimezone);
-    if (err != ESP_OK) {
+    // Past WiFi, NTP, the MQTT connect and the calendar download only wait
+    // on the network, so they run at once and are joined before drawing.
+    TimeJobArgs timeArgs = {ntpHost, ntpSyncTolerance};
+#if defined(HAS_MQTT)
+    MqttJobArgs mqttArgs = {mqttLoggerBroker, mqttLoggerPort, mqttLoggerTopic,
+                            mqttLoggerClientID, mqttLoggerRetries};
+#endif
+#if defined(HAS_SDCARD)
+    const char* imagePath = CALENDAR_RW_PATH;
+#else
+    const char* imagePath = calendarUrl;
+#endif
+    CalendarJobArgs calendarArgs = {calendarUrl, imagePath, calendarRetries};
+    Job jobs[] = {
+        {"ntp", runTimeJob, &timeArgs, JOB_CORE_NETWORK, ESP_OK},
+#if defined(HAS_SDCARD)
+        {"download", runDownloadJob, &calendarArgs, ARDUINO_RUNNING_CORE,
+         ESP_OK},
+#else
+        // Without an SD card the first draw streams from the server.
+        {"draw", runDrawJob, &calendarArgs, ARDUINO_RUNNING_CORE, ESP_OK},
+#endif
+#if defined(HAS_MQTT)
+        {"mqtt", runMqttJob, &mqttArgs, JOB_CORE_NETWORK, ESP_OK},
+#endif
+    };
+    Job* timeJob = &jobs[0];
+    Job* calendarJob = &jobs[1];
+
+    bool mqttLive = FEATURE_MQTT && mqttLoggerEnabled && !mqttLoggerTelemetry;
+    if constexpr (FEATURE_MQTT) {
+        if (mqttLoggerEnabled && mqttLoggerTelemetry) {
+            // Hold logs back for a single packet right before deep sleep.
+            telemetryBegin(mqttLoggerBroker, mqttLoggerPort, mqttLoggerTopic,
+                           mqttLoggerClientID, mqttLoggerRetries);
+        }
+    } else if (mqttLoggerEnabled) {
+        log(LOG_WARNING, "remote logging is not built in, see HAS_MQTT");
+    }
+    // The MQTT job is last so it can be left out.
+    jobsRun(jobs, mqttLive ? 3 : 2);
+
+    // A stale cached lease still associates, but every request after fails.
+    if (timeJob->err != ESP_OK ||
+        (calendarJob->err != ESP_OK && calendarJob->err != ESP_ERR_ENOTMOD)) {
+        dropWiFiCache();
+    }
+
+    if (timeJob->err != ESP_OK) {
         log(LOG_WARNING, "failed to synchronize RTC with network time");
+        telemetryError(timeJob->err);
+    }
+    // A timezone missing from the built-in rules needs a network lookup.
+    if (tzErr == ESP_ERR_NOT_FOUND) tzErr = configureTimezone(ntpTimezone);
+    if (tzErr != ESP_OK) {
+        logf(LOG_WARNING, "unknown timezone %s, using UTC", ntpTimezone);
+        telemetryError(tzErr);
     }
 
-    if (mqttLoggerEnabled) {
-        // Attempt to connect to MQTT broker for remote logging.
-        err = configureMQTT(mqttLoggerBroker, mqttLoggerPort, mqttLoggerTopic,
-                            mqttLoggerClientID, mqttLoggerRetries);
-        if (err == ESP_ERR_TIMEOUT) {
+#if defined(HAS_MQTT)
+    if (mqttLive) {
+        Job* mqttJob = &jobs[2];
+        if (mqttJob->err == ESP_ERR_TIMEOUT) {
             log(LOG_WARNING,
                 "failed to connect remote logging, fallback to serial");
+        } else if (profilerPublish(client, mqttLoggerTopic) != ESP_OK) {
+            // Profiles stay in RTC memory for the next connected wake.
+            log(LOG_WARNING, "failed to publish wake profiles");
         }
     }
+#endif
 
-    // Reset err state.
-    err = ESP_FAIL;
     const char* errMsg;
     int attempts = 0;
 #if defined(HAS_SDCARD)
-    const char* imagePath = CALENDAR_RW_PATH;
-
-    do {
-        logf(LOG_DEBUG, "calendar download attempt #%d", attempts + 1);
-
-        err = downloadFile(calendarUrl, CALENDAR_IMAGE_SIZE, imagePath);
-        if (err != ESP_OK) {
-            errMsg = "file download error";
-            log(LOG_ERROR, errMsg);
-            continue;
-        }
-    } while (err != ESP_OK && ++attempts <= calendarRetries);
+    err = calendarJob->err;
 
     // Disconnect and turn off WiFi radio to save power.
     // Remove the below lines if you want to stay connected
     // and logging with MQTT, though more battery will be used.
-    log(LOG_NOTICE, "disconnecting WiFi radio...");
-    WiFi.disconnect();
-    WiFi.mode(WIFI_OFF);
+    // Telemetry needs the radio until right before deep sleep.
+    if (!telemetryEnabled()) {
+        log(LOG_NOTICE, "disconnecting WiFi radio...");
+        WiFi.disconnect();
+        WiFi.mode(WIFI_OFF);
+    }
+
+    // The panel already shows the latest calendar.
+    if (err == ESP_ERR_ENOTMOD) {
+        log(LOG_NOTICE, "calendar unchanged, skipping refresh");
+        retryReset();
+        // A partial update is cheap enough for the battery status alone.
+        displayBatteryChange(batteryRemainingPercent);
+        sleep();
+    }
 
     // If we were not successful, print the error msg to the inkplate display.
     if (err != ESP_OK) {
-        displayMessage(errMsg, batteryRemainingPercent);
-        // Deep sleep until next refresh time
-        sleep(calendarDailyRefreshTime);
+        displayMessage("file download error", batteryRemainingPercent);
+        // Deep sleep until a retry or the next refresh time
+        sleepRetry(RETRY_DOWNLOAD, batteryRemainingPercent);
     }
+
+    err = drawCalendar(imagePath, attempts);
 #else
-    const char* imagePath = calendarUrl;
+    err = calendarJob->err;
 #endif
-    
-    // Reset err state.
-    err = ESP_FAIL;
-    attempts = 0;
-    do {
-        logf(LOG_DEBUG, "calendar draw attempt #%d", attempts + 1);
 
-        board.clearDisplay();
-        err = loadImage(imagePath);
-        if (err != ESP_OK) {
-            errMsg = "image load error";
-            log(LOG_ERROR, errMsg);
-            continue;
+    while (err != ESP_OK) {
+        if (err == ESP_ERR_ENOTMOD) {
+            // The panel already shows the latest calendar.
+            log(LOG_NOTICE, "calendar unchanged, skipping refresh");
+            retryReset();
+            displayBatteryChange(batteryRemainingPercent);
+            sleep();
         }
+        errMsg = "image load error";
+        log(LOG_ERROR, errMsg);
+        telemetryError(err);
+        if (++attempts > calendarRetries) break;
+        delay(retryBackoff(attempts));
+        err = drawCalendar(imagePath, attempts);
+    }
 
-        displayBatteryStatus(batteryRemainingPercent, false);
+    if (err == ESP_OK) {
+        // Keep the calendar, before the battery status is drawn over it, so
+        // the next wake only needs the tiles that change.
+        profilerBegin(PHASE_RETAIN);
+        int tilesWritten;
+        if (tilesSave(&tilesWritten) != ESP_OK) {
+            log(LOG_WARNING, "failed to store calendar tiles");
+        } else {
+            logf(LOG_DEBUG, "stored %d changed calendar tiles", tilesWritten);
+        }
+        profilerEnd(PHASE_RETAIN);
 
         // Send buffer to eink display.
-        board.display();
-    } while (err != ESP_OK && ++attempts <= calendarRetries);
-
-    // If we were not successful, print the error msg to the inkplate display.
-    if (err != ESP_OK) {
+        displayCalendar(batteryRemainingPercent);
+        calendarValidatorSave();
+        retryReset();
+    } else {
+        // If we were not successful, print the error msg to the inkplate
+        // display, and try again soon.
         displayMessage(errMsg, batteryRemainingPercent);
+        sleepRetry(RETRY_DRAW, batteryRemainingPercent);
     }
 
     // Deep sleep until next refresh time
-    sleep(calendarDailyRefreshTime);
+    sleep();
 }
 
 void loop() {}
@@ -0,0 +1,204 @@
+#include "pipeline.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include "jobs.h"
+
+// Set by the receive task after writing to the ring.
+#define PIPELINE_DATA_BIT (1 << 0)
+// Set by the decoder after reading from the ring.
+#define PIPELINE_SPACE_BIT (1 << 1)
+// Set by the receive task once it will no longer touch the pipeline.
+#define PIPELINE_DONE_BIT (1 << 2)
+// Longest a stage sleeps before checking the ring again, in case a wake up
+// was missed.
+#define PIPELINE_WAIT_MS 10
+
+// State shared by the receive task and the decoder.
+struct Pipeline {
+    SpscRing ring;
+    PngReadFn read;
+    void* readCtx;
+    volatile bool closed;     // the input has ended, set after the last write
+    volatile bool cancelled;  // the decoder has stopped reading
+    volatile int readResult;  // the last read's result, negative on error
+    PipelineStats stats;
+};
+
+// Wakes the stages when the ring changes. Never deleted, so the receive task
+// can still be returning from setting its bits when the decoder wakes.
+static EventGroupHandle_t pipelineEvents;
+
+/**
+  Set up an empty ring.
+
+  @param ring the ring.
+  @param buf the ring's storage.
+  @param size the size of buf, a power of two.
+*/
+void spscInit(SpscRing* ring, uint8_t* buf, uint32_t size) {
+    ring->buf = buf;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+/**
+  Write as much of the data as fits. Only call from the producer.
+
+  @param ring the ring.
+  @param data the bytes to write.
+  @param len the number of bytes.
+  @returns the number of bytes written, 0 if the ring is full.
+*/
+size_t spscWrite(SpscRing* ring, const uint8_t* data, size_t len) {
+    uint32_t head = ring->head;
+    // Acquire: the consumer is done with the bytes before tail.
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t n = min(len, (size_t)(ring->size - (head - tail)));
+    uint32_t at = head & (ring->size - 1);
+    size_t first = min(n, (size_t)(ring->size - at));
+    memcpy(ring->buf + at, data, first);
+    memcpy(ring->buf, data + first, n - first);
+    // Release: the bytes are in the ring before the consumer sees head.
+    __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/**
+  Read as much data as is available. Only call from the consumer.
+
+  @param ring the ring.
+  @param data the buffer to read into.
+  @param len the size of the buffer.
+  @returns the number of bytes read, 0 if the ring is empty.
+*/
+size_t spscRead(SpscRing* ring, uint8_t* data, size_t len) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t n = min(len, (size_t)(head - tail));
+    uint32_t at = tail & (ring->size - 1);
+    size_t first = min(n, (size_t)(ring->size - at));
+    memcpy(data, ring->buf + at, first);
+    memcpy(data + first, ring->buf, n - first);
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/**
+  Pull the input into the ring until it ends, fails or the decoder stops.
+*/
+static void receiveTask(void* param) {
+    Pipeline* p = (Pipeline*)param;
+    uint8_t buf[PIPELINE_READ_CHUNK];
+    int n;
+
+    do {
+        uint32_t start = micros();
+        n = p->read(p->readCtx, buf, sizeof(buf));
+        p->stats.receiveUs += micros() - start;
+        if (n <= 0) break;
+        p->stats.bytes += n;
+
+        const uint8_t* data = buf;
+        size_t left = n;
+        while (left > 0 && !p->cancelled) {
+            size_t written = spscWrite(&p->ring, data, left);
+            if (written > 0) {
+                data += written;
+                left -= written;
+                xEventGroupSetBits(pipelineEvents, PIPELINE_DATA_BIT);
+                continue;
+            }
+            start = micros();
+            xEventGroupWaitBits(pipelineEvents, PIPELINE_SPACE_BIT, pdTRUE,
+                                pdFALSE, pdMS_TO_TICKS(PIPELINE_WAIT_MS));
+            p->stats.receiveWaitUs += micros() - start;
+        }
+    } while (!p->cancelled);
+
+    p->readResult = n;
+    __atomic_store_n(&p->closed, true, __ATOMIC_RELEASE);
+    xEventGroupSetBits(pipelineEvents, PIPELINE_DATA_BIT | PIPELINE_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+/**
+  Read for the decoder from the ring, waiting for the receive task when it
+  is empty. Returns 0 at the end of the input and -1 if receiving failed.
+*/
+static int readRing(void* ctx, uint8_t* buf, size_t len) {
+    Pipeline* p = (Pipeline*)ctx;
+    for (;;) {
+        // Seen before reading, so no bytes written before closing are missed.
+        bool closed = __atomic_load_n(&p->closed, __ATOMIC_ACQUIRE);
+        size_t n = spscRead(&p->ring, buf, len);
+        if (n > 0) {
+            xEventGroupSetBits(pipelineEvents, PIPELINE_SPACE_BIT);
+            return n;
+        }
+        if (closed) return p->readResult < 0 ? -1 : 0;
+
+        uint32_t start = micros();
+        xEventGroupWaitBits(pipelineEvents, PIPELINE_DATA_BIT, pdTRUE, pdFALSE,
+                            pdMS_TO_TICKS(PIPELINE_WAIT_MS));
+        p->stats.decodeWaitUs += micros() - start;
+    }
+}
+
+/**
+  Pull a stream on a receive task pinned to the network core while it is
+  consumed on the calling task. Only one pipeline may run at a time.
+
+  @param read the input, called from the receive task only.
+  @param readCtx the context passed to read.
+  @param consume the consumer, called on the calling task.
+  @param ctx the context passed to consume.
+  @param stats filled with the time spent by each stage, may be NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the ring or the receive task cannot be allocated.
+  - the consumer's error otherwise.
+*/
+esp_err_t pipelineRun(PngReadFn read, void* readCtx,
+                      PipelineConsumeFn consume, void* ctx,
+                      PipelineStats* stats) {
+    if (pipelineEvents == NULL) pipelineEvents = xEventGroupCreate();
+    uint8_t* buf = (uint8_t*)malloc(PIPELINE_RING_SIZE);
+    if (pipelineEvents == NULL || buf == NULL) {
+        free(buf);
+        return ESP_ERR_NO_MEM;
+    }
+
+    Pipeline p;
+    memset(&p, 0, sizeof(p));
+    spscInit(&p.ring, buf, PIPELINE_RING_SIZE);
+    p.read = read;
+    p.readCtx = readCtx;
+    xEventGroupClearBits(pipelineEvents, PIPELINE_DATA_BIT |
+                                             PIPELINE_SPACE_BIT |
+                                             PIPELINE_DONE_BIT);
+
+    uint32_t start = micros();
+    if (xTaskCreatePinnedToCore(receiveTask, "receive", PIPELINE_STACK_SIZE,
+                                &p, 1, NULL, JOB_CORE_NETWORK) != pdPASS) {
+        free(buf);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = consume(readRing, &p, ctx);
+
+    // The decoder may stop before the input ends, eg. on a bad image.
+    p.cancelled = true;
+    xEventGroupSetBits(pipelineEvents, PIPELINE_SPACE_BIT);
+    xEventGroupWaitBits(pipelineEvents, PIPELINE_DONE_BIT, pdTRUE, pdFALSE,
+                        portMAX_DELAY);
+    free(buf);
+
+    p.stats.totalUs = micros() - start;
+    p.stats.decodeUs = p.stats.totalUs - p.stats.decodeWaitUs;
+    if (stats) *stats = p.stats;
+    return err;
+}
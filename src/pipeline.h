@@ -0,0 +1,98 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <Arduino.h>
+
+#include "png.h"
+
+// Receives a stream on one core while it is decoded on the other. A receive
+// task pulls the input into a lock-free single-producer single-consumer ring
+// and the calling task decodes from the ring, so neither waits on the other
+// unless the ring runs empty or full.
+
+// Size of the ring between the receive task and the decoder, a power of two.
+// A few TCP segments are enough to cover the jitter of either side.
+#define PIPELINE_RING_SIZE 16384
+// Largest read the receive task makes at once, one TCP segment.
+#define PIPELINE_READ_CHUNK 1460
+// Stack of the receive task.
+#define PIPELINE_STACK_SIZE 4096
+
+// A single-producer single-consumer byte ring. One task may write and one
+// other task may read at the same time without locks: head is only written
+// by the producer and tail by the consumer.
+struct SpscRing {
+    uint8_t* buf;
+    uint32_t size;  // a power of two
+    uint32_t head;  // total bytes written
+    uint32_t tail;  // total bytes read
+};
+
+// Time spent by each stage of a pipelined load, for its throughput.
+struct PipelineStats {
+    uint32_t bytes;          // bytes received
+    uint32_t receiveUs;      // receive task reading the input
+    uint32_t receiveWaitUs;  // receive task waiting for room in the ring
+    uint32_t decodeUs;       // decoder busy, excluding waits for data
+    uint32_t decodeWaitUs;   // decoder waiting for data
+    uint32_t totalUs;
+};
+
+/**
+  Consume a stream, eg. decode it into the framebuffer.
+
+  @param read the input to pull the stream from.
+  @param readCtx the context passed to read.
+  @param ctx the caller's context.
+  @returns the esp_err_t code of the consumer.
+*/
+typedef esp_err_t (*PipelineConsumeFn)(PngReadFn read, void* readCtx,
+                                       void* ctx);
+
+/**
+  Set up an empty ring.
+
+  @param ring the ring.
+  @param buf the ring's storage.
+  @param size the size of buf, a power of two.
+*/
+void spscInit(SpscRing* ring, uint8_t* buf, uint32_t size);
+
+/**
+  Write as much of the data as fits. Only call from the producer.
+
+  @param ring the ring.
+  @param data the bytes to write.
+  @param len the number of bytes.
+  @returns the number of bytes written, 0 if the ring is full.
+*/
+size_t spscWrite(SpscRing* ring, const uint8_t* data, size_t len);
+
+/**
+  Read as much data as is available. Only call from the consumer.
+
+  @param ring the ring.
+  @param data the buffer to read into.
+  @param len the size of the buffer.
+  @returns the number of bytes read, 0 if the ring is empty.
+*/
+size_t spscRead(SpscRing* ring, uint8_t* data, size_t len);
+
+/**
+  Pull a stream on a receive task pinned to the network core while it is
+  consumed on the calling task. Only one pipeline may run at a time.
+
+  @param read the input, called from the receive task only.
+  @param readCtx the context passed to read.
+  @param consume the consumer, called on the calling task.
+  @param ctx the context passed to consume.
+  @param stats filled with the time spent by each stage, may be NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the ring or the receive task cannot be allocated.
+  - the consumer's error otherwise.
+*/
+esp_err_t pipelineRun(PngReadFn read, void* readCtx,
+                      PipelineConsumeFn consume, void* ctx,
+                      PipelineStats* stats);
+
+#endif
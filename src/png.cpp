@@ -0,0 +1,627 @@
+#include "png.h"
+
+#define PNG_COLOR_GRAY 0
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_PALETTE 3
+#define PNG_COLOR_GRAY_ALPHA 4
+#define PNG_COLOR_RGBA 6
+
+// Huffman codes up to this length are resolved with a single table lookup.
+#define HUFFMAN_FAST_BITS 9
+
+// Luma weights used by the Inkplate driver for colour to gray conversion.
+#define LUMA(r, g, b) ((54 * (r) + 183 * (g) + 19 * (b)) >> 8)
+
+// Canonical Huffman code for inflate.
+struct Huffman {
+    uint16_t counts[16];    // number of codes of each length
+    uint16_t symbols[288];  // symbols ordered by code
+    // Bit-reversed code prefix -> (length << 12 | symbol), 0 if longer.
+    uint16_t fast[1 << HUFFMAN_FAST_BITS];
+};
+
+struct PngDecoder {
+    PngReadFn read;
+    void* readCtx;
+    PngRowFn row;
+    void* rowCtx;
+    esp_err_t err;
+
+    // Raw input.
+    uint8_t in[PNG_INPUT_CHUNK];
+    size_t inPos;
+    size_t inLen;
+    uint32_t bytesIn;
+    uint32_t idatRemaining;
+    bool idatEnd;
+
+    // Inflate.
+    uint32_t bitBuf;
+    uint8_t bitCount;
+    uint8_t* window;
+    uint32_t outTotal;
+    Huffman lit;
+    Huffman dist;
+
+    // Image.
+    uint32_t width;
+    uint32_t height;
+    uint8_t bitDepth;
+    uint8_t colorType;
+    uint8_t channels;
+    uint8_t bpp;  // bytes per complete pixel, at least 1
+    uint8_t paletteGray[256];
+
+    // Scanline assembly: filter byte followed by the row's bytes.
+    uint8_t* cur;
+    uint8_t* prev;
+    uint8_t* gray;
+    size_t rowBytes;
+    size_t rowPos;
+    uint32_t y;
+};
+
+static const uint16_t lengthBase[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                        1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distBase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                      4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                      9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t codeLengthOrder[19] = {16, 17, 18, 0, 8,  7, 9,
+                                            6,  10, 5,  11, 4, 12, 3,
+                                            13, 2,  14, 1,  15};
+
+/**
+  Read the next byte of the PNG file, pulling more input when needed.
+
+  @returns the byte, or -1 at end of input or on error.
+*/
+static int rawByte(PngDecoder* d) {
+    if (d->inPos == d->inLen) {
+        if (d->err != ESP_OK) return -1;
+        int n = d->read(d->readCtx, d->in, sizeof(d->in));
+        if (n <= 0) {
+            d->err = ESP_ERR_TIMEOUT;
+            return -1;
+        }
+        d->inPos = 0;
+        d->inLen = n;
+        d->bytesIn += n;
+    }
+    return d->in[d->inPos++];
+}
+
+static uint32_t rawU32(PngDecoder* d) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v = v << 8 | (rawByte(d) & 0xff);
+    return v;
+}
+
+static void rawSkip(PngDecoder* d, uint32_t n) {
+    while (n-- && d->err == ESP_OK) rawByte(d);
+}
+
+/**
+  Read the next byte of compressed image data, stepping over chunk
+  boundaries. Past the last IDAT chunk it returns 0 so that the bit reader
+  can look ahead harmlessly; the final block's end code stops decoding.
+*/
+static int idatByte(PngDecoder* d) {
+    while (d->idatRemaining == 0) {
+        if (d->idatEnd || d->err != ESP_OK) return 0;
+        rawSkip(d, 4);  // CRC of the previous chunk
+        uint32_t len = rawU32(d);
+        uint32_t type = rawU32(d);
+        if (type != 0x49444154) {  // "IDAT"
+            d->idatEnd = true;
+            return 0;
+        }
+        d->idatRemaining = len;
+    }
+    d->idatRemaining--;
+    return rawByte(d);
+}
+
+static inline void needBits(PngDecoder* d, uint8_t n) {
+    while (d->bitCount < n) {
+        d->bitBuf |= (uint32_t)(idatByte(d) & 0xff) << d->bitCount;
+        d->bitCount += 8;
+    }
+}
+
+static inline uint32_t getBits(PngDecoder* d, uint8_t n) {
+    if (n == 0) return 0;
+    needBits(d, n);
+    uint32_t v = d->bitBuf & ((1UL << n) - 1);
+    d->bitBuf >>= n;
+    d->bitCount -= n;
+    return v;
+}
+
+/**
+  Build a canonical Huffman code from code lengths.
+
+  @returns false if the lengths over-subscribe the code space.
+*/
+static bool buildHuffman(Huffman* h, const uint8_t* lengths, int num) {
+    uint16_t offsets[16];
+    uint16_t nextCode[16];
+
+    memset(h->counts, 0, sizeof(h->counts));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int i = 0; i < num; i++) h->counts[lengths[i]]++;
+    h->counts[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left = (left << 1) - h->counts[len];
+        if (left < 0) return false;
+    }
+
+    offsets[1] = 0;
+    nextCode[1] = 0;
+    for (int len = 1; len < 15; len++) {
+        offsets[len + 1] = offsets[len] + h->counts[len];
+        nextCode[len + 1] = (nextCode[len] + h->counts[len]) << 1;
+    }
+
+    for (int sym = 0; sym < num; sym++) {
+        uint8_t len = lengths[sym];
+        if (len == 0) continue;
+        h->symbols[offsets[len]++] = sym;
+
+        uint16_t code = nextCode[len]++;
+        if (len > HUFFMAN_FAST_BITS) continue;
+        // Codes are stored MSB first but read LSB first.
+        uint16_t rev = 0;
+        for (int i = 0; i < len; i++) rev |= ((code >> i) & 1) << (len - 1 - i);
+        for (int i = rev; i < (1 << HUFFMAN_FAST_BITS); i += 1 << len) {
+            h->fast[i] = len << 12 | sym;
+        }
+    }
+    return true;
+}
+
+static int decodeSymbol(PngDecoder* d, const Huffman* h) {
+    needBits(d, HUFFMAN_FAST_BITS);
+    uint16_t entry = h->fast[d->bitBuf & ((1 << HUFFMAN_FAST_BITS) - 1)];
+    if (entry) {
+        d->bitBuf >>= entry >> 12;
+        d->bitCount -= entry >> 12;
+        return entry & 0x0fff;
+    }
+
+    // Long code: walk the canonical code one bit at a time.
+    int sum = 0, cur = 0;
+    for (int len = 1; len < 16; len++) {
+        cur = 2 * cur + getBits(d, 1);
+        sum += h->counts[len];
+        cur -= h->counts[len];
+        if (cur < 0) return h->symbols[sum + cur];
+    }
+    d->err = ESP_ERR_INVALID_RESPONSE;
+    return -1;
+}
+
+static inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+/**
+  Unfilter the completed scanline, convert it to gray and emit it.
+*/
+static void finishRow(PngDecoder* d) {
+    uint8_t filter = d->cur[0];
+    uint8_t* c = d->cur + 1;
+    const uint8_t* p = d->prev + 1;
+    size_t n = d->rowBytes - 1;
+    uint8_t bpp = d->bpp;
+
+    switch (filter) {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < n; i++) c[i] += c[i - bpp];
+            break;
+        case 2:
+            for (size_t i = 0; i < n; i++) c[i] += p[i];
+            break;
+        case 3:
+            for (size_t i = 0; i < bpp; i++) c[i] += p[i] >> 1;
+            for (size_t i = bpp; i < n; i++) c[i] += (c[i - bpp] + p[i]) >> 1;
+            break;
+        case 4:
+            for (size_t i = 0; i < bpp; i++) c[i] += paeth(0, p[i], 0);
+            for (size_t i = bpp; i < n; i++) {
+                c[i] += paeth(c[i - bpp], p[i], p[i - bpp]);
+            }
+            break;
+        default:
+            d->err = ESP_ERR_INVALID_RESPONSE;
+            return;
+    }
+
+    uint8_t* g = d->gray;
+    uint32_t w = d->width;
+    if (d->bitDepth < 8) {
+        // Packed gray or palette indices, MSB first.
+        uint8_t depth = d->bitDepth;
+        uint8_t mask = (1 << depth) - 1;
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t bit = x * depth;
+            uint8_t v = (c[bit >> 3] >> (8 - depth - (bit & 7))) & mask;
+            g[x] = d->colorType == PNG_COLOR_PALETTE ? d->paletteGray[v]
+                                                     : v * 255 / mask;
+        }
+    } else {
+        // 8 or 16 bit samples; only the high byte of 16 bit samples is used.
+        uint8_t step = d->bitDepth / 8;
+        const uint8_t* s = c;
+        for (uint32_t x = 0; x < w; x++, s += d->bpp) {
+            uint8_t v, a = 255;
+            switch (d->colorType) {
+                case PNG_COLOR_GRAY:
+                    v = s[0];
+                    break;
+                case PNG_COLOR_PALETTE:
+                    v = d->paletteGray[s[0]];
+                    break;
+                case PNG_COLOR_GRAY_ALPHA:
+                    v = s[0];
+                    a = s[step];
+                    break;
+                case PNG_COLOR_RGB:
+                    v = LUMA(s[0], s[step], s[2 * step]);
+                    break;
+                default:
+                    v = LUMA(s[0], s[step], s[2 * step]);
+                    a = s[3 * step];
+                    break;
+            }
+            // Composite over a white background.
+            g[x] = a == 255 ? v : (v * a + 255 * (255 - a)) / 255;
+        }
+    }
+
+    d->row(d->rowCtx, d->y++, g, w);
+
+    uint8_t* t = d->prev;
+    d->prev = d->cur;
+    d->cur = t;
+    d->rowPos = 0;
+}
+
+static inline void emit(PngDecoder* d, uint8_t b) {
+    d->window[d->outTotal++ & (PNG_WINDOW_SIZE - 1)] = b;
+    d->cur[d->rowPos++] = b;
+    if (d->rowPos == d->rowBytes) finishRow(d);
+}
+
+static bool done(PngDecoder* d) {
+    return d->err != ESP_OK || d->y >= d->height;
+}
+
+static void inflateStored(PngDecoder* d) {
+    // Stored blocks start on a byte boundary.
+    getBits(d, d->bitCount & 7);
+    uint16_t len = getBits(d, 16);
+    uint16_t nlen = getBits(d, 16);
+    if ((uint16_t)~nlen != len) {
+        d->err = ESP_ERR_INVALID_RESPONSE;
+        return;
+    }
+    while (len-- && !done(d)) emit(d, getBits(d, 8));
+}
+
+static void inflateCodes(PngDecoder* d) {
+    while (!done(d)) {
+        int sym = decodeSymbol(d, &d->lit);
+        if (sym < 256) {
+            if (sym < 0) return;
+            emit(d, sym);
+            continue;
+        }
+        if (sym == 256) return;
+
+        sym -= 257;
+        if (sym >= 29) {
+            d->err = ESP_ERR_INVALID_RESPONSE;
+            return;
+        }
+        uint16_t len = lengthBase[sym] + getBits(d, lengthExtra[sym]);
+        int dsym = decodeSymbol(d, &d->dist);
+        if (dsym < 0 || dsym >= 30) {
+            d->err = ESP_ERR_INVALID_RESPONSE;
+            return;
+        }
+        uint32_t dist = distBase[dsym] + getBits(d, distExtra[dsym]);
+        if (dist > d->outTotal) {
+            d->err = ESP_ERR_INVALID_RESPONSE;
+            return;
+        }
+        uint32_t from = d->outTotal - dist;
+        while (len-- && !done(d)) {
+            emit(d, d->window[from++ & (PNG_WINDOW_SIZE - 1)]);
+        }
+    }
+}
+
+static void buildFixed(PngDecoder* d) {
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    buildHuffman(&d->lit, lengths, 288);
+    memset(lengths, 5, 30);
+    buildHuffman(&d->dist, lengths, 30);
+}
+
+static bool buildDynamic(PngDecoder* d) {
+    uint8_t lengths[288 + 32];
+    uint16_t hlit = getBits(d, 5) + 257;
+    uint8_t hdist = getBits(d, 5) + 1;
+    uint8_t hclen = getBits(d, 4) + 4;
+
+    memset(lengths, 0, 19);
+    for (int i = 0; i < hclen; i++) {
+        lengths[codeLengthOrder[i]] = getBits(d, 3);
+    }
+    // Decode the code lengths with the literal table as scratch space.
+    if (!buildHuffman(&d->lit, lengths, 19)) return false;
+
+    int n = 0;
+    while (n < hlit + hdist && d->err == ESP_OK) {
+        int sym = decodeSymbol(d, &d->lit);
+        uint8_t rep, val = 0;
+        if (sym < 0) return false;
+        if (sym < 16) {
+            lengths[n++] = sym;
+            continue;
+        } else if (sym == 16) {
+            if (n == 0) return false;
+            val = lengths[n - 1];
+            rep = 3 + getBits(d, 2);
+        } else if (sym == 17) {
+            rep = 3 + getBits(d, 3);
+        } else {
+            rep = 11 + getBits(d, 7);
+        }
+        if (n + rep > hlit + hdist) return false;
+        while (rep--) lengths[n++] = val;
+    }
+
+    return d->err == ESP_OK && buildHuffman(&d->lit, lengths, hlit) &&
+           buildHuffman(&d->dist, lengths + hlit, hdist);
+}
+
+static void inflate(PngDecoder* d) {
+    uint8_t cmf = getBits(d, 8);
+    uint8_t flg = getBits(d, 8);
+    if ((cmf & 0x0f) != 8 || (cmf << 8 | flg) % 31 != 0 || (flg & 0x20)) {
+        d->err = ESP_ERR_INVALID_RESPONSE;
+        return;
+    }
+
+    bool last = false;
+    while (!last && !done(d)) {
+        last = getBits(d, 1);
+        switch (getBits(d, 2)) {
+            case 0:
+                inflateStored(d);
+                break;
+            case 1:
+                buildFixed(d);
+                inflateCodes(d);
+                break;
+            case 2:
+                if (!buildDynamic(d)) {
+                    if (d->err == ESP_OK) d->err = ESP_ERR_INVALID_RESPONSE;
+                    return;
+                }
+                inflateCodes(d);
+                break;
+            default:
+                d->err = ESP_ERR_INVALID_RESPONSE;
+                return;
+        }
+    }
+}
+
+/**
+  Check a colour type and bit depth pair against the combinations the PNG
+  specification allows. Anything else would break the row unpacking.
+*/
+static bool validFormat(uint8_t colorType, uint8_t bitDepth) {
+    switch (colorType) {
+        case PNG_COLOR_GRAY:
+            return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 ||
+                   bitDepth == 8 || bitDepth == 16;
+        case PNG_COLOR_PALETTE:
+            return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 ||
+                   bitDepth == 8;
+        case PNG_COLOR_RGB:
+        case PNG_COLOR_GRAY_ALPHA:
+        case PNG_COLOR_RGBA:
+            return bitDepth == 8 || bitDepth == 16;
+        default:
+            return false;
+    }
+}
+
+/**
+  Read chunks up to the first IDAT, collecting the header and palette.
+*/
+static esp_err_t readHeader(PngDecoder* d) {
+    static const uint8_t signature[8] = {0x89, 'P',  'N',  'G',
+                                         '\r', '\n', 0x1a, '\n'};
+    for (int i = 0; i < 8; i++) {
+        if (rawByte(d) != signature[i]) {
+            return d->err != ESP_OK ? d->err : ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    uint16_t paletteSize = 0;
+    bool first = true;
+    while (d->err == ESP_OK) {
+        uint32_t len = rawU32(d);
+        uint32_t type = rawU32(d);
+
+        if (first && (type != 0x49484452 || len != 13)) {  // "IHDR"
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        first = false;
+
+        switch (type) {
+            case 0x49484452: {  // "IHDR"
+                d->width = rawU32(d);
+                d->height = rawU32(d);
+                d->bitDepth = rawByte(d);
+                d->colorType = rawByte(d);
+                if (d->err == ESP_OK &&
+                    !validFormat(d->colorType, d->bitDepth)) {
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+                rawSkip(d, 2);  // compression and filter method
+                if (rawByte(d) != 0) return ESP_ERR_NOT_SUPPORTED;
+                break;
+            }
+            case 0x504c5445:  // "PLTE"
+                for (uint32_t i = 0; i < len / 3; i++) {
+                    uint8_t r = rawByte(d), g = rawByte(d), b = rawByte(d);
+                    if (i < 256) d->paletteGray[i] = LUMA(r, g, b);
+                }
+                paletteSize = len / 3 > 256 ? 256 : len / 3;
+                rawSkip(d, len % 3);
+                break;
+            case 0x74524e53:  // "tRNS"
+                // Composite transparent palette entries over white.
+                for (uint32_t i = 0; i < len; i++) {
+                    uint8_t a = rawByte(d);
+                    if (d->colorType == PNG_COLOR_PALETTE && i < paletteSize) {
+                        uint8_t v = d->paletteGray[i];
+                        d->paletteGray[i] = (v * a + 255 * (255 - a)) / 255;
+                    }
+                }
+                break;
+            case 0x49444154:  // "IDAT"
+                d->idatRemaining = len;
+                return ESP_OK;
+            case 0x49454e44:  // "IEND"
+                return ESP_ERR_INVALID_RESPONSE;
+            default:
+                rawSkip(d, len);
+                break;
+        }
+        if (type != 0x49444154) rawSkip(d, 4);  // CRC
+    }
+    return d->err;
+}
+
+/**
+  Decode a PNG incrementally. Input is pulled through read() as the decoder
+  needs it and each row is handed to row() as soon as it is unfiltered, so
+  neither the compressed file nor the decoded image is ever held in memory.
+  All colour types and bit depths are converted to 8-bit gray, with alpha
+  composited over white. Interlaced images are not supported.
+
+  @param read the input callback.
+  @param readCtx the context passed to read().
+  @param row the output callback.
+  @param rowCtx the context passed to row().
+  @param info filled with details of the image, may be NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if decoder memory cannot be allocated.
+  - ESP_ERR_TIMEOUT if read() fails or input ends early.
+  - ESP_ERR_NOT_SUPPORTED if the image is interlaced.
+  - ESP_ERR_INVALID_RESPONSE if the data is not a valid PNG.
+*/
+esp_err_t pngDecode(PngReadFn read, void* readCtx, PngRowFn row, void* rowCtx,
+                    PngInfo* info) {
+    PngDecoder* d = (PngDecoder*)calloc(1, sizeof(PngDecoder));
+    if (!d) {
+        return ESP_ERR_NO_MEM;
+    }
+    d->read = read;
+    d->readCtx = readCtx;
+    d->row = row;
+    d->rowCtx = rowCtx;
+    d->err = ESP_OK;
+    for (int i = 0; i < 256; i++) d->paletteGray[i] = i;
+
+    esp_err_t err = readHeader(d);
+    size_t memoryUsed = sizeof(PngDecoder);
+    if (err == ESP_OK) {
+        switch (d->colorType) {
+            case PNG_COLOR_GRAY:
+            case PNG_COLOR_PALETTE:
+                d->channels = 1;
+                break;
+            case PNG_COLOR_GRAY_ALPHA:
+                d->channels = 2;
+                break;
+            case PNG_COLOR_RGB:
+                d->channels = 3;
+                break;
+            case PNG_COLOR_RGBA:
+                d->channels = 4;
+                break;
+            default:
+                err = ESP_ERR_INVALID_RESPONSE;
+                break;
+        }
+        if (d->width == 0 || d->height == 0 || d->width > 0x4000) {
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    if (err == ESP_OK) {
+        uint32_t bits = d->width * d->channels * d->bitDepth;
+        d->bpp = max(1, d->channels * d->bitDepth / 8);
+        d->rowBytes = 1 + (bits + 7) / 8;
+        d->window = (uint8_t*)malloc(PNG_WINDOW_SIZE);
+        d->cur = (uint8_t*)calloc(1, d->rowBytes);
+        d->prev = (uint8_t*)calloc(1, d->rowBytes);
+        d->gray = (uint8_t*)malloc(d->width);
+        memoryUsed += PNG_WINDOW_SIZE + 2 * d->rowBytes + d->width;
+        if (!d->window || !d->cur || !d->prev || !d->gray) {
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (err == ESP_OK) {
+        inflate(d);
+        err = d->err;
+        if (err == ESP_OK && d->y < d->height) {
+            err = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    if (info) {
+        info->width = d->width;
+        info->height = d->height;
+        info->bitDepth = d->bitDepth;
+        info->colorType = d->colorType;
+        info->bytesIn = d->bytesIn;
+        info->memoryUsed = memoryUsed;
+    }
+
+    free(d->window);
+    free(d->cur);
+    free(d->prev);
+    free(d->gray);
+    free(d);
+
+    return err;
+}
@@ -0,0 +1,63 @@
+#ifndef PNG_H
+#define PNG_H
+#include <Arduino.h>
+
+// Size of the buffer input is pulled into.
+#define PNG_INPUT_CHUNK 2048
+// Deflate history window. PNG encoders use the maximum 32K window, so a
+// back-reference can reach this far into previously decoded data.
+#define PNG_WINDOW_SIZE 32768
+
+/**
+  Pull input for the decoder.
+
+  @param ctx the caller's context.
+  @param buf the buffer to fill.
+  @param len the maximum number of bytes to read.
+  @returns the number of bytes read, 0 at end of input or negative on error.
+*/
+typedef int (*PngReadFn)(void* ctx, uint8_t* buf, size_t len);
+
+/**
+  Receive one decoded row.
+
+  @param ctx the caller's context.
+  @param y the row number.
+  @param gray the row's pixels as 8-bit gray (0 black, 255 white).
+  @param width the number of pixels in the row.
+*/
+typedef void (*PngRowFn)(void* ctx, int y, const uint8_t* gray, int width);
+
+// Summary of a decoded image.
+struct PngInfo {
+    uint32_t width;
+    uint32_t height;
+    uint8_t bitDepth;
+    uint8_t colorType;
+    uint32_t bytesIn;      // PNG bytes consumed
+    size_t memoryUsed;     // decoder working memory
+};
+
+/**
+  Decode a PNG incrementally. Input is pulled through read() as the decoder
+  needs it and each row is handed to row() as soon as it is unfiltered, so
+  neither the compressed file nor the decoded image is ever held in memory.
+  All colour types and bit depths are converted to 8-bit gray, with alpha
+  composited over white. Interlaced images are not supported.
+
+  @param read the input callback.
+  @param readCtx the context passed to read().
+  @param row the output callback.
+  @param rowCtx the context passed to row().
+  @param info filled with details of the image, may be NULL.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if decoder memory cannot be allocated.
+  - ESP_ERR_TIMEOUT if read() fails or input ends early.
+  - ESP_ERR_NOT_SUPPORTED if the image is interlaced.
+  - ESP_ERR_INVALID_RESPONSE if the data is not a valid PNG.
+*/
+esp_err_t pngDecode(PngReadFn read, void* readCtx, PngRowFn row, void* rowCtx,
+                    PngInfo* info);
+
+#endif
@@ -0,0 +1,236 @@
+#include "profiler.h"
+
+#include <freertos/semphr.h>
+
+// Profiles survive deep sleep so they can be published on a later wake. The
+// ring holds the wake being recorded plus PROFILER_HISTORY completed ones.
+RTC_DATA_ATTR WakeProfile profiles[PROFILER_HISTORY + 1];
+RTC_DATA_ATTR uint8_t profileHead = 0;
+RTC_DATA_ATTR uint32_t profilerBootCount = 0;
+
+// Index of the open span of each phase, -1 when the phase is not running.
+static int8_t openSpans[PHASE_COUNT];
+// Phases may be timed from concurrent tasks.
+static SemaphoreHandle_t spansMutex;
+
+static const char* phaseNames[PHASE_COUNT] = {
+    "boot", "battery", "sdcard",  "config", "wifi",    "time",
+    "mqtt", "download", "draw", "display", "message", "retain",
+};
+
+/**
+  Start profiling a new wake. Retains the previous wake's profile in RTC
+  memory until it has been published.
+*/
+void profilerInit() {
+    if (profiles[profileHead].numSpans > 0) {
+        // Keep the previous wake; this overwrites the oldest one if the
+        // history was never published.
+        profileHead = (profileHead + 1) % (PROFILER_HISTORY + 1);
+    }
+
+    WakeProfile* p = &profiles[profileHead];
+    memset(p, 0, sizeof(WakeProfile));
+    p->bootCount = ++profilerBootCount;
+    memset(openSpans, -1, sizeof(openSpans));
+    if (spansMutex == NULL) spansMutex = xSemaphoreCreateMutex();
+}
+
+/**
+  Mark the start of a phase.
+
+  @param phase the phase, see PHASE_COUNT.
+*/
+void profilerBegin(uint8_t phase) {
+    WakeProfile* p = &profiles[profileHead];
+    if (phase >= PHASE_COUNT) return;
+    xSemaphoreTake(spansMutex, portMAX_DELAY);
+    if (p->numSpans >= PROFILER_MAX_SPANS) {
+        p->droppedSpans++;
+    } else {
+        PhaseSpan* span = &p->spans[p->numSpans];
+        span->phase = phase;
+        span->startUs = micros();
+        span->durationUs = 0;
+        openSpans[phase] = p->numSpans++;
+    }
+    xSemaphoreGive(spansMutex);
+}
+
+/**
+  Mark the end of a phase started with profilerBegin().
+
+  @param phase the phase, see PHASE_COUNT.
+*/
+void profilerEnd(uint8_t phase) {
+    if (phase >= PHASE_COUNT) return;
+    xSemaphoreTake(spansMutex, portMAX_DELAY);
+    if (openSpans[phase] >= 0) {
+        PhaseSpan* span = &profiles[profileHead].spans[openSpans[phase]];
+        span->durationUs = micros() - span->startUs;
+        openSpans[phase] = -1;
+    }
+    xSemaphoreGive(spansMutex);
+}
+
+/**
+  Close the current wake's profile. Call right before entering deep sleep.
+
+  @param epoch the current time, UTC.
+*/
+void profilerFinish(time_t epoch) {
+    for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+        profilerEnd(phase);
+    }
+
+    WakeProfile* p = &profiles[profileHead];
+    p->epoch = epoch;
+    p->awakeUs = micros();
+}
+
+/**
+  Get the profile of the current wake.
+
+  @returns the profile being recorded.
+*/
+const WakeProfile* profilerCurrent() { return &profiles[profileHead]; }
+
+/**
+  Get the printable name of a phase.
+
+  @param phase the phase, see PHASE_COUNT.
+  @returns the phase name.
+*/
+const char* phaseName(uint8_t phase) {
+    return phase < PHASE_COUNT ? phaseNames[phase] : "unknown";
+}
+
+/**
+  Append formatted text to a buffer, stopping at its end.
+
+  @param buf the buffer.
+  @param size the size of the buffer.
+  @param len the length of the text already in the buffer.
+  @param fmt the format of the text to append.
+  @returns the new length, size if the text did not fit.
+*/
+static size_t appendf(char* buf, size_t size, size_t len, const char* fmt,
+                      ...) {
+    if (len >= size) return size;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + len, size - len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - len) return size;
+    return len + n;
+}
+
+/**
+  Publish the profiles of all previous, unpublished wakes as one JSON record.
+
+  @param client a connected MQTT client.
+  @param topic the topic to publish to.
+  @returns the esp_err_t code:
+  - ESP_OK if successful or there was nothing to publish.
+  - ESP_FAIL if the record does not fit its buffer or the MQTT publish fails.
+*/
+esp_err_t profilerPublish(PubSubClient& client, const char* topic) {
+    static char record[4096];
+    size_t len = 0;
+    int published = 0;
+
+    len = appendf(record, sizeof(record), len, "{\"profiles\":[");
+    // Oldest first, stopping short of the wake being recorded.
+    for (int i = 1; i <= PROFILER_HISTORY; i++) {
+        WakeProfile* p =
+            &profiles[(profileHead + i) % (PROFILER_HISTORY + 1)];
+        if (p->numSpans == 0 || p->published) continue;
+
+        len = appendf(record, sizeof(record), len,
+                      "%s{\"boot\":%u,\"epoch\":%u,\"awake_us\":%u,"
+                      "\"dropped\":%u,\"spans\":[",
+                      published ? "," : "", p->bootCount, p->epoch,
+                      p->awakeUs, p->droppedSpans);
+        for (uint8_t s = 0; s < p->numSpans && len < sizeof(record); s++) {
+            len = appendf(record, sizeof(record), len, "%s[\"%s\",%u,%u]",
+                          s ? "," : "", phaseName(p->spans[s].phase),
+                          p->spans[s].startUs, p->spans[s].durationUs);
+        }
+        len = appendf(record, sizeof(record), len, "]}");
+        published++;
+    }
+    len = appendf(record, sizeof(record), len, "]}");
+
+    if (published == 0) return ESP_OK;
+    if (len >= sizeof(record)) return ESP_FAIL;
+
+    if (client.getBufferSize() < len + strlen(topic) + 16) {
+        client.setBufferSize(len + strlen(topic) + 16);
+    }
+    if (!client.publish(topic, (const uint8_t*)record, len)) {
+        return ESP_FAIL;
+    }
+
+    for (int i = 1; i <= PROFILER_HISTORY; i++) {
+        profiles[(profileHead + i) % (PROFILER_HISTORY + 1)].published = true;
+    }
+
+    return ESP_OK;
+}
+
+#if defined(SIMULATOR)
+/**
+  Write all retained profiles to a Chrome trace file (chrome://tracing,
+  ui.perfetto.dev). Each wake appears as its own process.
+
+  @param path the file to write.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_FAIL if the file could not be written.
+*/
+esp_err_t profilerExportTrace(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        return ESP_FAIL;
+    }
+
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int i = 1; i <= PROFILER_HISTORY + 1; i++) {
+        WakeProfile* p =
+            &profiles[(profileHead + i) % (PROFILER_HISTORY + 1)];
+        if (p->numSpans == 0) continue;
+
+        fprintf(fp,
+                "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+                "\"args\":{\"name\":\"wake #%u\"}}",
+                first ? "" : ",\n", p->bootCount, p->bootCount);
+        first = false;
+        fprintf(fp,
+                ",\n{\"name\":\"awake\",\"cat\":\"wake\",\"ph\":\"X\","
+                "\"ts\":0,\"dur\":%u,\"pid\":%u,\"tid\":0}",
+                p->awakeUs, p->bootCount);
+        // A row per phase, as phases run concurrently once WiFi is up.
+        bool named[PHASE_COUNT] = {false};
+        for (uint8_t s = 0; s < p->numSpans; s++) {
+            uint8_t phase = p->spans[s].phase;
+            if (!named[phase]) {
+                fprintf(fp,
+                        ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                        "\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        p->bootCount, phase + 1, phaseName(phase));
+                named[phase] = true;
+            }
+            fprintf(fp,
+                    ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\","
+                    "\"ts\":%u,\"dur\":%u,\"pid\":%u,\"tid\":%u}",
+                    phaseName(phase), p->spans[s].startUs,
+                    p->spans[s].durationUs, p->bootCount, phase + 1);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    return ESP_OK;
+}
+#endif
@@ -0,0 +1,110 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+// Phases of the wake cycle timed by the profiler.
+#define PHASE_BOOT 0       // board init and RTC read
+#define PHASE_BATTERY 1    // battery voltage read
+#define PHASE_SDCARD 2     // SD card init
+#define PHASE_CONFIG 3     // config file parse
+#define PHASE_WIFI 4       // WiFi association and DHCP
+#define PHASE_TIME 5       // NTP sync and RTC update
+#define PHASE_MQTT 6       // MQTT broker connect
+#define PHASE_DOWNLOAD 7   // calendar image download
+#define PHASE_DRAW 8       // image decode into the framebuffer
+#define PHASE_DISPLAY 9    // e-ink panel refresh
+#define PHASE_MESSAGE 10   // error/notice message screen
+#define PHASE_RETAIN 11    // storing the drawn calendar in flash
+#define PHASE_COUNT 12
+
+// Max number of timed spans kept per wake. Retries add extra spans.
+#define PROFILER_MAX_SPANS 24
+// Number of completed wakes kept in RTC memory until they are published.
+#define PROFILER_HISTORY 4
+
+// A timed phase, relative to the start of the wake.
+struct PhaseSpan {
+    uint8_t phase;
+    uint32_t startUs;
+    uint32_t durationUs;
+};
+
+// Phase timings of a single wake.
+struct WakeProfile {
+    uint32_t bootCount;
+    uint32_t epoch;    // UTC time the wake ended, 0 if it never reached sleep
+    uint32_t awakeUs;  // total time awake
+    uint8_t numSpans;
+    uint8_t droppedSpans;
+    bool published;
+    PhaseSpan spans[PROFILER_MAX_SPANS];
+};
+
+/**
+  Start profiling a new wake. Retains the previous wake's profile in RTC
+  memory until it has been published.
+*/
+void profilerInit();
+
+/**
+  Mark the start of a phase.
+
+  @param phase the phase, see PHASE_COUNT.
+*/
+void profilerBegin(uint8_t phase);
+
+/**
+  Mark the end of a phase started with profilerBegin().
+
+  @param phase the phase, see PHASE_COUNT.
+*/
+void profilerEnd(uint8_t phase);
+
+/**
+  Close the current wake's profile. Call right before entering deep sleep.
+
+  @param epoch the current time, UTC.
+*/
+void profilerFinish(time_t epoch);
+
+/**
+  Get the profile of the current wake.
+
+  @returns the profile being recorded.
+*/
+const WakeProfile* profilerCurrent();
+
+/**
+  Get the printable name of a phase.
+
+  @param phase the phase, see PHASE_COUNT.
+  @returns the phase name.
+*/
+const char* phaseName(uint8_t phase);
+
+/**
+  Publish the profiles of all previous, unpublished wakes as one JSON record.
+
+  @param client a connected MQTT client.
+  @param topic the topic to publish to.
+  @returns the esp_err_t code:
+  - ESP_OK if successful or there was nothing to publish.
+  - ESP_FAIL if the record does not fit its buffer or the MQTT publish fails.
+*/
+esp_err_t profilerPublish(PubSubClient& client, const char* topic);
+
+#if defined(SIMULATOR)
+/**
+  Write all retained profiles to a Chrome trace file (chrome://tracing,
+  ui.perfetto.dev). Each wake appears as its own process.
+
+  @param path the file to write.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_FAIL if the file could not be written.
+*/
+esp_err_t profilerExportTrace(const char* path);
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+#include "refresh.h"
+
+#include "lib.h"
+
+#define REFRESH_MAGIC 0x31464552  // "REF1"
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+// What the panel shows, kept in RTC memory across deep sleep.
+struct RefreshState {
+    uint32_t magic;
+    uint32_t shownHash;  // of the 1-bit frame shown, 0 if it shows gray
+    uint8_t partials;    // partial updates since the last full refresh
+};
+
+RTC_DATA_ATTR static RefreshState state;
+
+// The frame the panel shows packed as 1-bit, if preloaded.
+static uint8_t* shown = NULL;
+
+/**
+  Count the pixels of the 3-bit buffer that are neither black nor white,
+  stopping once there are too many for 1-bit.
+*/
+static int countGray() {
+    int gray = 0;
+    for (int i = 0; i < E_INK_WIDTH * E_INK_HEIGHT / 2; i++) {
+        uint8_t b = board.DMemory4Bit[i];
+        uint8_t hi = b >> 4 & 7, lo = b & 7;
+        gray += (hi != 0 && hi != 7) + (lo != 0 && lo != 7);
+        if (gray > REFRESH_MAX_GRAY_PIXELS) break;
+    }
+    return gray;
+}
+
+/**
+  Pack the 3-bit buffer as 1-bit, a set bit for black, the first pixel of
+  each byte in bit 7.
+
+  @returns the FNV-1a hash of the packed frame.
+*/
+static uint32_t packMono(uint8_t* mono) {
+    uint32_t hash = FNV_OFFSET;
+    const uint8_t* p = board.DMemory4Bit;
+    for (int i = 0; i < REFRESH_MONO_SIZE; i++, p += 4) {
+        uint8_t bits = 0;
+        for (int j = 0; j < 4; j++) {
+            bits = bits << 2 | ((p[j] >> 4 & 7) < REFRESH_MONO_THRESHOLD) << 1 |
+                   ((p[j] & 7) < REFRESH_MONO_THRESHOLD);
+        }
+        mono[i] = bits;
+        hash = (hash ^ bits) * FNV_PRIME;
+    }
+    // 0 means a gray frame.
+    return hash ? hash : 1;
+}
+
+/**
+  Draw a packed frame into the board's 1-bit buffer, in the panel's native
+  orientation.
+*/
+static void drawMono(const uint8_t* mono) {
+    board.clearDisplay();
+    for (int i = 0; i < REFRESH_MONO_SIZE; i++) {
+        if (mono[i] == 0) continue;
+        int x = i * 8 % E_INK_WIDTH, y = i * 8 / E_INK_WIDTH;
+        for (int j = 0; j < 8; j++) {
+            if (mono[i] & 0x80 >> j) board.drawPixel(x + j, y, BLACK);
+        }
+    }
+}
+
+static void checkState() {
+    if (state.magic != REFRESH_MAGIC) {
+        memset(&state, 0, sizeof(state));
+        state.magic = REFRESH_MAGIC;
+    }
+}
+
+/**
+  Check whether the panel shows a 1-bit frame.
+
+  @returns true if the last refresh was a 1-bit one.
+*/
+bool refreshShowsMono() {
+    checkState();
+    return state.shownHash != 0;
+}
+
+/**
+  Check whether the next refresh could be a partial update, so preloading
+  the frame the panel shows is worth redrawing it.
+
+  @returns true if the panel shows a 1-bit frame and fewer than
+  REFRESH_MAX_PARTIALS partial updates were made since the last full
+  refresh.
+*/
+bool refreshCanPartial() {
+    return refreshShowsMono() && state.partials < REFRESH_MAX_PARTIALS;
+}
+
+/**
+  Take the frame in the 3-bit buffer as the one the panel shows, so the next
+  refreshDisplay() can be a partial update.
+
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if the frame is not the one last shown.
+  - ESP_ERR_NO_MEM if there is no memory to keep it.
+*/
+esp_err_t refreshPreload() {
+    if (!refreshCanPartial() || countGray() > REFRESH_MAX_GRAY_PIXELS) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (shown == NULL) shown = (uint8_t*)malloc(REFRESH_MONO_SIZE);
+    if (shown == NULL) return ESP_ERR_NO_MEM;
+
+    if (packMono(shown) != state.shownHash) {
+        free(shown);
+        shown = NULL;
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+/**
+  Show the frame in the 3-bit buffer on the panel in the cheapest way that
+  shows it.
+
+  @returns how it was shown, REFRESH_GRAY, REFRESH_MONO, REFRESH_PARTIAL or
+  REFRESH_NONE.
+*/
+uint8_t refreshDisplay() {
+    checkState();
+    uint8_t* mono = NULL;
+    if (countGray() <= REFRESH_MAX_GRAY_PIXELS) {
+        mono = (uint8_t*)malloc(REFRESH_MONO_SIZE);
+    }
+    if (mono == NULL) {
+        board.display();
+        state.shownHash = 0;
+        state.partials = 0;
+        free(shown);
+        shown = NULL;
+        return REFRESH_GRAY;
+    }
+
+    uint32_t hash = packMono(mono);
+    if (hash == state.shownHash) {
+        free(mono);
+        return REFRESH_NONE;
+    }
+    bool partial = shown != NULL && refreshCanPartial();
+    // The 1-bit buffer is in the panel's orientation, and changing mode
+    // clears the buffers.
+    uint8_t rotation = board.getRotation();
+    board.selectDisplayMode(INKPLATE_1BIT);
+    board.setRotation(0);
+    if (partial) {
+        drawMono(shown);
+        board.preloadScreen();
+    }
+    drawMono(mono);
+    board.setRotation(rotation);
+    if (partial) {
+        board.partialUpdate();
+        state.partials++;
+    } else {
+        board.display();
+        state.partials = 0;
+    }
+    board.selectDisplayMode(INKPLATE_3BIT);
+
+    state.shownHash = hash;
+    free(shown);
+    shown = mono;
+    return partial ? REFRESH_PARTIAL : REFRESH_MONO;
+}
@@ -0,0 +1,70 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+#include <Inkplate.h>
+
+// Picks how the panel is refreshed. A full 3-bit refresh shows gray but is
+// the slowest and draws the most power; a full 1-bit refresh shows only
+// black and white, faster; and a 1-bit partial update drives only the
+// pixels that changed, faster still. A frame drawn in the 3-bit buffer that
+// is black and white, bar a few antialiased pixels such as the battery
+// icon's, is shown in 1-bit. It is shown with a partial update when the
+// frame the panel shows was redrawn and passed to refreshPreload(), since
+// the panel's contents do not survive deep sleep in the driver's buffers.
+//
+// Partial updates leave ghosting that builds up, so after
+// REFRESH_MAX_PARTIALS of them the next refresh is a full one, which
+// cleans the panel.
+
+// Most gray pixels in a frame that is still shown in 1-bit.
+#define REFRESH_MAX_GRAY_PIXELS 1024
+// Gray levels below this are black in 1-bit, the rest white.
+#define REFRESH_MONO_THRESHOLD 4
+// Most partial updates in a row before a full refresh.
+#define REFRESH_MAX_PARTIALS 8
+// Size of a frame packed as 1-bit.
+#define REFRESH_MONO_SIZE (E_INK_WIDTH * E_INK_HEIGHT / 8)
+
+// Ways of refreshing the panel.
+#define REFRESH_GRAY 0
+#define REFRESH_MONO 1
+#define REFRESH_PARTIAL 2
+#define REFRESH_NONE 3  // the panel already shows the frame
+
+/**
+  Check whether the panel shows a 1-bit frame.
+
+  @returns true if the last refresh was a 1-bit one.
+*/
+bool refreshShowsMono();
+
+/**
+  Check whether the next refresh could be a partial update, so preloading
+  the frame the panel shows is worth redrawing it.
+
+  @returns true if the panel shows a 1-bit frame and fewer than
+  REFRESH_MAX_PARTIALS partial updates were made since the last full
+  refresh.
+*/
+bool refreshCanPartial();
+
+/**
+  Take the frame in the 3-bit buffer as the one the panel shows, so the next
+  refreshDisplay() can be a partial update.
+
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if the frame is not the one last shown.
+  - ESP_ERR_NO_MEM if there is no memory to keep it.
+*/
+esp_err_t refreshPreload();
+
+/**
+  Show the frame in the 3-bit buffer on the panel in the cheapest way that
+  shows it.
+
+  @returns how it was shown, REFRESH_GRAY, REFRESH_MONO, REFRESH_PARTIAL or
+  REFRESH_NONE.
+*/
+uint8_t refreshDisplay();
+
+#endif
@@ -0,0 +1,101 @@
+#include "retry.h"
+
+#include "logger.h"
+
+#define RETRY_MAGIC 0x31545952  // "RYT1"
+
+static const uint32_t wakeDelays[] = RETRY_WAKE_DELAYS;
+static const int numWakeDelays = sizeof(wakeDelays) / sizeof(wakeDelays[0]);
+
+static const char* const failureNames[RETRY_COUNT] = {"wifi", "download",
+                                                      "draw", "mqtt"};
+
+// Retry budgets spent since the last refill, kept in RTC memory.
+struct RetryState {
+    uint32_t magic;
+    uint32_t since;              // UTC time of the first failure
+    uint32_t spentMs;            // awake time of the failed wakes
+    uint8_t wakes[RETRY_COUNT];  // retry wakes made for each failure class
+    bool retrying;               // whether this is a retry wake
+};
+
+RTC_DATA_ATTR static RetryState state;
+
+/**
+  Get the delay before retrying an operation within a wake.
+
+  @param attempt the number of attempts made so far, from 1.
+  @returns the delay in milliseconds, between half and all of
+  RETRY_BACKOFF_BASE_MS doubled for each attempt after the first, at most
+  RETRY_BACKOFF_MAX_MS.
+*/
+uint32_t retryBackoff(int attempt) {
+    uint32_t ms = RETRY_BACKOFF_BASE_MS;
+    for (int i = 1; i < attempt && ms < RETRY_BACKOFF_MAX_MS; i++) ms *= 2;
+    if (ms > RETRY_BACKOFF_MAX_MS) ms = RETRY_BACKOFF_MAX_MS;
+    // Half of it is random: enough to spread retries out, while never
+    // retrying at once.
+    return ms / 2 + esp_random() % (ms / 2 + 1);
+}
+
+/**
+  Get when to wake after a failed wake, spending the budgets of the failure
+  class and of awake time on a retry wake if they allow one.
+
+  @param failure the operation that failed, RETRY_WIFI to RETRY_DRAW.
+  @param nowTime the time now, UTC.
+  @param scheduled the next wake in the refresh schedule, UTC.
+  @param batteryPercent the battery charge.
+  @returns the time of the retry wake, or scheduled if that is sooner or no
+  retry wake is made.
+*/
+time_t retryWakeTime(uint8_t failure, time_t nowTime, time_t scheduled,
+                     int batteryPercent) {
+    if (state.magic != RETRY_MAGIC) {
+        memset(&state, 0, sizeof(state));
+        state.magic = RETRY_MAGIC;
+        state.since = nowTime;
+    }
+    if (nowTime < state.since ||
+        (uint32_t)(nowTime - state.since) >= RETRY_BUDGET_PERIOD) {
+        state.since = nowTime;
+        state.spentMs = 0;
+    }
+    state.spentMs += millis();
+    // A scheduled refresh that fails gets retry wakes of its own.
+    if (!state.retrying) memset(state.wakes, 0, sizeof(state.wakes));
+    state.retrying = false;
+
+    if (failure >= RETRY_COUNT) return scheduled;
+    if (batteryPercent < RETRY_MIN_BATTERY_PERCENT) {
+        log(LOG_NOTICE, "battery low, no retry wake");
+        return scheduled;
+    }
+    if (state.spentMs >= RETRY_ENERGY_BUDGET_MS) {
+        logf(LOG_NOTICE, "%lus awake in failed wakes, no retry wake",
+             (unsigned long)state.spentMs / 1000);
+        return scheduled;
+    }
+    int n = state.wakes[failure];
+    if (n >= numWakeDelays) {
+        logf(LOG_NOTICE, "made %d retry wakes for %s, no more", n,
+             failureNames[failure]);
+        return scheduled;
+    }
+
+    uint32_t jitter = wakeDelays[n] * RETRY_WAKE_JITTER_PERCENT / 100;
+    time_t retryTime =
+        nowTime + wakeDelays[n] - jitter + esp_random() % (2 * jitter + 1);
+    if (retryTime >= scheduled) return scheduled;
+
+    state.wakes[failure]++;
+    state.retrying = true;
+    logf(LOG_NOTICE, "retry wake %d of %d for %s in %lds", n + 1,
+         numWakeDelays, failureNames[failure], (long)(retryTime - nowTime));
+    return retryTime;
+}
+
+/**
+  Refill the retry budgets after a successful refresh.
+*/
+void retryReset() { state.magic = 0; }
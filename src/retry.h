@@ -0,0 +1,67 @@
+#ifndef RETRY_H
+#define RETRY_H
+#include <Arduino.h>
+
+#include "schedule.h"
+#include "telemetry.h"
+
+// Retries after a failure back off twice over. Within a wake each retry of
+// an operation waits about twice as long as the last, with jitter, so a
+// router or server that is briefly down is not hammered. A wake that still
+// fails sleeps for a short retry wake, 5, then 15, then 60 minutes, instead
+// of until the next refresh, so a blip does not leave the display stale for
+// a day.
+//
+// Each failure class, one of the operations RETRY_WIFI to RETRY_DRAW, has
+// its own budget of retry wakes for each scheduled refresh that fails, and
+// the failed wakes together have a budget of awake time so that a long
+// outage cannot flatten the battery. Both are kept in RTC memory and
+// refilled by a successful refresh; the awake time is also refilled
+// RETRY_BUDGET_PERIOD after the first failure.
+
+// Delay before the first retry within a wake, doubled for each retry after.
+#define RETRY_BACKOFF_BASE_MS 500
+// Longest delay between retries within a wake.
+#define RETRY_BACKOFF_MAX_MS 8000
+// Seconds from a failed wake to each retry wake of a failure class.
+#define RETRY_WAKE_DELAYS {5 * 60, 15 * 60, 60 * 60}
+// Retry wakes are moved by up to this much either way, so devices that
+// failed together do not all retry together.
+#define RETRY_WAKE_JITTER_PERCENT 10
+// Most time spent awake in failed wakes before the budgets are refilled.
+#define RETRY_ENERGY_BUDGET_MS (3 * 60 * 1000UL)
+// Time after the first failure that the awake time budget is refilled.
+#define RETRY_BUDGET_PERIOD (24 * 3600UL)
+// Battery charge below which no retry wakes are made.
+#define RETRY_MIN_BATTERY_PERCENT SCHEDULE_SAVER_PERCENT
+
+/**
+  Get the delay before retrying an operation within a wake.
+
+  @param attempt the number of attempts made so far, from 1.
+  @returns the delay in milliseconds, between half and all of
+  RETRY_BACKOFF_BASE_MS doubled for each attempt after the first, at most
+  RETRY_BACKOFF_MAX_MS.
+*/
+uint32_t retryBackoff(int attempt);
+
+/**
+  Get when to wake after a failed wake, spending the budgets of the failure
+  class and of awake time on a retry wake if they allow one.
+
+  @param failure the operation that failed, RETRY_WIFI to RETRY_DRAW.
+  @param nowTime the time now, UTC.
+  @param scheduled the next wake in the refresh schedule, UTC.
+  @param batteryPercent the battery charge.
+  @returns the time of the retry wake, or scheduled if that is sooner or no
+  retry wake is made.
+*/
+time_t retryWakeTime(uint8_t failure, time_t nowTime, time_t scheduled,
+                     int batteryPercent);
+
+/**
+  Refill the retry budgets after a successful refresh.
+*/
+void retryReset();
+
+#endif
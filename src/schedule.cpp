@@ -0,0 +1,214 @@
+#include "schedule.h"
+
+#define SCHEDULE_SECS_PER_DAY 86400UL
+#define SCHEDULE_SECS_PER_WEEK (7 * SCHEDULE_SECS_PER_DAY)
+// Every day of the week.
+#define SCHEDULE_ALL_DAYS 0x7f
+
+static const char* const dayNames[] = {"Mon", "Tue", "Wed", "Thu",
+                                       "Fri", "Sat", "Sun"};
+
+static const char* skipSpaces(const char* p) {
+    while (*p == ' ') p++;
+    return p;
+}
+
+/**
+  Parse a decimal number no greater than max.
+*/
+static const char* parseNumber(const char* p, int max, int* n) {
+    if (!isdigit((unsigned char)*p)) return NULL;
+    *n = 0;
+    while (isdigit((unsigned char)*p)) {
+        *n = *n * 10 + (*p++ - '0');
+        if (*n > max) return NULL;
+    }
+    return p;
+}
+
+/**
+  Parse a time of day, HH:MM or HH:MM:SS.
+*/
+static const char* parseTime(const char* p, uint32_t* secondOfDay) {
+    int hour, minute, second = 0;
+    p = parseNumber(p, 23, &hour);
+    if (p == NULL || *p++ != ':') return NULL;
+    p = parseNumber(p, 59, &minute);
+    if (p != NULL && *p == ':') p = parseNumber(p + 1, 59, &second);
+    if (p == NULL) return NULL;
+    *secondOfDay = hour * 3600UL + minute * 60UL + second;
+    return p;
+}
+
+/**
+  Parse a day name, eg. Mon, as 0 for Monday to 6 for Sunday.
+*/
+static const char* parseDay(const char* p, int* day) {
+    for (int d = 0; d < 7; d++) {
+        if (strncasecmp(p, dayNames[d], 3) == 0) {
+            *day = d;
+            return p + 3;
+        }
+    }
+    return NULL;
+}
+
+/**
+  Parse days as names, ranges or lists of both, eg. Mon,Wed-Fri.
+*/
+static const char* parseDays(const char* p, uint8_t* days) {
+    *days = 0;
+    for (;;) {
+        int first, last;
+        p = parseDay(p, &first);
+        if (p == NULL) return NULL;
+        last = first;
+        if (*p == '-') {
+            p = parseDay(p + 1, &last);
+            if (p == NULL) return NULL;
+        }
+        // A range may wrap around the week, eg. Sat-Mon.
+        for (int d = first;; d = (d + 1) % 7) {
+            *days |= 1 << d;
+            if (d == last) break;
+        }
+        if (*p != ',') return p;
+        p++;
+    }
+}
+
+/**
+  Parse a schedule, see above for the format.
+
+  @param spec the schedule.
+  @param schedule filled with the slots of the schedule, with no wakes
+  planned.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the schedule cannot be parsed or has no slots.
+  - ESP_ERR_INVALID_SIZE if it has more than SCHEDULE_MAX_SLOTS slots.
+*/
+esp_err_t scheduleParse(const char* spec, Schedule* schedule) {
+    memset(schedule, 0, sizeof(*schedule));
+    if (spec == NULL) return ESP_ERR_INVALID_ARG;
+
+    const char* p = skipSpaces(spec);
+    while (*p != '\0') {
+        if (schedule->numSlots == SCHEDULE_MAX_SLOTS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        ScheduleSlot* slot = &schedule->slots[schedule->numSlots++];
+        slot->days = SCHEDULE_ALL_DAYS;
+
+        p = parseTime(p, &slot->secondOfDay);
+        if (p == NULL) return ESP_ERR_INVALID_ARG;
+        p = skipSpaces(p);
+        if (isalpha((unsigned char)*p)) {
+            p = parseDays(p, &slot->days);
+            if (p == NULL) return ESP_ERR_INVALID_ARG;
+            p = skipSpaces(p);
+        }
+        if (isdigit((unsigned char)*p)) {
+            int percent;
+            p = parseNumber(p, 100, &percent);
+            if (p == NULL || *p++ != '%') return ESP_ERR_INVALID_ARG;
+            slot->minPercent = percent;
+            p = skipSpaces(p);
+        }
+
+        if (*p == ';') {
+            p = skipSpaces(p + 1);
+        } else if (*p != '\0') {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return schedule->numSlots > 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+  Add a wake to the sorted wakes of the week, unless it is already there.
+*/
+static void addWake(Schedule* schedule, uint32_t sinceMonday) {
+    int i = schedule->numWakes;
+    for (int j = 0; j < i; j++) {
+        if (schedule->wakes[j] == sinceMonday) return;
+    }
+    while (i > 0 && schedule->wakes[i - 1] > sinceMonday) {
+        schedule->wakes[i] = schedule->wakes[i - 1];
+        i--;
+    }
+    schedule->wakes[i] = sinceMonday;
+    schedule->numWakes++;
+}
+
+/**
+  Plan the wakes of each day from the slots that can run at a battery
+  charge.
+
+  @param keepAll true to keep every slot whatever charge it asks for.
+*/
+static void planDays(Schedule* schedule, int batteryPercent, bool keepAll) {
+    bool saver = batteryPercent < SCHEDULE_SAVER_PERCENT;
+    for (int day = 0; day < 7; day++) {
+        const ScheduleSlot* first = NULL;
+        for (int i = 0; i < schedule->numSlots; i++) {
+            const ScheduleSlot* slot = &schedule->slots[i];
+            if (!(slot->days & 1 << day)) continue;
+            if (!keepAll && batteryPercent < slot->minPercent) continue;
+            if (!saver) {
+                addWake(schedule, day * SCHEDULE_SECS_PER_DAY +
+                                      slot->secondOfDay);
+            } else if (first == NULL ||
+                       slot->secondOfDay < first->secondOfDay) {
+                first = slot;
+            }
+        }
+        if (first != NULL) {
+            addWake(schedule, day * SCHEDULE_SECS_PER_DAY + first->secondOfDay);
+        }
+    }
+}
+
+/**
+  Plan the wakes of the week for a battery charge, skipping the slots that
+  need more.
+
+  @param schedule the parsed schedule.
+  @param batteryPercent the battery charge.
+*/
+void schedulePlan(Schedule* schedule, int batteryPercent) {
+    schedule->numWakes = 0;
+    planDays(schedule, batteryPercent, false);
+    if (schedule->numWakes == 0) planDays(schedule, 0, true);
+}
+
+/**
+  Find the first planned wake after a time, by binary search.
+
+  @param schedule the planned schedule.
+  @param local the local time.
+  @returns the local time of the wake, or 0 if no wakes are planned.
+*/
+time_t scheduleNext(const Schedule* schedule, time_t local) {
+    if (schedule->numWakes == 0) return 0;
+
+    // 1 January 1970 was a Thursday.
+    uint32_t sinceMonday =
+        (local / SCHEDULE_SECS_PER_DAY + 3) % 7 * SCHEDULE_SECS_PER_DAY +
+        local % SCHEDULE_SECS_PER_DAY;
+    time_t weekStart = local - sinceMonday;
+
+    int lo = 0, hi = schedule->numWakes;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (schedule->wakes[mid] <= sinceMonday) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == schedule->numWakes) {
+        return weekStart + SCHEDULE_SECS_PER_WEEK + schedule->wakes[0];
+    }
+    return weekStart + schedule->wakes[lo];
+}
@@ -0,0 +1,74 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+#include <Arduino.h>
+
+// Refresh schedules of several wakes a day, eg.
+//
+//   07:00 Mon-Fri; 12:30 Mon-Fri 40%; 09:00 Sat,Sun
+//
+// Slots are separated by ';'. Each is a local time of day, HH:MM or
+// HH:MM:SS, followed by the days it runs on as names (Mon to Sun), ranges
+// (Mon-Fri) or lists of both (Mon,Wed-Fri), every day if none are given,
+// and by the least battery charge it needs, eg. 40%, below which it is
+// skipped. A single time such as "09:00:00" is a daily refresh.
+//
+// As the battery runs down the schedule thins itself out: below
+// SCHEDULE_SAVER_PERCENT only the first slot of each day that is left is
+// kept. Should every slot be skipped, the first slot of each day is kept
+// anyway so the display still wakes to show the battery warning.
+
+// Most slots in a schedule.
+#define SCHEDULE_MAX_SLOTS 8
+// Most wakes in a week.
+#define SCHEDULE_MAX_WAKES (SCHEDULE_MAX_SLOTS * 7)
+// Battery charge below which only the first slot of each day is kept.
+#define SCHEDULE_SAVER_PERCENT 25
+
+// A slot of a schedule.
+struct ScheduleSlot {
+    uint32_t secondOfDay;  // local time of day
+    uint8_t days;          // bit 0 for Monday to bit 6 for Sunday
+    uint8_t minPercent;    // least battery charge, 0 for any
+};
+
+// A parsed schedule and the wakes of the week planned from it.
+struct Schedule {
+    ScheduleSlot slots[SCHEDULE_MAX_SLOTS];
+    uint8_t numSlots;
+    // Seconds since Monday 00:00 local time of each planned wake, sorted.
+    uint32_t wakes[SCHEDULE_MAX_WAKES];
+    uint8_t numWakes;
+};
+
+/**
+  Parse a schedule, see above for the format.
+
+  @param spec the schedule.
+  @param schedule filled with the slots of the schedule, with no wakes
+  planned.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the schedule cannot be parsed or has no slots.
+  - ESP_ERR_INVALID_SIZE if it has more than SCHEDULE_MAX_SLOTS slots.
+*/
+esp_err_t scheduleParse(const char* spec, Schedule* schedule);
+
+/**
+  Plan the wakes of the week for a battery charge, skipping the slots that
+  need more.
+
+  @param schedule the parsed schedule.
+  @param batteryPercent the battery charge.
+*/
+void schedulePlan(Schedule* schedule, int batteryPercent);
+
+/**
+  Find the first planned wake after a time, by binary search.
+
+  @param schedule the planned schedule.
+  @param local the local time.
+  @returns the local time of the wake, or 0 if no wakes are planned.
+*/
+time_t scheduleNext(const Schedule* schedule, time_t local);
+
+#endif
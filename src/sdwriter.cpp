@@ -0,0 +1,245 @@
+#include "sdwriter.h"
+
+#include <freertos/task.h>
+
+#include "lib.h"
+
+/**
+  Write filled buffers to the card until the end-of-stream marker arrives.
+  Buffers go back to the producer even after a failed write so that it never
+  blocks; the failure is reported through w->err.
+*/
+static void writerTask(void* param) {
+    SdWriter* w = (SdWriter*)param;
+    SdChunk chunk;
+
+    while (xQueueReceive(w->fullQ, &chunk, portMAX_DELAY) == pdPASS) {
+        if (chunk.data == NULL) break;
+
+        if (w->err == ESP_OK) {
+            uint32_t start = micros();
+            size_t n = w->file.write(chunk.data, chunk.len);
+            w->writeUs += micros() - start;
+            if (n != chunk.len) {
+                w->err = ESP_ERR_EFILEW;
+            } else {
+                w->bytesWritten += n;
+            }
+        }
+        xQueueSend(w->freeQ, &chunk.data, portMAX_DELAY);
+    }
+
+    // Tell the producer every write has finished.
+    uint8_t* done = NULL;
+    xQueueSend(w->freeQ, &done, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+/**
+  Stop the writer task, wait for in-flight writes and release the buffers.
+*/
+static void writerStop(SdWriter* w) {
+    if (w->current.data != NULL && w->current.len > 0) {
+        xQueueSend(w->fullQ, &w->current, portMAX_DELAY);
+    }
+    SdChunk end = {NULL, 0};
+    xQueueSend(w->fullQ, &end, portMAX_DELAY);
+
+    uint8_t* buf;
+    do {
+        xQueueReceive(w->freeQ, &buf, portMAX_DELAY);
+    } while (buf != NULL);
+
+    for (int i = 0; i < SD_WRITER_BUFFERS; i++) {
+        free(w->buffers[i]);
+        w->buffers[i] = NULL;
+    }
+    vQueueDelete(w->freeQ);
+    vQueueDelete(w->fullQ);
+    w->current.data = NULL;
+}
+
+/**
+  Create the temp file and start the writer task.
+
+  @param w the writer.
+  @param path the path of the file to replace once the write completes.
+  @param size the expected file size to preallocate, or 0 if unknown.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the write buffers cannot be allocated.
+  - ESP_ERR_EFILEW if the temp file cannot be created.
+*/
+esp_err_t sdWriterBegin(SdWriter* w, const char* path, uint32_t size) {
+    if (strlen(path) >= SD_WRITER_PATH_MAX) {
+        return ESP_ERR_EFILEW;
+    }
+    strcpy(w->path, path);
+    sprintf(w->tmpPath, "%s%s", path, SD_WRITER_TMP_SUFFIX);
+    w->current = {NULL, 0};
+    w->bytesWritten = 0;
+    w->writeUs = 0;
+    w->err = ESP_OK;
+
+    for (int i = 0; i < SD_WRITER_BUFFERS; i++) {
+        w->buffers[i] = (uint8_t*)malloc(SD_WRITER_CHUNK);
+        if (w->buffers[i] == NULL) {
+            while (i-- > 0) free(w->buffers[i]);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    w->file = sd.open(w->tmpPath, O_RDWR | O_CREAT | O_TRUNC);
+    if (!w->file) {
+        for (int i = 0; i < SD_WRITER_BUFFERS; i++) free(w->buffers[i]);
+        return ESP_ERR_EFILEW;
+    }
+
+    // A single extent avoids FAT lookups and cluster allocation mid-write.
+    // Not fatal if the card is too fragmented, the file just grows as usual.
+    w->contiguous = size > 0 && w->file.preAllocate(size);
+    if (size > 0 && !w->contiguous) {
+        logf(LOG_DEBUG, "could not preallocate %u bytes for %s", size,
+             w->tmpPath);
+    }
+
+    // Free queue has room for the end-of-stream marker too.
+    w->freeQ = xQueueCreate(SD_WRITER_BUFFERS + 1, sizeof(uint8_t*));
+    w->fullQ = xQueueCreate(SD_WRITER_BUFFERS + 1, sizeof(SdChunk));
+    for (int i = 0; i < SD_WRITER_BUFFERS; i++) {
+        xQueueSend(w->freeQ, &w->buffers[i], 0);
+    }
+
+    if (xTaskCreatePinnedToCore(writerTask, "sdwriter", 4096, w, 1, NULL,
+                                ARDUINO_RUNNING_CORE) != pdPASS) {
+        for (int i = 0; i < SD_WRITER_BUFFERS; i++) free(w->buffers[i]);
+        vQueueDelete(w->freeQ);
+        vQueueDelete(w->fullQ);
+        w->file.close();
+        sd.remove(w->tmpPath);
+        return ESP_ERR_NO_MEM;
+    }
+
+    w->startMs = millis();
+    return ESP_OK;
+}
+
+/**
+  Append data to the file. Blocks only while both buffers are in flight.
+
+  @param w the writer.
+  @param data the bytes to append.
+  @param len the number of bytes.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EFILEW if an earlier write to the card failed.
+*/
+esp_err_t sdWriterWrite(SdWriter* w, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        if (w->err != ESP_OK) return w->err;
+
+        if (w->current.data == NULL) {
+            xQueueReceive(w->freeQ, &w->current.data, portMAX_DELAY);
+            w->current.len = 0;
+        }
+
+        size_t n = min(len, (size_t)(SD_WRITER_CHUNK - w->current.len));
+        memcpy(w->current.data + w->current.len, data, n);
+        w->current.len += n;
+        data += n;
+        len -= n;
+
+        if (w->current.len == SD_WRITER_CHUNK) {
+            xQueueSend(w->fullQ, &w->current, portMAX_DELAY);
+            w->current.data = NULL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+  Flush the remaining data, then replace the target file with the temp file.
+  The previous target file is only removed once the new file is in place.
+
+  @param w the writer.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EFILEW if writing or renaming fails. The target is left as it was.
+*/
+esp_err_t sdWriterCommit(SdWriter* w) {
+    writerStop(w);
+
+    // Give back the unused part of the preallocation.
+    if (w->err != ESP_OK || !w->file.truncate() || !w->file.sync()) {
+        w->file.close();
+        sd.remove(w->tmpPath);
+        return ESP_ERR_EFILEW;
+    }
+    w->file.close();
+
+    // FAT cannot rename over an existing file, so move the old one aside
+    // first. sdWriterRecover() puts it back if we lose power in between.
+    char oldPath[SD_WRITER_PATH_MAX + sizeof(SD_WRITER_OLD_SUFFIX)];
+    sprintf(oldPath, "%s%s", w->path, SD_WRITER_OLD_SUFFIX);
+    if (sd.exists(oldPath)) {
+        sd.remove(oldPath);
+    }
+    bool hadTarget = sd.exists(w->path);
+    if (hadTarget && !sd.rename(w->path, oldPath)) {
+        sd.remove(w->tmpPath);
+        return ESP_ERR_EFILEW;
+    }
+    if (!sd.rename(w->tmpPath, w->path)) {
+        if (hadTarget) sd.rename(oldPath, w->path);
+        sd.remove(w->tmpPath);
+        return ESP_ERR_EFILEW;
+    }
+    if (hadTarget) {
+        sd.remove(oldPath);
+    }
+
+    uint32_t elapsedMs = millis() - w->startMs;
+    uint32_t writeMs = w->writeUs / 1000;
+    uint32_t kbps = w->writeUs > 0
+                        ? (uint64_t)w->bytesWritten * 1000000 / 1024 / w->writeUs
+                        : 0;
+    logf(LOG_DEBUG,
+         "wrote %u bytes to %s in %lums, card busy %lums (%u KB/s%s)",
+         w->bytesWritten, w->path, elapsedMs, writeMs, kbps,
+         w->contiguous ? ", contiguous" : "");
+
+    return ESP_OK;
+}
+
+/**
+  Stop the writer and delete the temp file, leaving the target untouched.
+
+  @param w the writer.
+*/
+void sdWriterAbort(SdWriter* w) {
+    writerStop(w);
+    w->file.close();
+    sd.remove(w->tmpPath);
+}
+
+/**
+  Restore a file whose replacement was interrupted, and clear any stale temp
+  file left by an interrupted write.
+
+  @param path the path of the file.
+*/
+void sdWriterRecover(const char* path) {
+    char tmpPath[SD_WRITER_PATH_MAX + sizeof(SD_WRITER_TMP_SUFFIX)];
+    char oldPath[SD_WRITER_PATH_MAX + sizeof(SD_WRITER_OLD_SUFFIX)];
+    snprintf(tmpPath, sizeof(tmpPath), "%s%s", path, SD_WRITER_TMP_SUFFIX);
+    snprintf(oldPath, sizeof(oldPath), "%s%s", path, SD_WRITER_OLD_SUFFIX);
+
+    if (!sd.exists(path) && sd.exists(oldPath)) {
+        log(LOG_WARNING, "restoring file after interrupted replace");
+        sd.rename(oldPath, path);
+    }
+    if (sd.exists(tmpPath)) {
+        sd.remove(tmpPath);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SDWRITER_H
+#define SDWRITER_H
+#include <Arduino.h>
+#include <SdFat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+// Size of each write buffer. A multiple of the 512 byte SD sector so that
+// every write but the last covers whole sectors.
+#define SD_WRITER_CHUNK 8192
+// Number of write buffers. One fills from the network while the other is
+// written to the card.
+#define SD_WRITER_BUFFERS 2
+// Suffix of the file written to before it replaces the target.
+#define SD_WRITER_TMP_SUFFIX ".tmp"
+// Suffix the previous target is kept under while it is being replaced.
+#define SD_WRITER_OLD_SUFFIX ".old"
+// Longest supported target path.
+#define SD_WRITER_PATH_MAX 64
+
+// A buffer handed between the producer and the writer task.
+struct SdChunk {
+    uint8_t* data;
+    uint16_t len;
+};
+
+// Streams data to a temp file on SD card that atomically replaces the target
+// file once complete. Writes happen on a separate task so the caller can keep
+// receiving while the card is busy.
+struct SdWriter {
+    char path[SD_WRITER_PATH_MAX];
+    char tmpPath[SD_WRITER_PATH_MAX + sizeof(SD_WRITER_TMP_SUFFIX)];
+    File file;
+    uint8_t* buffers[SD_WRITER_BUFFERS];
+    SdChunk current;
+    QueueHandle_t freeQ;  // empty buffers, back from the writer task
+    QueueHandle_t fullQ;  // filled buffers, to the writer task
+    bool contiguous;      // the temp file was preallocated in one extent
+    uint32_t bytesWritten;
+    uint32_t writeUs;      // time the card spent in write calls
+    uint32_t startMs;
+    volatile esp_err_t err;
+};
+
+/**
+  Create the temp file and start the writer task.
+
+  @param w the writer.
+  @param path the path of the file to replace once the write completes.
+  @param size the expected file size to preallocate, or 0 if unknown.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NO_MEM if the write buffers cannot be allocated.
+  - ESP_ERR_EFILEW if the temp file cannot be created.
+*/
+esp_err_t sdWriterBegin(SdWriter* w, const char* path, uint32_t size);
+
+/**
+  Append data to the file. Blocks only while both buffers are in flight.
+
+  @param w the writer.
+  @param data the bytes to append.
+  @param len the number of bytes.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EFILEW if an earlier write to the card failed.
+*/
+esp_err_t sdWriterWrite(SdWriter* w, const uint8_t* data, size_t len);
+
+/**
+  Flush the remaining data, then replace the target file with the temp file.
+  The previous target file is only removed once the new file is in place.
+
+  @param w the writer.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_EFILEW if writing or renaming fails. The target is left as it was.
+*/
+esp_err_t sdWriterCommit(SdWriter* w);
+
+/**
+  Stop the writer and delete the temp file, leaving the target untouched.
+
+  @param w the writer.
+*/
+void sdWriterAbort(SdWriter* w);
+
+/**
+  Restore a file whose replacement was interrupted, and clear any stale temp
+  file left by an interrupted write.
+
+  @param path the path of the file.
+*/
+void sdWriterRecover(const char* path);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SUBSYSTEMS_H
+#define SUBSYSTEMS_H
+
+// The optional subsystems built into the firmware, chosen with build flags
+// in platformio.ini. Code using a subsystem tests its constant with
+// `if constexpr`, so when the subsystem is left out that code is discarded
+// at compile time instead of being checked on every call, and nothing of its
+// library is linked in.
+
+// Remote logging, telemetry and wake profiles over MQTT, build flag
+// HAS_MQTT. The SD card is likewise left out without HAS_SDCARD.
+#if defined(HAS_MQTT)
+constexpr bool FEATURE_MQTT = true;
+#else
+constexpr bool FEATURE_MQTT = false;
+#endif
+
+#endif
@@ -0,0 +1,241 @@
+#include "telemetry.h"
+
+#include "lib.h"
+
+// CBOR major types.
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_INDEFINITE_ARRAY 0x9f
+#define CBOR_BREAK 0xff
+
+// Room kept after the log messages for the closing fields of the packet.
+#define TELEMETRY_TRAILER 32
+
+// A CBOR packet being written; stops writing, but keeps counting, once full.
+struct Cbor {
+    uint8_t* buf;
+    size_t size;
+    size_t len;
+};
+
+// MQTT settings, set by telemetryBegin().
+static bool enabled;
+static const char* mqttBroker;
+static int mqttPort;
+static const char* mqttTopic;
+static const char* mqttClientID;
+static int mqttRetries;
+
+// Metrics of this wake.
+static uint32_t batteryMv;
+static uint16_t retries[RETRY_COUNT];
+static int32_t errors[TELEMETRY_MAX_ERRORS];
+static uint8_t numErrors;
+
+static uint8_t packet[TELEMETRY_PACKET_MAX];
+
+static const char* const retryNames[RETRY_COUNT] = {"wifi", "download",
+                                                    "draw", "mqtt"};
+
+static void cborByte(Cbor* c, uint8_t b) {
+    if (c->len < c->size) c->buf[c->len] = b;
+    c->len++;
+}
+
+/**
+  Write the initial byte of a data item and its argument, in the shortest
+  form.
+*/
+static void cborHead(Cbor* c, uint8_t major, uint32_t value) {
+    major <<= 5;
+    if (value < 24) {
+        cborByte(c, major | value);
+    } else if (value <= 0xff) {
+        cborByte(c, major | 24);
+        cborByte(c, value);
+    } else if (value <= 0xffff) {
+        cborByte(c, major | 25);
+        cborByte(c, value >> 8);
+        cborByte(c, value);
+    } else {
+        cborByte(c, major | 26);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            cborByte(c, value >> shift);
+        }
+    }
+}
+
+static void cborInt(Cbor* c, int32_t value) {
+    if (value < 0) {
+        cborHead(c, CBOR_NEGINT, (uint32_t)(-1 - value));
+    } else {
+        cborHead(c, CBOR_UINT, value);
+    }
+}
+
+static void cborText(Cbor* c, const char* text, size_t len) {
+    cborHead(c, CBOR_TEXT, len);
+    for (size_t i = 0; i < len; i++) cborByte(c, text[i]);
+}
+
+static void cborKey(Cbor* c, const char* key) { cborText(c, key, strlen(key)); }
+
+/**
+  Add a held log message to the packet if it fits.
+*/
+static bool addLog(void* ctx, const LogEntry* entry, const char* msg) {
+    Cbor* c = (Cbor*)ctx;
+    // Array head, boot, sequence, level, time and text head are at most 17
+    // bytes.
+    if (c->len + 17 + entry->len + TELEMETRY_TRAILER > c->size) return false;
+    cborHead(c, CBOR_ARRAY, 5);
+    cborHead(c, CBOR_UINT, entry->boot);
+    cborHead(c, CBOR_UINT, entry->seq);
+    cborHead(c, CBOR_UINT, entry->pri);
+    cborHead(c, CBOR_UINT, entry->time);
+    cborText(c, msg, entry->len);
+    return true;
+}
+
+/**
+  Enable telemetry mode for this wake. Log lines are held back and published
+  with the wake's metrics by telemetryPublish().
+
+  @param broker the hostname of the MQTT broker.
+  @param port the port of the MQTT broker.
+  @param topic the topic to publish to.
+  @param clientID the name of the client to appear as.
+  @param retries the number of connection attempts to make.
+*/
+void telemetryBegin(const char* broker, int port, const char* topic,
+                    const char* clientID, int retries) {
+    enabled = true;
+    mqttBroker = broker;
+    mqttPort = port;
+    mqttTopic = topic;
+    mqttClientID = clientID;
+    mqttRetries = retries;
+}
+
+/**
+  Check whether telemetry mode is enabled for this wake.
+
+  @returns true after telemetryBegin().
+*/
+bool telemetryEnabled() { return enabled; }
+
+/**
+  Record the battery voltage.
+
+  @param volts the battery voltage.
+*/
+void telemetrySetBattery(double volts) { batteryMv = volts * 1000 + 0.5; }
+
+/**
+  Count a retry of an operation.
+
+  @param op the operation, see RETRY_COUNT.
+*/
+void telemetryRetry(uint8_t op) {
+    if (op < RETRY_COUNT) retries[op]++;
+}
+
+/**
+  Record an error code.
+
+  @param err the error.
+*/
+void telemetryError(esp_err_t err) {
+    if (numErrors < TELEMETRY_MAX_ERRORS) errors[numErrors++] = err;
+}
+
+/**
+  Connect to the MQTT broker, publish the wake's metrics and held log lines
+  as a single packet and disconnect. Call right before deep sleep while WiFi
+  is still up.
+
+  @param client the MQTT client to publish with.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if telemetry mode is not enabled or WiFi is down.
+  - ESP_ERR_TIMEOUT if the broker cannot be reached.
+  - ESP_FAIL if the MQTT publish fails.
+*/
+esp_err_t telemetryPublish(PubSubClient& client) {
+    if (!enabled || WiFi.status() != WL_CONNECTED) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    client.setServer(mqttBroker, mqttPort);
+    int attempts = 0;
+    while (!client.connect(mqttClientID)) {
+        if (++attempts > mqttRetries) return ESP_ERR_TIMEOUT;
+        telemetryRetry(RETRY_MQTT);
+        delay(250);
+    }
+
+    const WakeProfile* profile = profilerCurrent();
+    Cbor c = {packet, sizeof(packet), 0};
+    cborHead(&c, CBOR_MAP, 10);
+    cborKey(&c, "v");
+    cborHead(&c, CBOR_UINT, TELEMETRY_VERSION);
+    cborKey(&c, "boot");
+    cborHead(&c, CBOR_UINT, profile->bootCount);
+    cborKey(&c, "epoch");
+    cborHead(&c, CBOR_UINT, now());
+    cborKey(&c, "awake_us");
+    cborHead(&c, CBOR_UINT, micros());
+    cborKey(&c, "battery_mv");
+    cborHead(&c, CBOR_UINT, batteryMv);
+
+    cborKey(&c, "spans");
+    cborHead(&c, CBOR_ARRAY, profile->numSpans);
+    for (uint8_t s = 0; s < profile->numSpans; s++) {
+        cborHead(&c, CBOR_ARRAY, 3);
+        cborKey(&c, phaseName(profile->spans[s].phase));
+        cborHead(&c, CBOR_UINT, profile->spans[s].startUs);
+        cborHead(&c, CBOR_UINT, profile->spans[s].durationUs);
+    }
+
+    cborKey(&c, "retries");
+    cborHead(&c, CBOR_MAP, RETRY_COUNT);
+    for (int i = 0; i < RETRY_COUNT; i++) {
+        cborKey(&c, retryNames[i]);
+        cborHead(&c, CBOR_UINT, retries[i]);
+    }
+
+    cborKey(&c, "errors");
+    cborHead(&c, CBOR_ARRAY, numErrors);
+    for (int i = 0; i < numErrors; i++) cborInt(&c, errors[i]);
+
+    // Messages that do not fit stay in the ring for the next packet.
+    cborKey(&c, "logs");
+    cborByte(&c, CBOR_INDEFINITE_ARRAY);
+    logDrain(addLog, &c);
+    cborByte(&c, CBOR_BREAK);
+
+    const LogStats* stats = logStats();
+    cborKey(&c, "log_stats");
+    cborHead(&c, CBOR_ARRAY, 3);
+    cborHead(&c, CBOR_UINT, stats->lines);
+    cborHead(&c, CBOR_UINT, stats->truncated);
+    cborHead(&c, CBOR_UINT, stats->dropped);
+
+    esp_err_t err = ESP_OK;
+    if (c.len > c.size) {
+        err = ESP_FAIL;
+    } else {
+        if (client.getBufferSize() < c.len + strlen(mqttTopic) + 16) {
+            client.setBufferSize(c.len + strlen(mqttTopic) + 16);
+        }
+        if (!client.publish(mqttTopic, packet, c.len)) {
+            err = ESP_FAIL;
+        }
+    }
+    client.disconnect();
+
+    return err;
+}
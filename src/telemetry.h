@@ -0,0 +1,86 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+// Telemetry mode publishes one CBOR (RFC 8949) packet per wake right before
+// deep sleep instead of streaming log lines over MQTT for the whole wake:
+//
+//   {"v": 2, "boot": n, "epoch": t, "awake_us": us, "battery_mv": mv,
+//    "spans": [[phase, start_us, duration_us], ...],
+//    "retries": {"wifi": n, "download": n, "draw": n, "mqtt": n},
+//    "errors": [esp_err_t, ...],
+//    "logs": [[boot, seq, level, epoch, message], ...],
+//    "log_stats": [lines, truncated, dropped]}
+//
+// See server/telemetry.py for the decoder.
+#define TELEMETRY_VERSION 2
+// Largest packet; log messages that do not fit stay in the log ring for the
+// next packet.
+#define TELEMETRY_PACKET_MAX 6144
+// Number of error codes kept per wake.
+#define TELEMETRY_MAX_ERRORS 8
+
+// Operations whose retries are counted.
+#define RETRY_WIFI 0
+#define RETRY_DOWNLOAD 1
+#define RETRY_DRAW 2
+#define RETRY_MQTT 3
+#define RETRY_COUNT 4
+
+/**
+  Enable telemetry mode for this wake. Log lines are held back and published
+  with the wake's metrics by telemetryPublish().
+
+  @param broker the hostname of the MQTT broker.
+  @param port the port of the MQTT broker.
+  @param topic the topic to publish to.
+  @param clientID the name of the client to appear as.
+  @param retries the number of connection attempts to make.
+*/
+void telemetryBegin(const char* broker, int port, const char* topic,
+                    const char* clientID, int retries);
+
+/**
+  Check whether telemetry mode is enabled for this wake.
+
+  @returns true after telemetryBegin().
+*/
+bool telemetryEnabled();
+
+/**
+  Record the battery voltage.
+
+  @param volts the battery voltage.
+*/
+void telemetrySetBattery(double volts);
+
+/**
+  Count a retry of an operation.
+
+  @param op the operation, see RETRY_COUNT.
+*/
+void telemetryRetry(uint8_t op);
+
+/**
+  Record an error code.
+
+  @param err the error.
+*/
+void telemetryError(esp_err_t err);
+
+/**
+  Connect to the MQTT broker, publish the wake's metrics and held log lines
+  as a single packet and disconnect. Call right before deep sleep while WiFi
+  is still up.
+
+  @param client the MQTT client to publish with.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_STATE if telemetry mode is not enabled or WiFi is down.
+  - ESP_ERR_TIMEOUT if the broker cannot be reached.
+  - ESP_FAIL if the MQTT publish fails.
+*/
+esp_err_t telemetryPublish(PubSubClient& client);
+
+#endif
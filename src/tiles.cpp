@@ -0,0 +1,307 @@
+#include "tiles.h"
+
+#include <esp_partition.h>
+
+#include "inkrle.h"
+#include "lib.h"
+
+// Sector layout: magic, hash of the tile's framebuffer rows, encoding,
+// a reserved byte, uint16 length of the tile data, then the tile data.
+#define TILE_SECTOR_HEADER 12
+#define TILE_ENCODING_RAW 0
+#define TILE_ENCODING_RLE 1
+
+// One tile and one sector's worth of tile data, shared by every operation.
+// No allocation.
+static uint8_t tileData[TILE_BYTES];
+static uint8_t sector[TILE_SECTOR_HEADER + TILE_BYTES];
+
+// Stored tile data pulled straight from flash by the decoder.
+struct FlashSource {
+    const esp_partition_t* store;
+    size_t offset;
+    size_t remaining;
+};
+
+static int readFlash(void* ctx, uint8_t* buf, size_t len) {
+    FlashSource* src = (FlashSource*)ctx;
+    if (len > src->remaining) len = src->remaining;
+    if (len == 0) return 0;
+    if (esp_partition_read(src->store, src->offset, buf, len) != ESP_OK) {
+        return -1;
+    }
+    src->offset += len;
+    src->remaining -= len;
+    return len;
+}
+
+static const esp_partition_t* tileStore() {
+    return esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)TILE_STORE_SUBTYPE,
+        TILE_STORE_LABEL);
+}
+
+/**
+  FNV-1a hash of a tile, as computed by the server for its manifest.
+*/
+static uint32_t tileHash(const uint8_t* data) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < TILE_BYTES; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    // 0 marks a missing tile in the manifest.
+    return h ? h : 1;
+}
+
+static inline uint8_t* tileOrigin(int index) {
+    int tx = index % TILES_X;
+    int ty = index / TILES_X;
+    return board.DMemory4Bit + ty * TILE_HEIGHT * (E_INK_WIDTH / 2) +
+           tx * TILE_ROW_BYTES;
+}
+
+static void tileRead(int index, uint8_t* data) {
+    const uint8_t* src = tileOrigin(index);
+    for (int row = 0; row < TILE_HEIGHT; row++) {
+        memcpy(data + row * TILE_ROW_BYTES, src, TILE_ROW_BYTES);
+        src += E_INK_WIDTH / 2;
+    }
+}
+
+static void tileWrite(int index, const uint8_t* data) {
+    uint8_t* dst = tileOrigin(index);
+    for (int row = 0; row < TILE_HEIGHT; row++) {
+        memcpy(dst, data + row * TILE_ROW_BYTES, TILE_ROW_BYTES);
+        dst += E_INK_WIDTH / 2;
+    }
+}
+
+static inline uint16_t getLE16(const uint8_t* p) { return p[0] | p[1] << 8; }
+
+static inline uint32_t getLE32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void putLE32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+  Read exactly len bytes of input.
+*/
+static esp_err_t readFully(PngReadFn read, void* ctx, uint8_t* buf,
+                           size_t len) {
+    while (len > 0) {
+        int n = read(ctx, buf, len);
+        if (n < 0) return ESP_ERR_TIMEOUT;
+        if (n == 0) return ESP_ERR_INVALID_RESPONSE;
+        buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+  Read the hash of each tile of the stored calendar.
+
+  @param hashes the TILE_COUNT tile hashes, 0 for a tile that is not stored.
+  @returns the esp_err_t code:
+  - ESP_OK if every tile is stored.
+  - ESP_ERR_NOT_FOUND if the partition is missing or some tiles are not
+  stored.
+*/
+esp_err_t tilesLoadManifest(uint32_t* hashes) {
+    const esp_partition_t* store = tileStore();
+    if (store == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < TILE_COUNT; i++) {
+        uint8_t header[TILE_SECTOR_HEADER];
+        hashes[i] = 0;
+        if (esp_partition_read(store, i * TILE_SECTOR_SIZE, header,
+                               sizeof(header)) == ESP_OK &&
+            getLE32(header) == TILE_SECTOR_MAGIC) {
+            hashes[i] = getLE32(header + 4);
+        }
+        if (hashes[i] == 0) err = ESP_ERR_NOT_FOUND;
+    }
+
+    return err;
+}
+
+/**
+  Copy the stored calendar into the 3-bit display buffer, eg. to draw over the
+  last good calendar without the network or SD card.
+
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the partition is missing or some tiles are not
+  stored.
+  - ESP_ERR_INVALID_CRC if a stored tile is corrupt.
+*/
+esp_err_t tilesRestore() {
+    const esp_partition_t* store = tileStore();
+    if (store == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    for (int i = 0; i < TILE_COUNT; i++) {
+        uint8_t header[TILE_SECTOR_HEADER];
+        size_t offset = i * TILE_SECTOR_SIZE;
+        if (esp_partition_read(store, offset, header, sizeof(header)) !=
+                ESP_OK ||
+            getLE32(header) != TILE_SECTOR_MAGIC) {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        // Only the tile's coded length is read from flash.
+        FlashSource src = {store, offset + TILE_SECTOR_HEADER,
+                           getLE16(header + 10)};
+        uint32_t bytesIn;
+        esp_err_t err = ESP_ERR_INVALID_CRC;
+        if (header[8] == TILE_ENCODING_RLE) {
+            err = inkRleDecode(readFlash, &src, tileData, TILE_WIDTH,
+                               TILE_HEIGHT, &bytesIn);
+        } else if (header[8] == TILE_ENCODING_RAW &&
+                   src.remaining == TILE_BYTES) {
+            err = esp_partition_read(store, src.offset, tileData,
+                                     TILE_BYTES);
+        }
+        if (err != ESP_OK || tileHash(tileData) != getLE32(header + 4)) {
+            return ESP_ERR_INVALID_CRC;
+        }
+        tileWrite(i, tileData);
+    }
+
+    return ESP_OK;
+}
+
+/**
+  Store the tiles of the 3-bit display buffer that differ from the stored
+  calendar.
+
+  @param written the number of tiles written to flash.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the partition is missing.
+  - ESP_FAIL if writing to flash fails.
+*/
+esp_err_t tilesSave(int* written) {
+    *written = 0;
+    const esp_partition_t* store = tileStore();
+    if (store == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    for (int i = 0; i < TILE_COUNT; i++) {
+        uint8_t header[TILE_SECTOR_HEADER];
+        size_t offset = i * TILE_SECTOR_SIZE;
+
+        tileRead(i, tileData);
+        uint32_t hash = tileHash(tileData);
+        if (esp_partition_read(store, offset, header, sizeof(header)) ==
+                ESP_OK &&
+            getLE32(header) == TILE_SECTOR_MAGIC &&
+            getLE32(header + 4) == hash) {
+            continue;
+        }
+
+        // Noisy tiles that do not shrink are stored as is.
+        uint32_t length;
+        uint8_t* data = sector + TILE_SECTOR_HEADER;
+        uint8_t encoding = TILE_ENCODING_RLE;
+        if (inkRleEncode(tileData, TILE_WIDTH, TILE_HEIGHT, data,
+                         TILE_BYTES - 1, &length) != ESP_OK) {
+            encoding = TILE_ENCODING_RAW;
+            length = TILE_BYTES;
+            memcpy(data, tileData, TILE_BYTES);
+        }
+
+        putLE32(sector, TILE_SECTOR_MAGIC);
+        putLE32(sector + 4, hash);
+        sector[8] = encoding;
+        sector[9] = 0;
+        sector[10] = length;
+        sector[11] = length >> 8;
+        if (esp_partition_erase_range(store, offset, TILE_SECTOR_SIZE) !=
+                ESP_OK ||
+            esp_partition_write(store, offset, sector,
+                                TILE_SECTOR_HEADER + length) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        (*written)++;
+    }
+
+    return ESP_OK;
+}
+
+/**
+  Patch the 3-bit display buffer with the tiles of a delta response.
+
+  @param read the input to pull the delta from.
+  @param ctx the context passed to read.
+  @param info the summary of the applied delta.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_SUPPORTED if the delta is for another tile layout.
+  - ESP_ERR_INVALID_RESPONSE if the delta is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t tilesApplyDelta(PngReadFn read, void* ctx, TileDeltaInfo* info) {
+    uint8_t header[TILE_DELTA_HEADER_SIZE];
+    esp_err_t err = readFully(read, ctx, header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (memcmp(header, TILE_DELTA_MAGIC, 4) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint16_t count = header[6] | header[7] << 8;
+    uint16_t tileWidth = header[8] | header[9] << 8;
+    uint16_t tileHeight = header[10] | header[11] << 8;
+    if (header[4] != TILE_DELTA_VERSION || header[5] != board.getRotation() ||
+        tileWidth != TILE_WIDTH || tileHeight != TILE_HEIGHT ||
+        count > TILE_COUNT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    info->tiles = count;
+    info->bytesIn = sizeof(header);
+    info->x0 = info->y0 = UINT16_MAX;
+    info->x1 = info->y1 = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint8_t index[2];
+        err = readFully(read, ctx, index, sizeof(index));
+        if (err == ESP_OK) {
+            err = readFully(read, ctx, tileData, TILE_BYTES);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        int tile = index[0] | index[1] << 8;
+        if (tile >= TILE_COUNT) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        tileWrite(tile, tileData);
+        info->bytesIn += sizeof(index) + TILE_BYTES;
+
+        uint16_t x = tile % TILES_X * TILE_WIDTH;
+        uint16_t y = tile / TILES_X * TILE_HEIGHT;
+        info->x0 = min(info->x0, x);
+        info->y0 = min(info->y0, y);
+        info->x1 = max(info->x1, (uint16_t)(x + TILE_WIDTH));
+        info->y1 = max(info->y1, (uint16_t)(y + TILE_HEIGHT));
+    }
+    if (count == 0) {
+        info->x0 = info->y0 = 0;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,90 @@
+#ifndef TILES_H
+#define TILES_H
+#include <Inkplate.h>
+
+#include "png.h"
+
+// The framebuffer is split into tiles in the panel's native orientation so
+// unchanged parts of the calendar need not be downloaded or stored again.
+// Tiles are an even number of pixels wide so they start on a byte.
+#define TILE_WIDTH 80
+#define TILE_HEIGHT 75
+#define TILES_X (E_INK_WIDTH / TILE_WIDTH)
+#define TILES_Y (E_INK_HEIGHT / TILE_HEIGHT)
+#define TILE_COUNT (TILES_X * TILES_Y)
+#define TILE_ROW_BYTES (TILE_WIDTH / 2)
+#define TILE_BYTES (TILE_ROW_BYTES * TILE_HEIGHT)
+
+// Flash partition holding the last drawn calendar, one tile per sector so a
+// changed tile costs a single sector erase. Tiles are run-length coded (see
+// inkrle.h) so restoring mostly-white tiles reads little flash. See
+// partitions.csv.
+#define TILE_STORE_LABEL "framebuf"
+#define TILE_STORE_SUBTYPE 0x40
+#define TILE_SECTOR_SIZE 4096
+#define TILE_SECTOR_MAGIC 0x324c4954  // "TIL2"
+
+// A tile delta response: a header followed by the changed tiles, each a
+// little-endian uint16 tile index and TILE_BYTES of framebuffer data.
+#define TILE_DELTA_MAGIC "INKD"
+#define TILE_DELTA_VERSION 1
+#define TILE_DELTA_HEADER_SIZE 16
+
+// Summary of an applied tile delta.
+struct TileDeltaInfo {
+    uint16_t tiles;     // number of changed tiles
+    uint32_t bytesIn;   // delta bytes consumed
+    // Bounding box of the changed tiles in panel pixels, empty if none.
+    uint16_t x0, y0, x1, y1;
+};
+
+/**
+  Read the hash of each tile of the stored calendar.
+
+  @param hashes the TILE_COUNT tile hashes, 0 for a tile that is not stored.
+  @returns the esp_err_t code:
+  - ESP_OK if every tile is stored.
+  - ESP_ERR_NOT_FOUND if the partition is missing or some tiles are not
+  stored.
+*/
+esp_err_t tilesLoadManifest(uint32_t* hashes);
+
+/**
+  Copy the stored calendar into the 3-bit display buffer, eg. to draw over the
+  last good calendar without the network or SD card.
+
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the partition is missing or some tiles are not
+  stored.
+  - ESP_ERR_INVALID_CRC if a stored tile is corrupt.
+*/
+esp_err_t tilesRestore();
+
+/**
+  Store the tiles of the 3-bit display buffer that differ from the stored
+  calendar.
+
+  @param written the number of tiles written to flash.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_FOUND if the partition is missing.
+  - ESP_FAIL if writing to flash fails.
+*/
+esp_err_t tilesSave(int* written);
+
+/**
+  Patch the 3-bit display buffer with the tiles of a delta response.
+
+  @param read the input to pull the delta from.
+  @param ctx the context passed to read.
+  @param info the summary of the applied delta.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_NOT_SUPPORTED if the delta is for another tile layout.
+  - ESP_ERR_INVALID_RESPONSE if the delta is malformed.
+  - ESP_ERR_TIMEOUT if reading the input fails.
+*/
+esp_err_t tilesApplyDelta(PngReadFn read, void* ctx, TileDeltaInfo* info);
+
+#endif
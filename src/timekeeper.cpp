@@ -0,0 +1,69 @@
+#include "timekeeper.h"
+
+#define TIMEKEEPER_MAGIC 0x314b4954  // "TIK1"
+
+// Sync history, kept in RTC memory across deep sleep.
+struct TimeKeeping {
+    uint32_t magic;
+    uint32_t lastSync;       // UTC time of the last sync
+    int32_t driftPpb;        // RTC gain, positive when it runs fast
+    uint32_t driftInterval;  // seconds the drift was measured over, 0 if none
+};
+
+RTC_DATA_ATTR static TimeKeeping keeping;
+
+/**
+  Predict how far off the RTC is since the last NTP sync.
+
+  @param rtcTime the time read from the RTC, UTC.
+  @returns the predicted error in milliseconds, or -1 if the RTC must be
+  synced: it has never been synced since power on or its last sync is older
+  than TIME_MAX_SYNC_INTERVAL.
+*/
+int32_t timekeeperPredictError(time_t rtcTime) {
+    if (keeping.magic != TIMEKEEPER_MAGIC || rtcTime < keeping.lastSync) {
+        return -1;
+    }
+    uint32_t elapsed = rtcTime - keeping.lastSync;
+    if (elapsed > TIME_MAX_SYNC_INTERVAL) return -1;
+
+    // The measured drift plus its own uncertainty: the RTC reads whole
+    // seconds, so a measurement over N seconds is good to 1/N.
+    int64_t ppb = TIME_DEFAULT_DRIFT_PPB;
+    if (keeping.driftInterval > 0) {
+        ppb = llabs(keeping.driftPpb) + 1000000000LL / keeping.driftInterval;
+    }
+    // Plus a second for reading and setting the RTC.
+    int64_t errorMs = (int64_t)elapsed * ppb / 1000000 + 1000;
+    return errorMs < INT32_MAX ? errorMs : INT32_MAX;
+}
+
+/**
+  Record an NTP sync, measuring the RTC drift since the last one.
+
+  @param rtcTime the time read from the RTC before it was set, UTC, or 0 if
+  the RTC was not set.
+  @param ntpTime the network time it was set to, UTC.
+  @returns the measured drift in parts per billion, positive when the RTC
+  runs fast, or the previous estimate if the last sync was too recent to
+  measure it or the RTC was stepped.
+*/
+int32_t timekeeperSynced(time_t rtcTime, time_t ntpTime) {
+    if (keeping.magic != TIMEKEEPER_MAGIC) {
+        memset(&keeping, 0, sizeof(keeping));
+        keeping.magic = TIMEKEEPER_MAGIC;
+    } else if (rtcTime != 0 && ntpTime > keeping.lastSync) {
+        uint32_t elapsed = ntpTime - keeping.lastSync;
+        if (elapsed >= TIME_MIN_DRIFT_INTERVAL) {
+            int64_t gain = (int64_t)(rtcTime - ntpTime);
+            int64_t ppb = gain * 1000000000LL / elapsed;
+            // A step is not drift: keep the previous estimate.
+            if (llabs(ppb) <= TIME_MAX_DRIFT_PPB) {
+                keeping.driftPpb = ppb;
+                keeping.driftInterval = elapsed;
+            }
+        }
+    }
+    keeping.lastSync = ntpTime;
+    return keeping.driftPpb;
+}
@@ -0,0 +1,43 @@
+#ifndef TIMEKEEPER_H
+#define TIMEKEEPER_H
+#include <Arduino.h>
+
+// The RTC keeps UTC between NTP syncs. Each sync measures how fast or slow
+// it runs, so a wake can predict how far off the RTC is and only sync when
+// that exceeds a tolerance.
+
+// Drift assumed until one is measured, in parts per billion. Generous for a
+// watch crystal, so the first syncs come often.
+#define TIME_DEFAULT_DRIFT_PPB 100000
+// Shortest time between syncs to measure the drift over, shorter intervals
+// are dominated by the RTC's one second resolution.
+#define TIME_MIN_DRIFT_INTERVAL (6 * 3600UL)
+// Longest time between syncs however good the drift estimate.
+#define TIME_MAX_SYNC_INTERVAL (14 * 86400UL)
+// Largest gain a crystal can plausibly drift by, 1000ppm. A larger correction
+// means the RTC was stepped, eg. set wrong or reset, rather than drifting.
+#define TIME_MAX_DRIFT_PPB 1000000
+
+/**
+  Predict how far off the RTC is since the last NTP sync.
+
+  @param rtcTime the time read from the RTC, UTC.
+  @returns the predicted error in milliseconds, or -1 if the RTC must be
+  synced: it has never been synced since power on or its last sync is older
+  than TIME_MAX_SYNC_INTERVAL.
+*/
+int32_t timekeeperPredictError(time_t rtcTime);
+
+/**
+  Record an NTP sync, measuring the RTC drift since the last one.
+
+  @param rtcTime the time read from the RTC before it was set, UTC, or 0 if
+  the RTC was not set.
+  @param ntpTime the network time it was set to, UTC.
+  @returns the measured drift in parts per billion, positive when the RTC
+  runs fast, or the previous estimate if the last sync was too recent to
+  measure it or the RTC was stepped.
+*/
+int32_t timekeeperSynced(time_t rtcTime, time_t ntpTime);
+
+#endif
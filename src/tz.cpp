@@ -0,0 +1,267 @@
+#include "tz.h"
+
+#include "zones.h"
+
+#define SECONDS_PER_DAY 86400L
+// Transition rule types.
+#define TZ_RULE_JULIAN1 0  // Jn: day 1-365, February 29th is never counted
+#define TZ_RULE_JULIAN0 1  // n: day 0-365, counting February 29th
+#define TZ_RULE_MONTH 2    // Mm.w.d: day d of week w (5 is last) of month m
+
+// When daylight saving starts or ends, in local time before the change.
+struct TzTransition {
+    uint8_t type;
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;  // 0 is Sunday
+    uint16_t day;
+    int32_t time;  // seconds after midnight, may be negative or over 24h
+};
+
+struct TzRule {
+    int32_t stdOffset;  // seconds east of UTC
+    int32_t dstOffset;
+    bool hasDst;
+    TzTransition start;
+    TzTransition end;
+};
+
+// UTC until tzSet().
+static TzRule rule;
+
+/**
+  Days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+*/
+static int32_t daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+  The year of a day since 1970-01-01.
+*/
+static int yearFromDays(int32_t days) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = days - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    return yoe + era * 400 + (mp >= 10);
+}
+
+static bool isLeap(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int32_t floorDiv(int64_t a, int32_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+  The time of a transition in a year, in seconds since the epoch of the local
+  time it is given in.
+*/
+static int64_t transitionTime(const TzTransition* t, int year) {
+    int32_t days;
+    if (t->type == TZ_RULE_JULIAN1) {
+        days = daysFromCivil(year, 1, 1) + t->day - 1;
+        if (isLeap(year) && t->day >= 60) days++;
+    } else if (t->type == TZ_RULE_JULIAN0) {
+        days = daysFromCivil(year, 1, 1) + t->day;
+    } else {
+        int32_t first = daysFromCivil(year, t->month, 1);
+        int32_t next = t->month == 12 ? daysFromCivil(year + 1, 1, 1)
+                                      : daysFromCivil(year, t->month + 1, 1);
+        // 1970-01-01 was a Thursday.
+        int weekday = ((first % 7) + 11) % 7;
+        days = first + (t->weekday - weekday + 7) % 7 + (t->week - 1) * 7;
+        while (days >= next) days -= 7;
+    }
+    return (int64_t)days * SECONDS_PER_DAY + t->time;
+}
+
+static bool isDst(time_t utc) {
+    if (!rule.hasDst) return false;
+    int year = yearFromDays(floorDiv(utc + rule.stdOffset, SECONDS_PER_DAY));
+    // Daylight saving starts in standard time and ends in daylight time.
+    int64_t start = transitionTime(&rule.start, year) - rule.stdOffset;
+    int64_t end = transitionTime(&rule.end, year) - rule.dstOffset;
+    if (start < end) return utc >= start && utc < end;
+    // Southern hemisphere, or a zone whose "daylight" time is in winter.
+    return utc < end || utc >= start;
+}
+
+/**
+  Parse a timezone abbreviation, eg. "GMT" or "<+0330>".
+*/
+static const char* parseName(const char* p) {
+    if (*p == '<') {
+        const char* close = strchr(p, '>');
+        return close && close - p > 1 ? close + 1 : NULL;
+    }
+    const char* start = p;
+    while (isalpha((unsigned char)*p)) p++;
+    return p - start >= 3 ? p : NULL;
+}
+
+/**
+  Parse [+-]hh[:mm[:ss]] into seconds.
+*/
+static const char* parseTime(const char* p, int32_t* seconds) {
+    int sign = 1;
+    if (*p == '+' || *p == '-') sign = *p++ == '-' ? -1 : 1;
+    if (!isdigit((unsigned char)*p)) return NULL;
+    int32_t value = 0;
+    for (int part = 0; part < 3; part++) {
+        int n = 0;
+        if (!isdigit((unsigned char)*p)) return NULL;
+        while (isdigit((unsigned char)*p)) n = n * 10 + (*p++ - '0');
+        value += n * (part == 0 ? 3600 : part == 1 ? 60 : 1);
+        if (*p != ':') break;
+        p++;
+    }
+    *seconds = sign * value;
+    return p;
+}
+
+static const char* parseNumber(const char* p, int min, int max, int* n) {
+    if (!isdigit((unsigned char)*p)) return NULL;
+    *n = 0;
+    while (isdigit((unsigned char)*p)) *n = *n * 10 + (*p++ - '0');
+    return *n >= min && *n <= max ? p : NULL;
+}
+
+/**
+  Parse a transition, eg. "M3.5.0/1", "J60" or "59/2".
+*/
+static const char* parseTransition(const char* p, TzTransition* t) {
+    int n;
+    memset(t, 0, sizeof(*t));
+    if (*p == 'M') {
+        t->type = TZ_RULE_MONTH;
+        if (!(p = parseNumber(p + 1, 1, 12, &n)) || *p != '.') return NULL;
+        t->month = n;
+        if (!(p = parseNumber(p + 1, 1, 5, &n)) || *p != '.') return NULL;
+        t->week = n;
+        if (!(p = parseNumber(p + 1, 0, 6, &n))) return NULL;
+        t->weekday = n;
+    } else if (*p == 'J') {
+        t->type = TZ_RULE_JULIAN1;
+        if (!(p = parseNumber(p + 1, 1, 365, &n))) return NULL;
+        t->day = n;
+    } else {
+        t->type = TZ_RULE_JULIAN0;
+        if (!(p = parseNumber(p, 0, 365, &n))) return NULL;
+        t->day = n;
+    }
+    t->time = 2 * 3600;
+    if (*p == '/') p = parseTime(p + 1, &t->time);
+    return p;
+}
+
+static esp_err_t parseRule(const char* p, TzRule* r) {
+    int32_t offset;
+    memset(r, 0, sizeof(*r));
+    // POSIX offsets are west of UTC.
+    if (!(p = parseName(p)) || !(p = parseTime(p, &offset))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    r->stdOffset = r->dstOffset = -offset;
+    if (*p == '\0') return ESP_OK;
+
+    if (!(p = parseName(p))) return ESP_ERR_INVALID_ARG;
+    r->hasDst = true;
+    r->dstOffset = r->stdOffset + 3600;
+    if (*p != ',' && *p != '\0') {
+        if (!(p = parseTime(p, &offset))) return ESP_ERR_INVALID_ARG;
+        r->dstOffset = -offset;
+    }
+    // Without transitions, the POSIX default of US rules.
+    if (*p == '\0') p = ",M3.2.0,M11.1.0";
+    if (*p != ',' || !(p = parseTransition(p + 1, &r->start)) || *p != ',' ||
+        !(p = parseTransition(p + 1, &r->end)) || *p != '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+  Find the POSIX TZ rule of a timezone.
+
+  @param name the name of the timezone in Olson format (eg. Europe/Dublin), or
+  a POSIX TZ rule which is returned as is.
+  @returns the rule, or NULL if the timezone is not in the built-in table.
+*/
+const char* tzLookup(const char* name) {
+    if (name == NULL) return NULL;
+    // Olson names have no offset, except the Etc/GMT+n zones.
+    if (strchr(name, '/') == NULL && strpbrk(name, "0123456789")) return name;
+
+    int lo = 0, hi = sizeof(tzZones) / sizeof(tzZones[0]) - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(name, tzZones[mid].name);
+        if (cmp == 0) return tzZones[mid].posix;
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+  Set the timezone used for local time.
+
+  @param posix the POSIX TZ rule of the timezone.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the rule cannot be parsed, local time stays as it
+  was.
+*/
+esp_err_t tzSet(const char* posix) {
+    TzRule parsed;
+    if (posix == NULL || parseRule(posix, &parsed) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    rule = parsed;
+    return ESP_OK;
+}
+
+/**
+  Get the offset of local time from UTC.
+
+  @param utc the UTC time.
+  @returns the offset in seconds east of UTC.
+*/
+int32_t tzOffset(time_t utc) {
+    return isDst(utc) ? rule.dstOffset : rule.stdOffset;
+}
+
+/**
+  Convert a UTC time to local time.
+
+  @param utc the UTC time.
+  @returns the local time.
+*/
+time_t tzLocalTime(time_t utc) { return utc + tzOffset(utc); }
+
+/**
+  Convert a local time to UTC. A local time repeated when the clocks change
+  is taken as daylight saving time, one that is skipped as standard time.
+
+  @param local the local time.
+  @returns the UTC time.
+*/
+time_t tzUTCTime(time_t local) {
+    if (rule.hasDst && isDst(local - rule.dstOffset)) {
+        return local - rule.dstOffset;
+    }
+    return local - rule.stdOffset;
+}
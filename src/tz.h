@@ -0,0 +1,57 @@
+#ifndef TZ_H
+#define TZ_H
+#include <Arduino.h>
+
+// Local time from POSIX TZ rules (eg. "IST-1GMT0,M10.5.0,M3.5.0/1"), worked
+// out on the device so no timezone lookup is needed over the network. Until
+// a rule is set local time is UTC.
+
+// Longest POSIX TZ rule.
+#define TZ_POSIX_MAX 64
+
+/**
+  Find the POSIX TZ rule of a timezone.
+
+  @param name the name of the timezone in Olson format (eg. Europe/Dublin), or
+  a POSIX TZ rule which is returned as is.
+  @returns the rule, or NULL if the timezone is not in the built-in table.
+*/
+const char* tzLookup(const char* name);
+
+/**
+  Set the timezone used for local time.
+
+  @param posix the POSIX TZ rule of the timezone.
+  @returns the esp_err_t code:
+  - ESP_OK if successful.
+  - ESP_ERR_INVALID_ARG if the rule cannot be parsed, local time stays as it
+  was.
+*/
+esp_err_t tzSet(const char* posix);
+
+/**
+  Get the offset of local time from UTC.
+
+  @param utc the UTC time.
+  @returns the offset in seconds east of UTC.
+*/
+int32_t tzOffset(time_t utc);
+
+/**
+  Convert a UTC time to local time.
+
+  @param utc the UTC time.
+  @returns the local time.
+*/
+time_t tzLocalTime(time_t utc);
+
+/**
+  Convert a local time to UTC. A local time repeated when the clocks change
+  is taken as daylight saving time, one that is skipped as standard time.
+
+  @param local the local time.
+  @returns the UTC time.
+*/
+time_t tzUTCTime(time_t local);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef ZONES_H
+#define ZONES_H
+
+// POSIX TZ rules of common IANA timezones, from the rule at the end of each
+// zone's tzdata file (tzdata 2025b). To add a zone, take the last line of
+// /usr/share/zoneinfo/<zone> and keep the table sorted by name. Changes no
+// POSIX rule can describe, like Casablanca's around Ramadan, are left out.
+struct TzZone {
+    const char* name;
+    const char* posix;
+};
+
+static const TzZone tzZones[] = {
+    {"Africa/Accra", "GMT0"},
+    {"Africa/Algiers", "CET-1"},
+    {"Africa/Cairo", "EET-2EEST,M4.5.5/0,M10.5.4/24"},
+    {"Africa/Casablanca", "<+01>-1"},
+    {"Africa/Johannesburg", "SAST-2"},
+    {"Africa/Lagos", "WAT-1"},
+    {"Africa/Nairobi", "EAT-3"},
+    {"America/Anchorage", "AKST9AKDT,M3.2.0,M11.1.0"},
+    {"America/Argentina/Buenos_Aires", "<-03>3"},
+    {"America/Asuncion", "<-03>3"},
+    {"America/Bogota", "<-05>5"},
+    {"America/Caracas", "<-04>4"},
+    {"America/Chicago", "CST6CDT,M3.2.0,M11.1.0"},
+    {"America/Denver", "MST7MDT,M3.2.0,M11.1.0"},
+    {"America/Detroit", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Edmonton", "MST7MDT,M3.2.0,M11.1.0"},
+    {"America/Guatemala", "CST6"},
+    {"America/Halifax", "AST4ADT,M3.2.0,M11.1.0"},
+    {"America/Havana", "CST5CDT,M3.2.0/0,M11.1.0/1"},
+    {"America/Lima", "<-05>5"},
+    {"America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+    {"America/Mexico_City", "CST6"},
+    {"America/Montevideo", "<-03>3"},
+    {"America/New_York", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Panama", "EST5"},
+    {"America/Phoenix", "MST7"},
+    {"America/Puerto_Rico", "AST4"},
+    {"America/Regina", "CST6"},
+    {"America/Santiago", "<-04>4<-03>,M9.1.6/24,M4.1.6/24"},
+    {"America/Sao_Paulo", "<-03>3"},
+    {"America/St_Johns", "NST3:30NDT,M3.2.0,M11.1.0"},
+    {"America/Toronto", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Vancouver", "PST8PDT,M3.2.0,M11.1.0"},
+    {"America/Winnipeg", "CST6CDT,M3.2.0,M11.1.0"},
+    {"Asia/Almaty", "<+05>-5"},
+    {"Asia/Baghdad", "<+03>-3"},
+    {"Asia/Bangkok", "<+07>-7"},
+    {"Asia/Beirut", "EET-2EEST,M3.5.0/0,M10.5.0/0"},
+    {"Asia/Colombo", "<+0530>-5:30"},
+    {"Asia/Dhaka", "<+06>-6"},
+    {"Asia/Dubai", "<+04>-4"},
+    {"Asia/Ho_Chi_Minh", "<+07>-7"},
+    {"Asia/Hong_Kong", "HKT-8"},
+    {"Asia/Jakarta", "WIB-7"},
+    {"Asia/Jerusalem", "IST-2IDT,M3.4.4/26,M10.5.0"},
+    {"Asia/Kabul", "<+0430>-4:30"},
+    {"Asia/Karachi", "PKT-5"},
+    {"Asia/Kathmandu", "<+0545>-5:45"},
+    {"Asia/Kolkata", "IST-5:30"},
+    {"Asia/Kuala_Lumpur", "<+08>-8"},
+    {"Asia/Manila", "PST-8"},
+    {"Asia/Riyadh", "<+03>-3"},
+    {"Asia/Seoul", "KST-9"},
+    {"Asia/Shanghai", "CST-8"},
+    {"Asia/Singapore", "<+08>-8"},
+    {"Asia/Taipei", "CST-8"},
+    {"Asia/Tashkent", "<+05>-5"},
+    {"Asia/Tehran", "<+0330>-3:30"},
+    {"Asia/Tokyo", "JST-9"},
+    {"Asia/Yangon", "<+0630>-6:30"},
+    {"Atlantic/Azores", "<-01>1<+00>,M3.5.0/0,M10.5.0/1"},
+    {"Atlantic/Canary", "WET0WEST,M3.5.0/1,M10.5.0"},
+    {"Atlantic/Reykjavik", "GMT0"},
+    {"Australia/Adelaide", "ACST-9:30ACDT,M10.1.0,M4.1.0/3"},
+    {"Australia/Brisbane", "AEST-10"},
+    {"Australia/Darwin", "ACST-9:30"},
+    {"Australia/Hobart", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Australia/Melbourne", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Australia/Perth", "AWST-8"},
+    {"Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Europe/Amsterdam", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Athens", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Belgrade", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Berlin", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Brussels", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Bucharest", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Budapest", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Copenhagen", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Dublin", "IST-1GMT0,M10.5.0,M3.5.0/1"},
+    {"Europe/Helsinki", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Istanbul", "<+03>-3"},
+    {"Europe/Kyiv", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Lisbon", "WET0WEST,M3.5.0/1,M10.5.0"},
+    {"Europe/London", "GMT0BST,M3.5.0/1,M10.5.0"},
+    {"Europe/Luxembourg", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Madrid", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Minsk", "<+03>-3"},
+    {"Europe/Moscow", "MSK-3"},
+    {"Europe/Oslo", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Paris", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Prague", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Riga", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Rome", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Sofia", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Stockholm", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Tallinn", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Vienna", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Vilnius", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Europe/Warsaw", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/Zurich", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Pacific/Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+    {"Pacific/Fiji", "<+12>-12"},
+    {"Pacific/Guam", "ChST-10"},
+    {"Pacific/Honolulu", "HST10"},
+    {"Pacific/Port_Moresby", "<+10>-10"},
+    {"Pacific/Tongatapu", "<+13>-13"},
+    {"UTC", "UTC0"},
+};
+
+#endif